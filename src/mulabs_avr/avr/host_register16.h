@@ -0,0 +1,96 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__AVR__HOST_REGISTER16_H__INCLUDED
+#define MULABS_AVR__AVR__HOST_REGISTER16_H__INCLUDED
+
+// Standard:
+#include <stdlib.h>
+
+// Mulabs:
+#include <mulabs_avr/avr/host_register_file.h>
+
+
+namespace mulabs {
+namespace avr {
+
+/**
+ * Same interface as BasicRegister16, but backed by the HostRegisterFile.
+ * See HostRegister8.
+ */
+class HostRegister16
+{
+  public:
+	// Ctor
+	constexpr
+	HostRegister16 (size_t base_address);
+
+	uint16_t
+	read() const;
+
+	void
+	write (uint16_t value) const;
+
+	HostRegister16 const&
+	operator= (uint16_t value) const;
+
+	/**
+	 * Reference the simulated register.
+	 */
+	uint16_t volatile&
+	ref() const;
+
+  private:
+	size_t	_address;
+};
+
+
+constexpr
+HostRegister16::HostRegister16 (size_t base_address):
+	_address (base_address)
+{ }
+
+
+inline uint16_t
+HostRegister16::read() const
+{
+	return HostRegisterFile::read16 (_address);
+}
+
+
+inline void
+HostRegister16::write (uint16_t value) const
+{
+	HostRegisterFile::write16 (_address, value);
+}
+
+
+inline HostRegister16 const&
+HostRegister16::operator= (uint16_t value) const
+{
+	write (value);
+	return *this;
+}
+
+
+inline uint16_t volatile&
+HostRegister16::ref() const
+{
+	return HostRegisterFile::ref16 (_address);
+}
+
+} // namespace avr
+} // namespace mulabs
+
+#endif
+
@@ -0,0 +1,219 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__AVR__HOST_REGISTER8_H__INCLUDED
+#define MULABS_AVR__AVR__HOST_REGISTER8_H__INCLUDED
+
+// Standard:
+#include <stdlib.h>
+
+// Mulabs:
+#include <mulabs_avr/avr/host_register_file.h>
+#include <mulabs_avr/utility/bits.h>
+
+
+namespace mulabs {
+namespace avr {
+
+/**
+ * Same interface as BasicRegister8, but backed by the HostRegisterFile, so that drivers can be compiled
+ * and run on the development machine. Every access done with read()/write() (including bit operations)
+ * is counted by the HostRegisterFile. Accesses done through ref() are not counted.
+ */
+class HostRegister8
+{
+  public:
+	// Ctor
+	constexpr
+	HostRegister8 (size_t address);
+
+	/**
+	 * Read value from the register.
+	 */
+	uint8_t
+	read() const;
+
+	/**
+	 * Alias for read().
+	 */
+	operator uint8_t() const;
+
+	/**
+	 * Write value to the register.
+	 */
+	void
+	write (uint8_t value) const;
+
+	/**
+	 * Alias for write (uint8_t).
+	 */
+	HostRegister8 const&
+	operator= (uint8_t value) const;
+
+	/**
+	 * Reference the simulated register.
+	 */
+	uint8_t volatile&
+	ref() const;
+
+	/**
+	 * Set given bit to given value.
+	 */
+	template<uint8_t Bit>
+		void
+		set_bit_value (bool value) const;
+
+	/**
+	 * Set given bit to 1.
+	 */
+	template<uint8_t Bit>
+		void
+		set_bit() const;
+
+	/**
+	 * Clear given bit.
+	 */
+	template<uint8_t Bit>
+		void
+		clear_bit() const;
+
+	/**
+	 * Set unsigned int value in given bits.
+	 */
+	template<uint8_t MostSignificantBit, uint8_t LeastSignificantBit>
+		void
+		set_bits_value (uint8_t value) const;
+
+	/**
+	 * Return value of given bit.
+	 */
+	template<uint8_t Bit>
+		bool
+		get_bit() const;
+
+	/**
+	 * Get unsigned int value from given bits (right-shifted).
+	 */
+	template<uint8_t MostSignificantBit, uint8_t LeastSignificantBit>
+		uint8_t
+		get_bits_value() const;
+
+  private:
+	size_t	_address;
+};
+
+
+constexpr
+HostRegister8::HostRegister8 (size_t address):
+	_address (address)
+{ }
+
+
+inline uint8_t
+HostRegister8::read() const
+{
+	return HostRegisterFile::read8 (_address);
+}
+
+
+inline
+HostRegister8::operator uint8_t() const
+{
+	return read();
+}
+
+
+inline void
+HostRegister8::write (uint8_t value) const
+{
+	HostRegisterFile::write8 (_address, value);
+}
+
+
+inline HostRegister8 const&
+HostRegister8::operator= (uint8_t value) const
+{
+	write (value);
+	return *this;
+}
+
+
+inline uint8_t volatile&
+HostRegister8::ref() const
+{
+	return HostRegisterFile::ref8 (_address);
+}
+
+
+template<uint8_t Bit>
+	inline void
+	HostRegister8::set_bit_value (bool value) const
+	{
+		uint8_t v = read();
+		mulabs::avr::set_bit_value<Bit> (v, value);
+		write (v);
+	}
+
+
+template<uint8_t Bit>
+	inline void
+	HostRegister8::set_bit() const
+	{
+		uint8_t v = read();
+		mulabs::avr::set_bit<Bit> (v);
+		write (v);
+	}
+
+
+template<uint8_t Bit>
+	inline void
+	HostRegister8::clear_bit() const
+	{
+		uint8_t v = read();
+		mulabs::avr::clear_bit<Bit> (v);
+		write (v);
+	}
+
+
+template<uint8_t MostSignificantBit, uint8_t LeastSignificantBit>
+	inline void
+	HostRegister8::set_bits_value (uint8_t value) const
+	{
+		uint8_t v = read();
+		mulabs::avr::set_bits_value<MostSignificantBit, LeastSignificantBit> (v, value);
+		write (v);
+	}
+
+
+template<uint8_t Bit>
+	inline bool
+	HostRegister8::get_bit() const
+	{
+		uint8_t v = read();
+		return mulabs::avr::get_bit<Bit> (v);
+	}
+
+
+template<uint8_t MostSignificantBit, uint8_t LeastSignificantBit>
+	inline uint8_t
+	HostRegister8::get_bits_value() const
+	{
+		uint8_t v = read();
+		return mulabs::avr::get_bits_value<MostSignificantBit, LeastSignificantBit> (v);
+	}
+
+} // namespace avr
+} // namespace mulabs
+
+#endif
+
@@ -0,0 +1,297 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__AVR__HOST_REGISTER_FILE_H__INCLUDED
+#define MULABS_AVR__AVR__HOST_REGISTER_FILE_H__INCLUDED
+
+// Standard:
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+
+namespace mulabs {
+namespace avr {
+
+/**
+ * Simulated I/O memory for off-target (host) builds, used by HostRegister8 and HostRegister16.
+ *
+ * Addresses below kSize are simulated device registers. Addresses at or above kSize are treated as pointers
+ * to host memory - this is for registers that on the MCU live in regular SRAM, like USB endpoint descriptors.
+ *
+ * All reads and writes done through registers are counted per address and globally. To measure register
+ * traffic of a particular piece of code, wrap it in a Probe:
+ *
+ *   HostRegisterFile::Traffic traffic;
+ *   {
+ *       HostRegisterFile::Probe probe (traffic);
+ *       control_transfer.handle_interrupt (...);
+ *   }
+ *   // traffic.reads, traffic.writes are now set.
+ */
+class HostRegisterFile
+{
+  public:
+	// Size of the simulated I/O memory. Covers whole I/O space of both XMEGA and ATMega devices:
+	static constexpr size_t kSize = 0x1000;
+
+	struct Traffic
+	{
+		size_t	reads	= 0;
+		size_t	writes	= 0;
+	};
+
+	/**
+	 * Adds all register accesses done during its lifetime to given Traffic object.
+	 * Probes can be nested, then the outer probe counts also accesses counted by the inner ones.
+	 */
+	class Probe
+	{
+	  public:
+		// Ctor
+		explicit
+		Probe (Traffic&);
+
+		// Dtor
+		~Probe();
+
+		// Copy ctor
+		Probe (Probe const&) = delete;
+
+		// Copy operator
+		Probe const&
+		operator= (Probe const&) = delete;
+
+	  private:
+		Traffic&	_traffic;
+		Probe*		_outer;
+
+		friend class HostRegisterFile;
+	};
+
+	/**
+	 * Called after every write with address and new value of the register.
+	 * Can be used to emulate side effects of writing to a device register (like clear-on-write flags).
+	 */
+	using WriteHook = void (*) (size_t address, uint8_t value);
+
+  public:
+	static uint8_t
+	read8 (size_t address);
+
+	static void
+	write8 (size_t address, uint8_t value);
+
+	static uint16_t
+	read16 (size_t address);
+
+	static void
+	write16 (size_t address, uint16_t value);
+
+	/**
+	 * Reference to the memory cell. Accesses through the reference are not counted.
+	 */
+	static uint8_t volatile&
+	ref8 (size_t address);
+
+	/**
+	 * Reference to the memory cell. Accesses through the reference are not counted.
+	 */
+	static uint16_t volatile&
+	ref16 (size_t address);
+
+	/**
+	 * Return traffic counted for given simulated register.
+	 */
+	static Traffic
+	traffic (size_t address);
+
+	/**
+	 * Return traffic counted for all registers since last reset().
+	 */
+	static Traffic
+	total_traffic();
+
+	/**
+	 * Set the write hook. Pass nullptr to remove it.
+	 */
+	static void
+	set_write_hook (WriteHook);
+
+	/**
+	 * Zero simulated memory and all counters.
+	 */
+	static void
+	reset();
+
+  private:
+	struct Data
+	{
+		uint8_t		memory[kSize];
+		Traffic		per_address[kSize];
+		Traffic		total;
+		Probe*		innermost_probe	= nullptr;
+		WriteHook	write_hook		= nullptr;
+	};
+
+  private:
+	static Data&
+	data();
+
+	static void
+	count (size_t address, size_t Traffic::* counter);
+};
+
+
+inline
+HostRegisterFile::Probe::Probe (Traffic& traffic):
+	_traffic (traffic),
+	_outer (data().innermost_probe)
+{
+	data().innermost_probe = this;
+}
+
+
+inline
+HostRegisterFile::Probe::~Probe()
+{
+	data().innermost_probe = _outer;
+}
+
+
+inline uint8_t
+HostRegisterFile::read8 (size_t address)
+{
+	count (address, &Traffic::reads);
+	return ref8 (address);
+}
+
+
+inline void
+HostRegisterFile::write8 (size_t address, uint8_t value)
+{
+	count (address, &Traffic::writes);
+	ref8 (address) = value;
+
+	if (data().write_hook)
+		data().write_hook (address, value);
+}
+
+
+inline uint16_t
+HostRegisterFile::read16 (size_t address)
+{
+	count (address, &Traffic::reads);
+	return ref16 (address);
+}
+
+
+inline void
+HostRegisterFile::write16 (size_t address, uint16_t value)
+{
+	count (address, &Traffic::writes);
+	ref16 (address) = value;
+
+	if (data().write_hook)
+	{
+		data().write_hook (address + 0, (value >> 0) & 0xff);
+		data().write_hook (address + 1, (value >> 8) & 0xff);
+	}
+}
+
+
+inline uint8_t volatile&
+HostRegisterFile::ref8 (size_t address)
+{
+	if (address < kSize)
+		return data().memory[address];
+	else
+		return *reinterpret_cast<uint8_t volatile*> (address);
+}
+
+
+inline uint16_t volatile&
+HostRegisterFile::ref16 (size_t address)
+{
+	if (address < kSize)
+		return *reinterpret_cast<uint16_t volatile*> (&data().memory[address]);
+	else
+		return *reinterpret_cast<uint16_t volatile*> (address);
+}
+
+
+inline HostRegisterFile::Traffic
+HostRegisterFile::traffic (size_t address)
+{
+	if (address < kSize)
+		return data().per_address[address];
+	else
+		return Traffic();
+}
+
+
+inline HostRegisterFile::Traffic
+HostRegisterFile::total_traffic()
+{
+	return data().total;
+}
+
+
+inline void
+HostRegisterFile::set_write_hook (WriteHook hook)
+{
+	data().write_hook = hook;
+}
+
+
+inline void
+HostRegisterFile::reset()
+{
+	auto& d = data();
+
+	memset (d.memory, 0, sizeof (d.memory));
+
+	for (auto& traffic: d.per_address)
+		traffic = Traffic();
+
+	d.total = Traffic();
+}
+
+
+inline HostRegisterFile::Data&
+HostRegisterFile::data()
+{
+	static Data data;
+	return data;
+}
+
+
+inline void
+HostRegisterFile::count (size_t address, size_t Traffic::* counter)
+{
+	auto& d = data();
+
+	if (address < kSize)
+		++(d.per_address[address].*counter);
+
+	++(d.total.*counter);
+
+	for (Probe* probe = d.innermost_probe; probe; probe = probe->_outer)
+		++(probe->_traffic.*counter);
+}
+
+} // namespace avr
+} // namespace mulabs
+
+#endif
+
@@ -14,9 +14,14 @@
 #ifndef MULABS_AVR__AVR__INTERRUPTS_LOCK_H__INCLUDED
 #define MULABS_AVR__AVR__INTERRUPTS_LOCK_H__INCLUDED
 
+#ifdef __AVR__
 // AVR:
-#include <avr/io.h>
-#include <avr/interrupt.h>
+# include <avr/io.h>
+# include <avr/interrupt.h>
+#else
+// Host builds (SREG, cli()):
+# include <mulabs_avr/mcu/host-registers.h>
+#endif
 
 // Local:
 #include <mulabs_avr/utility/bits.h>
@@ -0,0 +1,212 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__AVR__REGISTER_TRANSACTION_H__INCLUDED
+#define MULABS_AVR__AVR__REGISTER_TRANSACTION_H__INCLUDED
+
+// Mulabs:
+#include <mulabs_avr/utility/bits.h>
+
+
+namespace mulabs {
+namespace avr {
+
+/**
+ * Collects several field writes to a single register and commits them at once, with one read-modify-write.
+ * Masks are template parameters, so after inlining the accumulated mask is a constant. If all bits
+ * of the register were given, the commit is a plain store without reading the register first.
+ *
+ * Commit is done in the destructor or explicitly with commit().
+ *
+ * Usage:
+ *   {
+ *       RegisterTransaction ctrlc (_ctrlc);
+ *       ctrlc.set_bits_value<7, 6> (mode);
+ *       ctrlc.set_bits_value<5, 4> (parity);
+ *       ctrlc.set_bit_value<3> (two_stop_bits);
+ *   } // Register written here.
+ *
+ * \param	pRegister
+ *			Register type, like MCU::Register8 or MCU::StaticRegister8<Address>.
+ * \param	pValue
+ *			Integer type of the register.
+ */
+template<class pRegister, class pValue = uint8_t>
+	class RegisterTransaction
+	{
+	  public:
+		using Register	= pRegister;
+		using Value		= pValue;
+
+		static constexpr Value kAllBits = static_cast<Value> (-1);
+
+	  public:
+		// Ctor
+		explicit constexpr
+		RegisterTransaction (Register const&);
+
+		// Copy ctor
+		RegisterTransaction (RegisterTransaction const&) = delete;
+
+		// Dtor
+		~RegisterTransaction();
+
+		// Copy operator
+		RegisterTransaction const&
+		operator= (RegisterTransaction const&) = delete;
+
+		/**
+		 * Set given bit to given value.
+		 */
+		template<uint8_t Bit>
+			constexpr void
+			set_bit_value (bool value);
+
+		/**
+		 * Set given bit to 1.
+		 */
+		template<uint8_t Bit>
+			constexpr void
+			set_bit();
+
+		/**
+		 * Clear given bit.
+		 */
+		template<uint8_t Bit>
+			constexpr void
+			clear_bit();
+
+		/**
+		 * Set unsigned int value in given bits (value is not shifted).
+		 */
+		template<uint8_t MostSignificantBit, uint8_t LeastSignificantBit>
+			constexpr void
+			set_bits_value (Value value);
+
+		/**
+		 * Set bits selected by Mask to the value, which is already shifted to the mask position.
+		 * Useful for enum values that are defined as register bits, like BasicUSART::Parity.
+		 */
+		template<Value Mask>
+			constexpr void
+			set_masked_value (Value value);
+
+		/**
+		 * Return mask of all bits that will be written on commit().
+		 */
+		constexpr Value
+		mask() const;
+
+		/**
+		 * Write collected fields to the register. Does nothing if no fields were set.
+		 * After this, the transaction is empty and can be reused.
+		 */
+		void
+		commit();
+
+	  private:
+		Register const&	_register;
+		Value			_mask	{ 0 };
+		Value			_value	{ 0 };
+	};
+
+
+template<class R, class V>
+	constexpr
+	RegisterTransaction<R, V>::RegisterTransaction (Register const& reg):
+		_register (reg)
+	{ }
+
+
+template<class R, class V>
+	inline
+	RegisterTransaction<R, V>::~RegisterTransaction()
+	{
+		commit();
+	}
+
+
+template<class R, class V>
+	template<uint8_t Bit>
+		constexpr void
+		RegisterTransaction<R, V>::set_bit_value (bool value)
+		{
+			set_bits_value<Bit, Bit> (value ? 1 : 0);
+		}
+
+
+template<class R, class V>
+	template<uint8_t Bit>
+		constexpr void
+		RegisterTransaction<R, V>::set_bit()
+		{
+			set_bits_value<Bit, Bit> (1);
+		}
+
+
+template<class R, class V>
+	template<uint8_t Bit>
+		constexpr void
+		RegisterTransaction<R, V>::clear_bit()
+		{
+			set_bits_value<Bit, Bit> (0);
+		}
+
+
+template<class R, class V>
+	template<uint8_t MostSignificantBit, uint8_t LeastSignificantBit>
+		constexpr void
+		RegisterTransaction<R, V>::set_bits_value (Value value)
+		{
+			constexpr Value field_mask = mask_of_ones<MostSignificantBit, LeastSignificantBit, Value>();
+
+			set_masked_value<field_mask> (static_cast<Value> (value << LeastSignificantBit));
+		}
+
+
+template<class R, class V>
+	template<typename RegisterTransaction<R, V>::Value Mask>
+		constexpr void
+		RegisterTransaction<R, V>::set_masked_value (Value value)
+		{
+			_mask |= Mask;
+			_value = (_value & ~Mask) | (value & Mask);
+		}
+
+
+template<class R, class V>
+	constexpr auto
+	RegisterTransaction<R, V>::mask() const -> Value
+	{
+		return _mask;
+	}
+
+
+template<class R, class V>
+	inline void
+	RegisterTransaction<R, V>::commit()
+	{
+		if (_mask == kAllBits)
+			_register.write (_value);
+		else if (_mask != 0)
+			_register.write ((_register.read() & ~_mask) | _value);
+
+		_mask = 0;
+		_value = 0;
+	}
+
+} // namespace avr
+} // namespace mulabs
+
+#endif
+
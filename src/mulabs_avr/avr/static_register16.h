@@ -0,0 +1,110 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__AVR__STATIC_REGISTER16_H__INCLUDED
+#define MULABS_AVR__AVR__STATIC_REGISTER16_H__INCLUDED
+
+// Standard:
+#include <stdlib.h>
+
+// Mulabs:
+#include <mulabs_avr/avr/basic_register16.h>
+
+
+namespace mulabs {
+namespace avr {
+
+/**
+ * Same as BasicRegister16, but with the address known at compile-time.
+ * See StaticRegister8.
+ */
+template<size_t pBaseAddress>
+	class StaticRegister16
+	{
+	  public:
+		static constexpr size_t kAddress = pBaseAddress;
+
+	  public:
+		// Ctor
+		constexpr
+		StaticRegister16() = default;
+
+		uint16_t
+		read() const;
+
+		void
+		write (uint16_t value) const;
+
+		StaticRegister16 const&
+		operator= (uint16_t value) const;
+
+		/**
+		 * Reference the memory-mapped register.
+		 */
+		uint16_t volatile&
+		ref() const;
+
+		/**
+		 * Convert to BasicRegister16, so that the register can be passed where runtime-addressed
+		 * register is expected.
+		 */
+		constexpr
+		operator BasicRegister16() const;
+	};
+
+
+template<size_t A>
+	inline uint16_t
+	StaticRegister16<A>::read() const
+	{
+		return ref();
+	}
+
+
+template<size_t A>
+	inline void
+	StaticRegister16<A>::write (uint16_t value) const
+	{
+		ref() = value;
+	}
+
+
+template<size_t A>
+	inline StaticRegister16<A> const&
+	StaticRegister16<A>::operator= (uint16_t value) const
+	{
+		write (value);
+		return *this;
+	}
+
+
+template<size_t A>
+	inline uint16_t volatile&
+	StaticRegister16<A>::ref() const
+	{
+		return *reinterpret_cast<uint16_t volatile*> (A);
+	}
+
+
+template<size_t A>
+	constexpr
+	StaticRegister16<A>::operator BasicRegister16() const
+	{
+		return BasicRegister16 (A);
+	}
+
+} // namespace avr
+} // namespace mulabs
+
+#endif
+
@@ -0,0 +1,231 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__AVR__STATIC_REGISTER8_H__INCLUDED
+#define MULABS_AVR__AVR__STATIC_REGISTER8_H__INCLUDED
+
+// Standard:
+#include <stdlib.h>
+
+// Mulabs:
+#include <mulabs_avr/avr/basic_register8.h>
+#include <mulabs_avr/utility/bits.h>
+
+
+namespace mulabs {
+namespace avr {
+
+/**
+ * Same as BasicRegister8, but the address is a template parameter instead of a member.
+ * Since the address is always a constant expression, the compiler can use SBI/CBI/SBIS/SBIC/IN/OUT instructions
+ * for registers in the I/O space (like ATMega PORTx/DDRx/PINx or XMEGA VPORTs) instead of loading the pointer and
+ * doing a read-modify-write in the data space.
+ */
+template<size_t pAddress>
+	class StaticRegister8
+	{
+	  public:
+		static constexpr size_t kAddress = pAddress;
+
+	  public:
+		// Ctor
+		constexpr
+		StaticRegister8() = default;
+
+		/**
+		 * Read value from the register.
+		 */
+		uint8_t
+		read() const;
+
+		/**
+		 * Alias for read().
+		 */
+		operator uint8_t() const;
+
+		/**
+		 * Write value to the register.
+		 */
+		void
+		write (uint8_t value) const;
+
+		/**
+		 * Alias for write (uint8_t).
+		 */
+		StaticRegister8 const&
+		operator= (uint8_t value) const;
+
+		/**
+		 * Reference the memory-mapped register.
+		 */
+		uint8_t volatile&
+		ref() const;
+
+		/**
+		 * Set given bit to given value.
+		 */
+		template<uint8_t Bit>
+			void
+			set_bit_value (bool value) const;
+
+		/**
+		 * Set given bit to 1.
+		 */
+		template<uint8_t Bit>
+			void
+			set_bit() const;
+
+		/**
+		 * Clear given bit.
+		 */
+		template<uint8_t Bit>
+			void
+			clear_bit() const;
+
+		/**
+		 * Set unsigned int value in given bits.
+		 */
+		template<uint8_t MostSignificantBit, uint8_t LeastSignificantBit>
+			void
+			set_bits_value (uint8_t value) const;
+
+		/**
+		 * Return value of given bit.
+		 */
+		template<uint8_t Bit>
+			bool
+			get_bit() const;
+
+		/**
+		 * Get unsigned int value from given bits (right-shifted).
+		 */
+		template<uint8_t MostSignificantBit, uint8_t LeastSignificantBit>
+			uint8_t
+			get_bits_value() const;
+
+		/**
+		 * Convert to BasicRegister8, so that the register can be passed where runtime-addressed
+		 * register is expected.
+		 */
+		constexpr
+		operator BasicRegister8() const;
+	};
+
+
+template<size_t A>
+	inline uint8_t
+	StaticRegister8<A>::read() const
+	{
+		return ref();
+	}
+
+
+template<size_t A>
+	inline
+	StaticRegister8<A>::operator uint8_t() const
+	{
+		return read();
+	}
+
+
+template<size_t A>
+	inline void
+	StaticRegister8<A>::write (uint8_t value) const
+	{
+		ref() = value;
+	}
+
+
+template<size_t A>
+	inline StaticRegister8<A> const&
+	StaticRegister8<A>::operator= (uint8_t value) const
+	{
+		write (value);
+		return *this;
+	}
+
+
+template<size_t A>
+	inline uint8_t volatile&
+	StaticRegister8<A>::ref() const
+	{
+		return *reinterpret_cast<uint8_t volatile*> (A);
+	}
+
+
+template<size_t A>
+	template<uint8_t Bit>
+		inline void
+		StaticRegister8<A>::set_bit_value (bool value) const
+		{
+			mulabs::avr::set_bit_value<Bit> (ref(), value);
+		}
+
+
+template<size_t A>
+	template<uint8_t Bit>
+		inline void
+		StaticRegister8<A>::set_bit() const
+		{
+			mulabs::avr::set_bit<Bit> (ref());
+		}
+
+
+template<size_t A>
+	template<uint8_t Bit>
+		inline void
+		StaticRegister8<A>::clear_bit() const
+		{
+			mulabs::avr::clear_bit<Bit> (ref());
+		}
+
+
+template<size_t A>
+	template<uint8_t MostSignificantBit, uint8_t LeastSignificantBit>
+		inline void
+		StaticRegister8<A>::set_bits_value (uint8_t value) const
+		{
+			mulabs::avr::set_bits_value<MostSignificantBit, LeastSignificantBit> (ref(), value);
+		}
+
+
+template<size_t A>
+	template<uint8_t Bit>
+		inline bool
+		StaticRegister8<A>::get_bit() const
+		{
+			return mulabs::avr::get_bit<Bit> (ref());
+		}
+
+
+template<size_t A>
+	template<uint8_t MostSignificantBit, uint8_t LeastSignificantBit>
+		inline uint8_t
+		StaticRegister8<A>::get_bits_value() const
+		{
+			return mulabs::avr::get_bits_value<MostSignificantBit, LeastSignificantBit> (ref());
+		}
+
+
+template<size_t A>
+	constexpr
+	StaticRegister8<A>::operator BasicRegister8() const
+	{
+		return BasicRegister8 (A);
+	}
+
+} // namespace avr
+} // namespace mulabs
+
+#endif
+
@@ -12,8 +12,13 @@
  */
 
 // Standard:
+#include <stdint.h>
 #include <stdio.h>
 
+// AVR:
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
 
 namespace std {
 
@@ -52,23 +57,56 @@ __cxa_pure_virtual (void)
 { }
 
 
+/*
+ * Guards for function-local statics. Byte 0 of the guard is the "initialized" flag (the compiler checks it inline
+ * before calling __cxa_guard_acquire(), so after initialization the cost is a single byte compare). Byte 1 holds
+ * SREG saved by __cxa_guard_acquire(): interrupts stay disabled until initialization is finished, so an ISR can't
+ * see a half-constructed object or initialize it a second time. Nested initializations restore SREG in reverse
+ * order, as they should. Consequently constructors of function-local statics must not wait for interrupts.
+ * See also utility/eager_static.h.
+ */
+
+
 extern "C" int
 __cxa_guard_acquire (__guard* g)
 {
-	return !*reinterpret_cast<char*> (g);
+	auto* const guard = reinterpret_cast<uint8_t volatile*> (g);
+
+	if (guard[0])
+		return 0;
+
+	uint8_t const sreg = SREG;
+	cli();
+
+	// Check again, an ISR might have done the initialization in the meantime:
+	if (guard[0])
+	{
+		SREG = sreg;
+		return 0;
+	}
+
+	guard[1] = sreg;
+	return 1;
 }
 
 
 extern "C" void
 __cxa_guard_release (__guard* g)
 {
-	*reinterpret_cast<char*> (g) = 1;
+	auto* const guard = reinterpret_cast<uint8_t volatile*> (g);
+
+	guard[0] = 1;
+	SREG = guard[1];
 }
 
 
 extern "C" void
-__cxa_guard_abort (__guard*)
-{ }
+__cxa_guard_abort (__guard* g)
+{
+	auto* const guard = reinterpret_cast<uint8_t volatile*> (g);
+
+	SREG = guard[1];
+}
 
 
 extern "C" void*
@@ -21,6 +21,10 @@
 #include <avr/io.h>
 #include <avr/cpufunc.h>
 
+// Mulabs:
+#include <mulabs_avr/avr/basic_register8.h>
+#include <mulabs_avr/avr/register_transaction.h>
+
 // Local:
 #include "utility.h"
 
@@ -113,7 +117,9 @@ class ADC8
 	static void
 	select_auto_trigger_source (AutoTriggerSource source) noexcept
 	{
-		ADCSRB = (ADCSRB & ~ADCSRBTriggerSourceMask) | static_cast<uint8_t> (source);
+		BasicRegister8 const adcsrb (ADCSRB);
+		RegisterTransaction transaction (adcsrb);
+		transaction.set_masked_value<ADCSRBTriggerSourceMask> (static_cast<uint8_t> (source));
 	}
 
 	/**
@@ -123,7 +129,25 @@ class ADC8
 	static void
 	select_input (uint8_t input) noexcept
 	{
-		ADMUX = (ADMUX & ~ADMUXInputMask) | (input & 0x0f);
+		BasicRegister8 const admux (ADMUX);
+		RegisterTransaction transaction (admux);
+		transaction.set_masked_value<ADMUXInputMask> (input);
+		transaction.commit();
+		_NOP();
+	}
+
+	/**
+	 * Select voltage reference and conversion input with a single read-modify-write of ADMUX.
+	 * Won't have any effect until ADC is enabled, see set_enabled().
+	 */
+	static void
+	select (Reference reference, uint8_t input) noexcept
+	{
+		BasicRegister8 const admux (ADMUX);
+		RegisterTransaction transaction (admux);
+		transaction.set_masked_value<ADMUXReferenceMask> (static_cast<uint8_t> (reference));
+		transaction.set_masked_value<ADMUXInputMask> (input);
+		transaction.commit();
 		_NOP();
 	}
 
@@ -148,16 +172,18 @@ class ADC8
 						   scale_factor == 64 ||
 						   scale_factor == 128, "scale_factor must be power of 2 [2..128]");
 
-			ADCSRA &= ~ADCSRAScaleMask;
+			BasicRegister8 const adcsra (ADCSRA);
+			RegisterTransaction transaction (adcsra);
+
 			switch (scale_factor)
 			{
-				case 2:		ADCSRA |= 0b00000001; break;
-				case 4:		ADCSRA |= 0b00000010; break;
-				case 8:		ADCSRA |= 0b00000011; break;
-				case 16:	ADCSRA |= 0b00000100; break;
-				case 32:	ADCSRA |= 0b00000101; break;
-				case 64:	ADCSRA |= 0b00000110; break;
-				case 128:	ADCSRA |= 0b00000111; break;
+				case 2:		transaction.template set_masked_value<ADCSRAScaleMask> (0b00000001); break;
+				case 4:		transaction.template set_masked_value<ADCSRAScaleMask> (0b00000010); break;
+				case 8:		transaction.template set_masked_value<ADCSRAScaleMask> (0b00000011); break;
+				case 16:	transaction.template set_masked_value<ADCSRAScaleMask> (0b00000100); break;
+				case 32:	transaction.template set_masked_value<ADCSRAScaleMask> (0b00000101); break;
+				case 64:	transaction.template set_masked_value<ADCSRAScaleMask> (0b00000110); break;
+				case 128:	transaction.template set_masked_value<ADCSRAScaleMask> (0b00000111); break;
 			}
 		}
 
@@ -168,7 +194,9 @@ class ADC8
 	static void
 	select_reference (Reference reference) noexcept
 	{
-		ADMUX = (ADMUX & ~ADMUXReferenceMask) | static_cast<uint8_t> (reference);
+		BasicRegister8 const admux (ADMUX);
+		RegisterTransaction transaction (admux);
+		transaction.set_masked_value<ADMUXReferenceMask> (static_cast<uint8_t> (reference));
 	}
 
 	/**
@@ -0,0 +1,256 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__DEVICES__COMMON__COMMON_STATIC_PIN_H__INCLUDED
+#define MULABS_AVR__DEVICES__COMMON__COMMON_STATIC_PIN_H__INCLUDED
+
+// Standard:
+#include <stddef.h>
+#include <stdint.h>
+
+
+namespace mulabs {
+namespace avr {
+
+/**
+ * Same interface as CommonBasicPin, but both the port and the pin number are known at compile time.
+ * Port must be a static port (one that uses StaticRegister8), so that single-pin operations compile
+ * to single SBI/CBI/SBIS/SBIC instructions.
+ */
+template<class pPort, uint8_t pPinNumber>
+	class CommonStaticPin
+	{
+	  public:
+		using Port = pPort;
+
+		static constexpr uint8_t kPinNumber = pPinNumber;
+
+		static_assert (kPinNumber < 8, "pin number must be 0…7");
+
+	  public:
+		// Ctor
+		constexpr
+		CommonStaticPin() = default;
+
+		/**
+		 * Set pin level to logic_value. True means high, false mans low.
+		 */
+		CommonStaticPin const&
+		operator= (bool logic_value) const;
+
+		/**
+		 * Return the pin number in the port.
+		 */
+		static constexpr uint8_t
+		pin_number();
+
+		/**
+		 * Return pin number for the PinSet object
+		 * (taking into account port number as well).
+		 */
+		static constexpr size_t
+		absolute_pin_number();
+
+		/**
+		 * Return port.
+		 */
+		static constexpr Port
+		port();
+
+		/**
+		 * Read pin value.
+		 */
+		bool
+		get() const;
+
+		/**
+		 * Wait in loop until pin is in AwaitedState.
+		 */
+		template<bool AwaitedState>
+			void
+			wait_for() const;
+
+		/**
+		 * Wait in loop until pin is in awaited_state.
+		 */
+		void
+		wait_for (bool awaited_state) const;
+
+		/**
+		 * Configure pin as input.
+		 */
+		void
+		configure_as_input() const;
+
+		/**
+		 * Configure pin as output.
+		 */
+		void
+		configure_as_output() const;
+
+		/**
+		 * Set pin level to high.
+		 */
+		void
+		set_high() const;
+
+		/**
+		 * Set pin level to low.
+		 */
+		void
+		set_low() const;
+
+		/**
+		 * Toggle pin level.
+		 */
+		void
+		toggle() const;
+
+		/**
+		 * Toggle two times.
+		 */
+		void
+		signal() const;
+
+		/**
+		 * Send signal N times.
+		 */
+		template<class Integer>
+			void
+			signal (Integer times) const;
+	};
+
+
+template<class P, uint8_t N>
+	inline CommonStaticPin<P, N> const&
+	CommonStaticPin<P, N>::operator= (bool logic_value) const
+	{
+		port().pin_set (kPinNumber, logic_value);
+		return *this;
+	}
+
+
+template<class P, uint8_t N>
+	constexpr uint8_t
+	CommonStaticPin<P, N>::pin_number()
+	{
+		return kPinNumber;
+	}
+
+
+template<class P, uint8_t N>
+	constexpr size_t
+	CommonStaticPin<P, N>::absolute_pin_number()
+	{
+		return Port::port_number() * 8 + kPinNumber;
+	}
+
+
+template<class P, uint8_t N>
+	constexpr auto
+	CommonStaticPin<P, N>::port() -> Port
+	{
+		return Port();
+	}
+
+
+template<class P, uint8_t N>
+	inline bool
+	CommonStaticPin<P, N>::get() const
+	{
+		return port().pin_get (kPinNumber);
+	}
+
+
+template<class P, uint8_t N>
+	template<bool State>
+		inline void
+		CommonStaticPin<P, N>::wait_for() const
+		{
+			while (get() != State)
+				continue;
+		}
+
+
+template<class P, uint8_t N>
+	inline void
+	CommonStaticPin<P, N>::wait_for (bool awaited_state) const
+	{
+		while (get() != awaited_state)
+			continue;
+	}
+
+
+template<class P, uint8_t N>
+	inline void
+	CommonStaticPin<P, N>::configure_as_input() const
+	{
+		port().pin_configure_as_input (kPinNumber);
+	}
+
+
+template<class P, uint8_t N>
+	inline void
+	CommonStaticPin<P, N>::configure_as_output() const
+	{
+		port().pin_configure_as_output (kPinNumber);
+	}
+
+
+template<class P, uint8_t N>
+	inline void
+	CommonStaticPin<P, N>::set_high() const
+	{
+		port().pin_set_high (kPinNumber);
+	}
+
+
+template<class P, uint8_t N>
+	inline void
+	CommonStaticPin<P, N>::set_low() const
+	{
+		port().pin_set_low (kPinNumber);
+	}
+
+
+template<class P, uint8_t N>
+	inline void
+	CommonStaticPin<P, N>::toggle() const
+	{
+		port().pin_toggle (kPinNumber);
+	}
+
+
+template<class P, uint8_t N>
+	inline void
+	CommonStaticPin<P, N>::signal() const
+	{
+		toggle();
+		toggle();
+	}
+
+
+template<class P, uint8_t N>
+	template<class Integer>
+		inline void
+		CommonStaticPin<P, N>::signal (Integer times) const
+		{
+			for (Integer i = 0; i < times; ++i)
+				signal();
+		}
+
+} // namespace avr
+} // namespace mulabs
+
+#endif
+
@@ -0,0 +1,392 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__DEVICES__MEGA32U4__STATIC_PORT_H__INCLUDED
+#define MULABS_AVR__DEVICES__MEGA32U4__STATIC_PORT_H__INCLUDED
+
+// Mulabs:
+#include <mulabs_avr/devices/common/common_static_pin.h>
+#include <mulabs_avr/utility/bits.h>
+
+
+namespace mulabs {
+namespace avr {
+namespace mega32u4 {
+
+/**
+ * Same interface as BasicPort, but registers are StaticRegister8, so that operations on pins known
+ * at compile time compile to SBI/CBI/SBIS/SBIC instructions instead of read-modify-write through
+ * a pointer. Converts to MCU::Port where a runtime port is expected.
+ */
+template<class pMCU, uint8_t pPortNumber, size_t pPinAddress, size_t pDDRAddress, size_t pPortAddress>
+	class StaticPort
+	{
+	  public:
+		using MCU			= pMCU;
+		using PinRegister	= typename MCU::template StaticRegister8<pPinAddress>;
+		using DDRRegister	= typename MCU::template StaticRegister8<pDDRAddress>;
+		using PortRegister	= typename MCU::template StaticRegister8<pPortAddress>;
+		using PinBits		= typename MCU::PortIntegerType;
+
+		template<uint8_t PinNumber>
+			using Pin = CommonStaticPin<StaticPort, PinNumber>;
+
+	  public:
+		// Ctor
+		constexpr
+		StaticPort() = default;
+
+		/**
+		 * Return Pin object by bit number.
+		 */
+		template<uint8_t PinNumber>
+			static constexpr Pin<PinNumber>
+			pin();
+
+		/**
+		 * Return this port's number (A is 0, B is 1, etc).
+		 */
+		static constexpr uint8_t
+		port_number();
+
+		/**
+		 * Convert to runtime port.
+		 */
+		constexpr
+		operator typename MCU::Port() const;
+
+		/**
+		 * Read byte from the port.
+		 */
+		PinBits
+		get() const;
+
+		/**
+		 * Alias for get().
+		 */
+		operator PinBits() const;
+
+		/**
+		 * Write byte to all pins on port at once.
+		 */
+		void
+		set (PinBits pin_bits) const;
+
+		/**
+		 * Alias for set (uint8_t).
+		 */
+		StaticPort const&
+		operator= (PinBits pin_bits) const;
+
+		/**
+		 * Set selected pins to high level.
+		 */
+		void
+		set_high (PinBits pin_bits) const;
+
+		/**
+		 * Set selected pins to low level.
+		 */
+		void
+		set_low (PinBits pin_bits) const;
+
+		/**
+		 * Toggle selected pins (switch levels).
+		 */
+		void
+		toggle (PinBits pin_bits) const;
+
+		/**
+		 * Enable pull-ups on selected pins.
+		 * Makes sense only if given pins are configured as inputs.
+		 */
+		void
+		enable_pull_up (PinBits pin_bits) const;
+
+		/**
+		 * Disable pull-ups on selected pins.
+		 * Makes sense only if given pins are configured as inputs.
+		 */
+		void
+		disable_pull_up (PinBits pin_bits) const;
+
+		/**
+		 * Configure pins denoted by set bits as inputs.
+		 */
+		void
+		configure_as_inputs (PinBits pin_bits) const;
+
+		/**
+		 * Configure pins denoted by set bits as outputs.
+		 */
+		void
+		configure_as_outputs (PinBits pin_bits) const;
+
+		/**
+		 * Configure individual pin as input.
+		 */
+		void
+		pin_configure_as_input (uint8_t pin_number) const;
+
+		/**
+		 * Configure individual pin as output.
+		 */
+		void
+		pin_configure_as_output (uint8_t pin_number) const;
+
+		/**
+		 * Get individual pin level.
+		 */
+		bool
+		pin_get (uint8_t pin_number) const;
+
+		/**
+		 * Set individual pin to given logic value.
+		 */
+		void
+		pin_set (uint8_t pin_number, bool logic_value) const;
+
+		/**
+		 * Set individual pin to high level.
+		 */
+		void
+		pin_set_high (uint8_t pin_number) const;
+
+		/**
+		 * Set individual pin to low level.
+		 */
+		void
+		pin_set_low (uint8_t pin_number) const;
+
+		/**
+		 * Toggle individual pin level.
+		 */
+		void
+		pin_toggle (uint8_t pin_number) const;
+
+		/**
+		 * Enable internal pull-up on individual pin.
+		 * Makes sense only if the pin is configured as input.
+		 */
+		void
+		pin_enable_pull_up (uint8_t pin_number) const;
+
+		/**
+		 * Disable internal pull-up on individual pin.
+		 * Makes sense only if the pin is configured as input.
+		 */
+		void
+		pin_disable_pull_up (uint8_t pin_number) const;
+
+	  private:
+		static constexpr PinRegister	_pin	{ };	// PINx register
+		static constexpr DDRRegister	_ddr	{ };	// DDRx register
+		static constexpr PortRegister	_port	{ };	// PORTx register
+	};
+
+
+template<class M, uint8_t N, size_t I, size_t D, size_t P>
+	template<uint8_t PinNumber>
+		constexpr auto
+		StaticPort<M, N, I, D, P>::pin() -> Pin<PinNumber>
+		{
+			return Pin<PinNumber>();
+		}
+
+
+template<class M, uint8_t N, size_t I, size_t D, size_t P>
+	constexpr uint8_t
+	StaticPort<M, N, I, D, P>::port_number()
+	{
+		return N;
+	}
+
+
+template<class M, uint8_t N, size_t I, size_t D, size_t P>
+	constexpr
+	StaticPort<M, N, I, D, P>::operator typename MCU::Port() const
+	{
+		return typename MCU::Port (N, _pin, _ddr, _port);
+	}
+
+
+template<class M, uint8_t N, size_t I, size_t D, size_t P>
+	inline auto
+	StaticPort<M, N, I, D, P>::get() const -> PinBits
+	{
+		return _pin;
+	}
+
+
+template<class M, uint8_t N, size_t I, size_t D, size_t P>
+	inline
+	StaticPort<M, N, I, D, P>::operator PinBits() const
+	{
+		return get();
+	}
+
+
+template<class M, uint8_t N, size_t I, size_t D, size_t P>
+	inline void
+	StaticPort<M, N, I, D, P>::set (PinBits pin_bits) const
+	{
+		_port = pin_bits;
+	}
+
+
+template<class M, uint8_t N, size_t I, size_t D, size_t P>
+	inline auto
+	StaticPort<M, N, I, D, P>::operator= (PinBits pin_bits) const -> StaticPort const&
+	{
+		set (pin_bits);
+		return *this;
+	}
+
+
+template<class M, uint8_t N, size_t I, size_t D, size_t P>
+	inline void
+	StaticPort<M, N, I, D, P>::set_high (PinBits pin_bits) const
+	{
+		_port.ref() |= pin_bits;
+	}
+
+
+template<class M, uint8_t N, size_t I, size_t D, size_t P>
+	inline void
+	StaticPort<M, N, I, D, P>::set_low (PinBits pin_bits) const
+	{
+		_port.ref() &= ~pin_bits;
+	}
+
+
+template<class M, uint8_t N, size_t I, size_t D, size_t P>
+	inline void
+	StaticPort<M, N, I, D, P>::toggle (PinBits pin_bits) const
+	{
+		// Writing 1 to PINx toggles PORTx:
+		_pin = pin_bits;
+	}
+
+
+template<class M, uint8_t N, size_t I, size_t D, size_t P>
+	inline void
+	StaticPort<M, N, I, D, P>::enable_pull_up (PinBits pin_bits) const
+	{
+		_port.ref() |= pin_bits;
+	}
+
+
+template<class M, uint8_t N, size_t I, size_t D, size_t P>
+	inline void
+	StaticPort<M, N, I, D, P>::disable_pull_up (PinBits pin_bits) const
+	{
+		_port.ref() &= ~pin_bits;
+	}
+
+
+template<class M, uint8_t N, size_t I, size_t D, size_t P>
+	inline void
+	StaticPort<M, N, I, D, P>::configure_as_inputs (PinBits pin_bits) const
+	{
+		_ddr.ref() &= ~pin_bits;
+	}
+
+
+template<class M, uint8_t N, size_t I, size_t D, size_t P>
+	inline void
+	StaticPort<M, N, I, D, P>::configure_as_outputs (PinBits pin_bits) const
+	{
+		_ddr.ref() |= pin_bits;
+	}
+
+
+template<class M, uint8_t N, size_t I, size_t D, size_t P>
+	inline void
+	StaticPort<M, N, I, D, P>::pin_configure_as_input (uint8_t pin_number) const
+	{
+		configure_as_inputs (1 << pin_number);
+	}
+
+
+template<class M, uint8_t N, size_t I, size_t D, size_t P>
+	inline void
+	StaticPort<M, N, I, D, P>::pin_configure_as_output (uint8_t pin_number) const
+	{
+		configure_as_outputs (1 << pin_number);
+	}
+
+
+template<class M, uint8_t N, size_t I, size_t D, size_t P>
+	inline bool
+	StaticPort<M, N, I, D, P>::pin_get (uint8_t pin_number) const
+	{
+		return get() & (1 << pin_number);
+	}
+
+
+template<class M, uint8_t N, size_t I, size_t D, size_t P>
+	inline void
+	StaticPort<M, N, I, D, P>::pin_set (uint8_t pin_number, bool logic_value) const
+	{
+		if (logic_value)
+			pin_set_high (pin_number);
+		else
+			pin_set_low (pin_number);
+	}
+
+
+template<class M, uint8_t N, size_t I, size_t D, size_t P>
+	inline void
+	StaticPort<M, N, I, D, P>::pin_set_high (uint8_t pin_number) const
+	{
+		set_high (1 << pin_number);
+	}
+
+
+template<class M, uint8_t N, size_t I, size_t D, size_t P>
+	inline void
+	StaticPort<M, N, I, D, P>::pin_set_low (uint8_t pin_number) const
+	{
+		set_low (1 << pin_number);
+	}
+
+
+template<class M, uint8_t N, size_t I, size_t D, size_t P>
+	inline void
+	StaticPort<M, N, I, D, P>::pin_toggle (uint8_t pin_number) const
+	{
+		toggle (1 << pin_number);
+	}
+
+
+template<class M, uint8_t N, size_t I, size_t D, size_t P>
+	inline void
+	StaticPort<M, N, I, D, P>::pin_enable_pull_up (uint8_t pin_number) const
+	{
+		enable_pull_up (1 << pin_number);
+	}
+
+
+template<class M, uint8_t N, size_t I, size_t D, size_t P>
+	inline void
+	StaticPort<M, N, I, D, P>::pin_disable_pull_up (uint8_t pin_number) const
+	{
+		disable_pull_up (1 << pin_number);
+	}
+
+} // namespace mega32u4
+} // namespace avr
+} // namespace mulabs
+
+#endif
+
@@ -14,6 +14,9 @@
 #ifndef MULABS_AVR__DEVICES__XMEGA_AU__BASIC_CLOCK_H__INCLUDED
 #define MULABS_AVR__DEVICES__XMEGA_AU__BASIC_CLOCK_H__INCLUDED
 
+// Mulabs:
+#include <mulabs_avr/utility/array.h>
+
 
 namespace mulabs {
 namespace avr {
@@ -135,6 +138,67 @@ template<class pMCU>
 			XTAL16kCLK		= 0b1011,
 		};
 
+		/**
+		 * Peripherals which clock can be stopped with the power reduction registers.
+		 * High byte is the index of the PR register (PRGEN, PRPA, PRPB, PRPC…PRPF), low byte is the bit mask.
+		 */
+		enum class Peripheral: uint16_t
+		{
+			// PRGEN:
+			USB				= (0 << 8) | 0x40,
+			AES				= (0 << 8) | 0x10,
+			EBI				= (0 << 8) | 0x08,
+			RTC				= (0 << 8) | 0x04,
+			EventSystem		= (0 << 8) | 0x02,
+			DMA				= (0 << 8) | 0x01,
+			// PRPA:
+			DACA			= (1 << 8) | 0x04,
+			ADCA			= (1 << 8) | 0x02,
+			ACA				= (1 << 8) | 0x01,
+			// PRPB:
+			DACB			= (2 << 8) | 0x04,
+			ADCB			= (2 << 8) | 0x02,
+			ACB				= (2 << 8) | 0x01,
+			// PRPC:
+			TWIC			= (3 << 8) | 0x40,
+			USARTC1			= (3 << 8) | 0x20,
+			USARTC0			= (3 << 8) | 0x10,
+			SPIC			= (3 << 8) | 0x08,
+			HIRESC			= (3 << 8) | 0x04,
+			TC1C			= (3 << 8) | 0x02,
+			TC0C			= (3 << 8) | 0x01,
+			// PRPD:
+			TWID			= (4 << 8) | 0x40,
+			USARTD1			= (4 << 8) | 0x20,
+			USARTD0			= (4 << 8) | 0x10,
+			SPID			= (4 << 8) | 0x08,
+			HIRESD			= (4 << 8) | 0x04,
+			TC1D			= (4 << 8) | 0x02,
+			TC0D			= (4 << 8) | 0x01,
+			// PRPE:
+			TWIE			= (5 << 8) | 0x40,
+			USARTE1			= (5 << 8) | 0x20,
+			USARTE0			= (5 << 8) | 0x10,
+			SPIE			= (5 << 8) | 0x08,
+			HIRESE			= (5 << 8) | 0x04,
+			TC1E			= (5 << 8) | 0x02,
+			TC0E			= (5 << 8) | 0x01,
+			// PRPF:
+			TWIF			= (6 << 8) | 0x40,
+			USARTF1			= (6 << 8) | 0x20,
+			USARTF0			= (6 << 8) | 0x10,
+			SPIF			= (6 << 8) | 0x08,
+			HIRESF			= (6 << 8) | 0x04,
+			TC1F			= (6 << 8) | 0x02,
+			TC0F			= (6 << 8) | 0x01,
+		};
+
+		/**
+		 * Contents of the power reduction registers PRGEN, PRPA, PRPB, PRPC…PRPF.
+		 * Set bit means that the clock of the peripheral is stopped.
+		 */
+		using PowerReduction = Array<uint8_t, 7>;
+
 	  public:
 		/**
 		 * Enable selected oscillators.
@@ -320,6 +384,32 @@ template<class pMCU>
 		static void
 		set_dfll_enabled (DFLL, bool);
 
+		/**
+		 * Start/stop clock of given peripheral. Stopped peripheral keeps its state, but its registers can't be accessed.
+		 * All peripherals run after reset.
+		 */
+		static void
+		set_clock_enabled (Peripheral, bool enabled);
+
+		/**
+		 * Return state of all power reduction registers (eg. to restore it later with set_power_reduction()).
+		 */
+		static PowerReduction
+		power_reduction();
+
+		/**
+		 * Write all power reduction registers.
+		 */
+		static void
+		set_power_reduction (PowerReduction const&);
+
+		/**
+		 * Return power reduction state with clocks of all peripherals stopped, except the listed ones.
+		 */
+		template<class ...Peripherals>
+			static PowerReduction
+			all_stopped_except (Peripherals ...running);
+
 	  private:
 		/**
 		 * Helper for enable()/disable() of Oscillators.
@@ -651,6 +741,58 @@ template<class M>
 		}
 	}
 
+template<class M>
+	inline void
+	BasicClock<M>::set_clock_enabled (Peripheral peripheral, bool enabled)
+	{
+		uint8_t volatile& reg = (&PR_PRGEN)[static_cast<uint16_t> (peripheral) >> 8];
+		uint8_t const mask = static_cast<uint16_t> (peripheral) & 0xff;
+
+		if (enabled)
+			reg &= ~mask;
+		else
+			reg |= mask;
+	}
+
+
+template<class M>
+	inline auto
+	BasicClock<M>::power_reduction() -> PowerReduction
+	{
+		PowerReduction result;
+
+		for (uint8_t i = 0; i < result.size(); ++i)
+			result[i] = (&PR_PRGEN)[i];
+
+		return result;
+	}
+
+
+template<class M>
+	inline void
+	BasicClock<M>::set_power_reduction (PowerReduction const& power_reduction)
+	{
+		for (uint8_t i = 0; i < power_reduction.size(); ++i)
+			(&PR_PRGEN)[i] = power_reduction[i];
+	}
+
+
+template<class M>
+	template<class ...Peripherals>
+		inline auto
+		BasicClock<M>::all_stopped_except (Peripherals ...running) -> PowerReduction
+		{
+			// Only existing bits, reserved ones must be written as zero:
+			PowerReduction result;
+			result[0] = 0x5f;
+			result[1] = result[2] = 0x07;
+			result[3] = result[4] = result[5] = result[6] = 0x7f;
+
+			((result[static_cast<uint16_t> (running) >> 8] &= ~(static_cast<uint16_t> (running) & 0xff)), ...);
+
+			return result;
+		}
+
 } // namespace xmega_au
 } // namespace avr
 } // namespace mulabs
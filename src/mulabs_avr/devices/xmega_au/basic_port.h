@@ -61,6 +61,12 @@ template<class pMCU>
 		constexpr uint8_t
 		port_number() const;
 
+		/**
+		 * Return address of the first register of the port.
+		 */
+		constexpr size_t
+		base_address() const;
+
 		/**
 		 * Read byte from the port.
 		 */
@@ -284,6 +290,14 @@ template<class M>
 	}
 
 
+template<class M>
+	constexpr size_t
+	BasicPort<M>::base_address() const
+	{
+		return _base_address;
+	}
+
+
 template<class M>
 	inline typename BasicPort<M>::PinBits
 	BasicPort<M>::get() const
@@ -0,0 +1,110 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__DEVICES__XMEGA_AU__BASIC_SLEEP_H__INCLUDED
+#define MULABS_AVR__DEVICES__XMEGA_AU__BASIC_SLEEP_H__INCLUDED
+
+
+namespace mulabs {
+namespace avr {
+namespace xmega_au {
+
+/**
+ * Sleep controller.
+ */
+template<class pMCU>
+	class BasicSleep
+	{
+	  public:
+		using MCU = pMCU;
+
+		enum class Mode: uint8_t
+		{
+			Idle			= 0b000 << 1,	// CPU stopped, peripherals running
+			PowerDown		= 0b010 << 1,	// All clocks stopped, only asynchronous wake-up sources (pin change, TWI address match, USB bus events)
+			PowerSave		= 0b011 << 1,	// Like PowerDown, but RTC keeps running
+			Standby			= 0b110 << 1,	// Like PowerDown, but enabled oscillators keep running (fast wake-up)
+			ExtendedStandby	= 0b111 << 1,	// Like PowerSave, but enabled oscillators keep running
+		};
+
+	  public:
+		/**
+		 * Select sleep mode entered by sleep().
+		 */
+		static void
+		set (Mode);
+
+		/**
+		 * Enable/disable the SLEEP instruction. It's recommended to have it enabled only just before sleeping.
+		 */
+		static void
+		set_enabled (bool);
+
+		/**
+		 * Enter selected sleep mode. Returns after an interrupt wakes up the CPU (and after the interrupt handler
+		 * is executed). Sleep must be enabled.
+		 */
+		static void
+		sleep();
+
+		/**
+		 * Enable interrupts and sleep. An interrupt that got pending while interrupts were disabled can't be missed,
+		 * since SEI takes effect only after the next instruction (SLEEP), so the CPU will wake up immediately. Use it to sleep
+		 * after checking the wake-up condition with interrupts disabled. Sleep must be enabled.
+		 */
+		static void
+		enable_interrupts_and_sleep();
+	};
+
+
+template<class M>
+	inline void
+	BasicSleep<M>::set (Mode mode)
+	{
+		SLEEP_CTRL = (SLEEP_CTRL & 0b11110001) | static_cast<uint8_t> (mode);
+	}
+
+
+template<class M>
+	inline void
+	BasicSleep<M>::set_enabled (bool enabled)
+	{
+		SLEEP_CTRL = (SLEEP_CTRL & 0b11111110) | (enabled ? 1 : 0);
+	}
+
+
+template<class M>
+	inline void
+	BasicSleep<M>::sleep()
+	{
+		asm volatile ("sleep" ::: "memory");
+	}
+
+
+template<class M>
+	inline void
+	BasicSleep<M>::enable_interrupts_and_sleep()
+	{
+		asm volatile (
+			"sei	\n\t"
+			"sleep	\n\t"
+			::: "memory"
+		);
+	}
+
+} // namespace xmega_au
+} // namespace avr
+} // namespace mulabs
+
+#endif
+
@@ -14,6 +14,7 @@
 #ifndef MULABS_AVR__DEVICES__XMEGA_AU__BASIC_TIMER_01_H__INCLUDED
 #define MULABS_AVR__DEVICES__XMEGA_AU__BASIC_TIMER_01_H__INCLUDED
 
+#include <mulabs_avr/avr/register_transaction.h>
 #include <mulabs_avr/devices/xmega_au/interrupt_system.h>
 #include <mulabs_avr/std/type_traits.h>
 #include <mulabs_avr/utility/bits.h>
@@ -163,9 +164,30 @@ template<class pMCU>
 			void
 			disable (Channels...) const;
 
+		/**
+		 * Set waveform-generation mode and enable listed compare/capture channels (others get disabled)
+		 * with a single write to the CTRLB register.
+		 */
+		template<class ...Channels>
+			void
+			set_waveform (Mode, Channels...) const;
+
+		/**
+		 * Set event action and event source bus with a single read-modify-write of the CTRLD register.
+		 */
+		template<uint8_t EventBus>
+			void
+			set_event (EventAction) const;
+
 		void
 		set (InterruptType, InterruptSystem::Level) const;
 
+		/**
+		 * Set error and overflow interrupt levels with a single write to the INTCTRLA register.
+		 */
+		void
+		set_interrupt_levels (InterruptSystem::Level error, InterruptSystem::Level overflow) const;
+
 		void
 		set (CompareCaptureChannel, InterruptSystem::Level) const;
 
@@ -399,7 +421,8 @@ template<class M>
 	inline void
 	BasicTimer01<M>::set (Mode mode) const
 	{
-		_ctrlb = (_ctrlb.read() & 0b11110000) | static_cast<uint8_t> (mode);
+		RegisterTransaction ctrlb (_ctrlb);
+		ctrlb.template set_bits_value<2, 0> (static_cast<uint8_t> (mode));
 	}
 
 
@@ -415,7 +438,8 @@ template<class M>
 	inline void
 	BasicTimer01<M>::set (EventAction event_action) const
 	{
-		_ctrld = (_ctrld.read() & 0b0001'1111) | static_cast<uint8_t> (event_action);
+		RegisterTransaction ctrld (_ctrld);
+		ctrld.template set_masked_value<0b1110'0000> (static_cast<uint8_t> (event_action));
 	}
 
 
@@ -443,7 +467,8 @@ template<class M>
 		{
 			static_assert (EventBus >= 0 && EventBus <= 7);
 
-			_ctrld = (_ctrld.read() & 0b1111'0000) | 0b1000 | EventBus;
+			RegisterTransaction ctrld (_ctrld);
+			ctrld.template set_bits_value<3, 0> (0b1000 | EventBus);
 		}
 
 
@@ -451,7 +476,8 @@ template<class M>
 	inline void
 	BasicTimer01<M>::disable_event_source_bus() const
 	{
-		_ctrld = (_ctrld.read() & 0b1111'0000);
+		RegisterTransaction ctrld (_ctrld);
+		ctrld.template set_bits_value<3, 0> (0);
 	}
 
 
@@ -459,7 +485,8 @@ template<class M>
 	inline void
 	BasicTimer01<M>::set (ClockSource clock_source) const
 	{
-		_ctrla = (_ctrla.read() & 0b1111'0000) | static_cast<uint8_t> (clock_source);
+		RegisterTransaction ctrla (_ctrla);
+		ctrla.template set_bits_value<3, 0> (static_cast<uint8_t> (clock_source));
 	}
 
 
@@ -481,48 +508,83 @@ template<class M>
 		}
 
 
+template<class M>
+	template<class ...Channels>
+		inline void
+		BasicTimer01<M>::set_waveform (Mode mode, Channels ...channels) const
+		{
+			uint8_t channels_list = 0;
+
+			if constexpr (sizeof... (channels) > 0)
+				channels_list = make_channels_list (channels...);
+
+			// Bit 3 is reserved and must be written as 0, so the transaction covers the whole register
+			// and is committed with a plain store:
+			RegisterTransaction ctrlb (_ctrlb);
+			ctrlb.template set_bits_value<7, 4> (channels_list >> 4);
+			ctrlb.template set_bits_value<3, 3> (0);
+			ctrlb.template set_bits_value<2, 0> (static_cast<uint8_t> (mode));
+		}
+
+
+template<class M>
+	template<uint8_t EventBus>
+		inline void
+		BasicTimer01<M>::set_event (EventAction event_action) const
+		{
+			static_assert (EventBus >= 0 && EventBus <= 7);
+
+			RegisterTransaction ctrld (_ctrld);
+			ctrld.template set_masked_value<0b1110'0000> (static_cast<uint8_t> (event_action));
+			ctrld.template set_bits_value<3, 0> (0b1000 | EventBus);
+		}
+
+
 template<class M>
 	inline void
 	BasicTimer01<M>::set (InterruptType type, InterruptSystem::Level level) const
 	{
 		uint8_t const int_level = static_cast<uint8_t> (level);
+		RegisterTransaction intctrla (_intctrla);
 
 		switch (type)
 		{
 			case InterruptType::Error:
-				_intctrla = (_intctrla.read() & 0b11110011) | (int_level << 2);
+				intctrla.template set_bits_value<3, 2> (int_level);
 				break;
 
 			case InterruptType::Overflow:
-				_intctrla = (_intctrla.read() & 0b11110011) | (int_level << 0);
+				intctrla.template set_bits_value<1, 0> (int_level);
 				break;
 		}
 	}
 
 
+template<class M>
+	inline void
+	BasicTimer01<M>::set_interrupt_levels (InterruptSystem::Level error, InterruptSystem::Level overflow) const
+	{
+		// Bits 7:4 are reserved and must be written as 0:
+		RegisterTransaction intctrla (_intctrla);
+		intctrla.template set_bits_value<7, 4> (0);
+		intctrla.template set_bits_value<3, 2> (static_cast<uint8_t> (error));
+		intctrla.template set_bits_value<1, 0> (static_cast<uint8_t> (overflow));
+	}
+
+
 template<class M>
 	inline void
 	BasicTimer01<M>::set (CompareCaptureChannel channel, InterruptSystem::Level level) const
 	{
 		uint8_t const int_level = static_cast<uint8_t> (level);
+		RegisterTransaction intctrlb (_intctrlb);
 
 		switch (channel)
 		{
-			case CompareCaptureChannel::A:
-				_intctrlb = (_intctrlb.read() & 0b11111100) | (int_level << 0);
-				break;
-
-			case CompareCaptureChannel::B:
-				_intctrlb = (_intctrlb.read() & 0b11110011) | (int_level << 2);
-				break;
-
-			case CompareCaptureChannel::C:
-				_intctrlb = (_intctrlb.read() & 0b11001111) | (int_level << 4);
-				break;
-
-			case CompareCaptureChannel::D:
-				_intctrlb = (_intctrlb.read() & 0b00111111) | (int_level << 6);
-				break;
+			case CompareCaptureChannel::A:	intctrlb.template set_bits_value<1, 0> (int_level);	break;
+			case CompareCaptureChannel::B:	intctrlb.template set_bits_value<3, 2> (int_level);	break;
+			case CompareCaptureChannel::C:	intctrlb.template set_bits_value<5, 4> (int_level);	break;
+			case CompareCaptureChannel::D:	intctrlb.template set_bits_value<7, 6> (int_level);	break;
 		}
 	}
 
@@ -531,23 +593,16 @@ template<class M>
 	void
 	BasicTimer01<M>::set (CompareCaptureChannel channel, bool output) const
 	{
+		RegisterTransaction ctrlc (_ctrlc);
+		// Bits 7:4 are reserved and must be written as 0:
+		ctrlc.template set_bits_value<7, 4> (0);
+
 		switch (channel)
 		{
-			case CompareCaptureChannel::A:
-				_ctrlc = (_ctrlc.read() & 0b00001110) | ((output ? 1 : 0) << 0);
-				break;
-
-			case CompareCaptureChannel::B:
-				_ctrlc = (_ctrlc.read() & 0b00001101) | ((output ? 1 : 0) << 1);
-				break;
-
-			case CompareCaptureChannel::C:
-				_ctrlc = (_ctrlc.read() & 0b00001011) | ((output ? 1 : 0) << 2);
-				break;
-
-			case CompareCaptureChannel::D:
-				_ctrlc = (_ctrlc.read() & 0b00000111) | ((output ? 1 : 0) << 3);
-				break;
+			case CompareCaptureChannel::A:	ctrlc.template set_bit_value<0> (output);	break;
+			case CompareCaptureChannel::B:	ctrlc.template set_bit_value<1> (output);	break;
+			case CompareCaptureChannel::C:	ctrlc.template set_bit_value<2> (output);	break;
+			case CompareCaptureChannel::D:	ctrlc.template set_bit_value<3> (output);	break;
 		}
 	}
 
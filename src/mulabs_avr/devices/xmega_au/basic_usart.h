@@ -14,6 +14,7 @@
 #ifndef MULABS_AVR__DEVICES__XMEGA_AU__BASIC_USART_H__INCLUDED
 #define MULABS_AVR__DEVICES__XMEGA_AU__BASIC_USART_H__INCLUDED
 
+#include <mulabs_avr/avr/register_transaction.h>
 #include <mulabs_avr/devices/xmega_au/interrupt_system.h>
 
 
@@ -49,6 +50,16 @@ template<class pMCU>
 			_2x					= 0b1 << 2,
 		};
 
+		enum class StatusFlags: uint8_t
+		{
+			RxComplete			= 1 << 7,	// Interrupt flag
+			TxComplete			= 1 << 6,	// Interrupt flag
+			DataRegisterEmpty	= 1 << 5,	// Interrupt flag
+			FrameError			= 1 << 4,
+			BufferOverflow		= 1 << 3,
+			ParityError			= 1 << 2,
+		};
+
 	  private:
 		enum class DataBits: uint8_t
 		{
@@ -65,16 +76,6 @@ template<class pMCU>
 			_2					= 0b1 << 3,
 		};
 
-		enum class StatusFlags: uint8_t
-		{
-			RxComplete			= 1 << 7,	// Interrupt flag
-			TxComplete			= 1 << 6,	// Interrupt flag
-			DataRegisterEmpty	= 1 << 5,	// Interrupt flag
-			FrameError			= 1 << 4,
-			BufferOverflow		= 1 << 3,
-			ParityError			= 1 << 2,
-		};
-
 	  public:
 		// Ctor
 		explicit constexpr
@@ -154,6 +155,13 @@ template<class pMCU>
 		uint16_t
 		read9_blocking() const;
 
+		/**
+		 * Return the STATUS register (see StatusFlags). Error flags refer to the word at the front of the
+		 * receive buffer, so to check them for a word, read status() before reading the word.
+		 */
+		uint8_t
+		status() const;
+
 		/**
 		 * Return true there was an error in the last incoming frame.
 		 * It's cleared when data is read from the buffer.
@@ -269,6 +277,13 @@ template<class pMCU>
 			void
 			set_stop_bits() const;
 
+		/**
+		 * Set mode, parity, data bits and stop bits with a single write to the CTRLC register.
+		 * Invalid data bits or stop bits values leave respective fields unchanged.
+		 */
+		void
+		set_frame_format (Mode, Parity, uint8_t data_bits, uint8_t stop_bits) const;
+
 		// TODO CTRLC.UDORD
 		// TODO CTRLC.UCPHA
 
@@ -292,6 +307,13 @@ template<class pMCU>
 		void
 		set_baud_rate_scale (int8_t scale) const;
 
+		/**
+		 * Set both period and scale in fractional baud rate generator, writing
+		 * the BAUDCTRLB register only once.
+		 */
+		void
+		set_baud_rate_period_and_scale (uint16_t period, int8_t scale) const;
+
 	  private:
 		size_t const	_base_address;
 		Register8 const	_data, _status;
@@ -420,6 +442,14 @@ template<class M>
 	}
 
 
+template<class M>
+	inline uint8_t
+	BasicUSART<M>::status() const
+	{
+		return _status.read();
+	}
+
+
 template<class M>
 	inline bool
 	BasicUSART<M>::is_frame_error() const
@@ -614,6 +644,31 @@ template<class M>
 		}
 
 
+template<class M>
+	inline void
+	BasicUSART<M>::set_frame_format (Mode mode, Parity parity, uint8_t data_bits, uint8_t stop_bits) const
+	{
+		RegisterTransaction ctrlc (_ctrlc);
+		ctrlc.template set_masked_value<0b11000000> (static_cast<uint8_t> (mode));
+		ctrlc.template set_masked_value<0b00110000> (static_cast<uint8_t> (parity));
+
+		switch (stop_bits)
+		{
+			case 1:	ctrlc.template set_masked_value<0b00001000> (static_cast<uint8_t> (StopBits::_1));	break;
+			case 2:	ctrlc.template set_masked_value<0b00001000> (static_cast<uint8_t> (StopBits::_2));	break;
+		}
+
+		switch (data_bits)
+		{
+			case 5:	ctrlc.template set_masked_value<0b00000111> (static_cast<uint8_t> (DataBits::_5));	break;
+			case 6:	ctrlc.template set_masked_value<0b00000111> (static_cast<uint8_t> (DataBits::_6));	break;
+			case 7:	ctrlc.template set_masked_value<0b00000111> (static_cast<uint8_t> (DataBits::_7));	break;
+			case 8:	ctrlc.template set_masked_value<0b00000111> (static_cast<uint8_t> (DataBits::_8));	break;
+			case 9:	ctrlc.template set_masked_value<0b00000111> (static_cast<uint8_t> (DataBits::_9));	break;
+		}
+	}
+
+
 template<class M>
 	template<typename BasicUSART<M>::Mode pMode, typename BasicUSART<M>::Speed pSpeed>
 		inline void
@@ -644,11 +699,9 @@ template<class M>
 					}
 
 					if (scale >= 0)
-						set_baud_rate_period (1.0f * peripheral_frequency / (pow2 (scale) * x * baud_rate) - 1);
+						set_baud_rate_period_and_scale (1.0f * peripheral_frequency / (pow2 (scale) * x * baud_rate) - 1, scale);
 					else
-						set_baud_rate_period (1.0f * pow2 (-scale) * (peripheral_frequency / (x * baud_rate) - 1));
-
-					set_baud_rate_scale (scale);
+						set_baud_rate_period_and_scale (1.0f * pow2 (-scale) * (peripheral_frequency / (x * baud_rate) - 1), scale);
 					break;
 				}
 			}
@@ -671,6 +724,18 @@ template<class M>
 		_baudctrlb = (_baudctrlb.read() & 0b00001111) | (scale << 4);
 	}
 
+
+template<class M>
+	inline void
+	BasicUSART<M>::set_baud_rate_period_and_scale (uint16_t period, int8_t scale) const
+	{
+		_baudctrla = period & 0x0ff;
+		// Both fields cover whole BAUDCTRLB, so this is a plain write:
+		RegisterTransaction baudctrlb (_baudctrlb);
+		baudctrlb.template set_bits_value<7, 4> (static_cast<uint8_t> (scale));
+		baudctrlb.template set_bits_value<3, 0> ((period & 0xf00) >> 8);
+	}
+
 } // namespace xmega_au
 } // namespace avr
 } // namespace mulabs
@@ -241,6 +241,12 @@ template<class pMCU>
 		void
 		set_address (uint8_t) const;
 
+		/**
+		 * Return the USB address set with set_address().
+		 */
+		uint8_t
+		address() const;
+
 		/**
 		 * Attach/detach the USB device from the bus.
 		 */
@@ -620,6 +626,14 @@ template<class M>
 	}
 
 
+template<class M>
+	inline uint8_t
+	BasicUSBSIE<M>::address() const
+	{
+		return _addr;
+	}
+
+
 template<class M>
 	inline void
 	BasicUSBSIE<M>::set_attached (bool attached) const
@@ -73,7 +73,8 @@ template<class pMCU>
 			_1,	// DATA1 packet
 		};
 
-	  protected:
+	  public:
+		// STATUS register bits:
 		static constexpr uint8_t kStall						= bit<7>;
 		static constexpr uint8_t kCRCError					= bit<7>;
 		static constexpr uint8_t kUnderflowOverflow			= bit<6>;
@@ -84,6 +85,8 @@ template<class pMCU>
 		static constexpr uint8_t kBusNack1					= bit<2>;
 		static constexpr uint8_t kBusNack0					= bit<1>;
 		static constexpr uint8_t kData						= bit<0>;
+		// CTRL register bits:
+		static constexpr uint8_t kControlStall				= bit<2>;
 
 	  protected:
 		// Ctor
@@ -162,6 +165,12 @@ template<class pMCU>
 		void
 		set_stalled (bool);
 
+		/**
+		 * Return true if STALL of the endpoint is enabled (see set_stalled()).
+		 */
+		bool
+		stall_enabled() const;
+
 		/**
 		 * Set pointer to the data buffer.
 		 */
@@ -254,7 +263,18 @@ template<class pMCU>
 		void
 		wait_for_transaction_complete() const;
 
-		// TODO STATUS<3> BANK
+		/**
+		 * Return true if transaction on given bank completed successfully.
+		 * Use with ping-pong operation; Buffer::_0 is equivalent to transaction_complete().
+		 */
+		bool
+		transaction_complete (Buffer) const;
+
+		/**
+		 * Return the bank that will be used for the next transaction when ping-pong operation is enabled.
+		 */
+		Buffer
+		bank() const;
 
 		/**
 		 * Return true if endpoint is NACK-ing all transactions.
@@ -288,6 +308,13 @@ template<class pMCU>
 		void
 		set_ready();
 
+		/**
+		 * Give given bank to the SIE when ping-pong operation is enabled: clear its transaction_complete and nack_all flags
+		 * and clear the underflow or overflow condition. The other bank is not affected.
+		 */
+		void
+		set_ready (Buffer);
+
 	  protected:
 		size_t const		_base_address;
 		// There registers are not memory-mapped device registers, but regular SRAM cells,
@@ -325,6 +352,12 @@ template<class pMCU>
 		void
 		set_total_transfer_size (size_t);
 
+		/**
+		 * Reset number of received bytes to 0. Needed before receiving a new multipacket transfer.
+		 */
+		void
+		reset_transaction_size();
+
 		/**
 		 * Return true if the endpoint is not yet ready to receive new data from host after an OUT packet.
 		 */
@@ -388,6 +421,8 @@ template<class pMCU>
 		void
 		reset_underflow();
 
+		using Endpoint::set_ready;
+
 		/**
 		 * Call set_transaction_size (bytes) and set_ready().
 		 */
@@ -509,6 +544,14 @@ template<class M>
 	}
 
 
+template<class M>
+	inline bool
+	BasicUSBSIEEndpoint<M>::stall_enabled() const
+	{
+		return _ctrl.template get_bit<2>();
+	}
+
+
 template<class M>
 	inline void
 	BasicUSBSIEEndpoint<M>::set_buffer (uint8_t* buffer)
@@ -624,6 +667,32 @@ template<class M>
 	}
 
 
+template<class M>
+	inline bool
+	BasicUSBSIEEndpoint<M>::transaction_complete (Buffer buffer) const
+	{
+		switch (buffer)
+		{
+			case Buffer::_0:
+				return this->_status.template get_bit<5>();
+
+			case Buffer::_1:
+				return this->_status.template get_bit<4>();
+
+			default:
+				return false;
+		}
+	}
+
+
+template<class M>
+	inline auto
+	BasicUSBSIEEndpoint<M>::bank() const -> Buffer
+	{
+		return this->_status.template get_bit<3>() ? Buffer::_1 : Buffer::_0;
+	}
+
+
 template<class M>
 	inline bool
 	BasicUSBSIEEndpoint<M>::is_nack_all (Buffer buffer) const
@@ -692,6 +761,23 @@ template<class M>
 	}
 
 
+template<class M>
+	inline void
+	BasicUSBSIEEndpoint<M>::set_ready (Buffer buffer)
+	{
+		switch (buffer)
+		{
+			case Buffer::_0:
+				atomic_sram_clear_bitmask<kUnderflowOverflow | kTransactionComplete | kBusNack0> (this->_status.ref());
+				break;
+
+			case Buffer::_1:
+				atomic_sram_clear_bitmask<kUnderflowOverflow | kTransactionComplete1 | kBusNack1> (this->_status.ref());
+				break;
+		}
+	}
+
+
 template<class M>
 	constexpr
 	BasicUSBSIEOutputEndpoint<M>::BasicUSBSIEOutputEndpoint (uint8_t* base_address):
@@ -715,6 +801,14 @@ template<class M>
 	}
 
 
+template<class M>
+	inline void
+	BasicUSBSIEOutputEndpoint<M>::reset_transaction_size()
+	{
+		this->_cnt = 0;
+	}
+
+
 template<class M>
 	inline bool
 	BasicUSBSIEOutputEndpoint<M>::is_overflow() const
@@ -0,0 +1,347 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__DEVICES__XMEGA_AU__BUFFERED_USART_H__INCLUDED
+#define MULABS_AVR__DEVICES__XMEGA_AU__BUFFERED_USART_H__INCLUDED
+
+// Standard:
+#include <stddef.h>
+#include <stdint.h>
+
+// Mulabs:
+#include <mulabs_avr/devices/xmega_au/interrupt_system.h>
+#include <mulabs_avr/utility/atomic.h>
+#include <mulabs_avr/utility/span.h>
+#include <mulabs_avr/utility/spsc_ring.h>
+
+
+namespace mulabs {
+namespace avr {
+namespace xmega_au {
+
+/**
+ * Interrupt-driven USART with receive and transmit ring buffers. write() and read() never wait: they copy as much
+ * as fits (or as much as is available) and return, the interrupt handlers move the data between the rings and
+ * the USART.
+ *
+ * Both handlers drain the hardware in a loop (the receiver has a 2-word buffer, the transmitter a data register and
+ * a shift register), so one interrupt can move more than one word. At 2 Mbaud a word takes 5 µs (160 cycles at 32 MHz),
+ * and the receive buffer gives the RXC interrupt about two word-times to run before an overrun happens, so give it
+ * a level that isn't blocked for longer than that by other handlers.
+ *
+ * Only 5…8-bit words are supported.
+ *
+ * Usage:
+ *   xmega_au::BufferedUSART<MCU, 64, 64> usart (MCU::usart_c0);
+ *
+ *   ISR (USARTC0_RXC_vect) { usart.handle_rx_complete(); }
+ *   ISR (USARTC0_DRE_vect) { usart.handle_data_register_empty(); }
+ *
+ *   usart.usart().set_frame_format (…);
+ *   usart.usart().set_baud_rate<…> (…);
+ *   usart.set_interrupt_level (InterruptSystem::Level::Medium);
+ *   usart.usart().set_rx_enabled (true);
+ *   usart.usart().set_tx_enabled (true);
+ *
+ * \param	pRxCapacity, pTxCapacity
+ *			Ring sizes in bytes. Must be powers of two, max 128.
+ */
+template<class pMCU, size_t pRxCapacity = 64, size_t pTxCapacity = 64>
+	class BufferedUSART
+	{
+	  public:
+		using MCU			= pMCU;
+		using USART			= typename MCU::USART;
+		using StatusFlags	= typename USART::StatusFlags;
+		using RxRing		= SpscRing<uint8_t, pRxCapacity>;
+		using TxRing		= SpscRing<uint8_t, pTxCapacity>;
+
+	  public:
+		// Ctor
+		explicit
+		BufferedUSART (USART const&);
+
+		/**
+		 * Return the USART, for configuration.
+		 */
+		USART const&
+		usart() const noexcept;
+
+		/**
+		 * Set level of the receive-complete and data-register-empty interrupts. The data-register-empty interrupt
+		 * is enabled only while there's data to send.
+		 */
+		void
+		set_interrupt_level (InterruptSystem::Level);
+
+		/**
+		 * Queue bytes for sending. Return number of bytes queued (less than requested if the transmit ring is full).
+		 */
+		size_t
+		write (Span<uint8_t const>);
+
+		/**
+		 * Read received bytes into the span. Return number of bytes read.
+		 */
+		size_t
+		read (Span<uint8_t>);
+
+		/**
+		 * Return number of received bytes ready to read.
+		 */
+		size_t
+		readable() const;
+
+		/**
+		 * Return number of bytes that can be queued with write().
+		 */
+		size_t
+		writable() const;
+
+		/**
+		 * Return true if all queued bytes were passed to the USART. The last byte may be still being shifted out.
+		 */
+		bool
+		tx_empty() const;
+
+		/**
+		 * Error counters. Counters are free-running (they wrap at 256), so to see if errors occured, compare
+		 * with previously read values.
+		 */
+
+		/**
+		 * Number of words lost by the hardware, because the receive buffer was full (the RXC interrupt was handled too late).
+		 */
+		uint8_t
+		overruns() const;
+
+		/**
+		 * Number of words received with a frame error (stop bit was 0). Such words are dropped.
+		 */
+		uint8_t
+		frame_errors() const;
+
+		/**
+		 * Number of words received with a parity error. Such words are dropped.
+		 */
+		uint8_t
+		parity_errors() const;
+
+		/**
+		 * Number of words dropped because the receive ring was full (read() wasn't called often enough).
+		 */
+		uint8_t
+		rx_dropped() const;
+
+		/**
+		 * Call from the RXC interrupt handler.
+		 */
+		void
+		handle_rx_complete();
+
+		/**
+		 * Call from the DRE interrupt handler.
+		 */
+		void
+		handle_data_register_empty();
+
+	  private:
+		static void
+		increment (Atomic<uint8_t>&);
+
+	  private:
+		USART const				_usart;
+		InterruptSystem::Level	_level				{ InterruptSystem::Level::Disabled };
+		RxRing					_rx_ring;
+		TxRing					_tx_ring;
+		Atomic<uint8_t>			_overruns			{ 0 };
+		Atomic<uint8_t>			_frame_errors		{ 0 };
+		Atomic<uint8_t>			_parity_errors		{ 0 };
+		Atomic<uint8_t>			_rx_dropped			{ 0 };
+	};
+
+
+template<class M, size_t R, size_t T>
+	inline
+	BufferedUSART<M, R, T>::BufferedUSART (USART const& usart):
+		_usart (usart)
+	{ }
+
+
+template<class M, size_t R, size_t T>
+	inline auto
+	BufferedUSART<M, R, T>::usart() const noexcept -> USART const&
+	{
+		return _usart;
+	}
+
+
+template<class M, size_t R, size_t T>
+	inline void
+	BufferedUSART<M, R, T>::set_interrupt_level (InterruptSystem::Level level)
+	{
+		_level = level;
+		_usart.set_rx_complete (level);
+
+		if (!_tx_ring.empty())
+			_usart.set_data_register_empty (level);
+	}
+
+
+template<class M, size_t R, size_t T>
+	inline size_t
+	BufferedUSART<M, R, T>::write (Span<uint8_t const> data)
+	{
+		size_t const written = _tx_ring.push_span (data);
+
+		// Enable the interrupt after pushing: if the handler disabled it in the meantime because the ring was empty,
+		// it will now see the new data. If it already sent the data, it will just disable itself again.
+		if (written > 0)
+			_usart.set_data_register_empty (_level);
+
+		return written;
+	}
+
+
+template<class M, size_t R, size_t T>
+	inline size_t
+	BufferedUSART<M, R, T>::read (Span<uint8_t> data)
+	{
+		return _rx_ring.pop_span (data);
+	}
+
+
+template<class M, size_t R, size_t T>
+	inline size_t
+	BufferedUSART<M, R, T>::readable() const
+	{
+		return _rx_ring.size();
+	}
+
+
+template<class M, size_t R, size_t T>
+	inline size_t
+	BufferedUSART<M, R, T>::writable() const
+	{
+		return TxRing::capacity() - _tx_ring.size();
+	}
+
+
+template<class M, size_t R, size_t T>
+	inline bool
+	BufferedUSART<M, R, T>::tx_empty() const
+	{
+		return _tx_ring.empty();
+	}
+
+
+template<class M, size_t R, size_t T>
+	inline uint8_t
+	BufferedUSART<M, R, T>::overruns() const
+	{
+		return _overruns.load();
+	}
+
+
+template<class M, size_t R, size_t T>
+	inline uint8_t
+	BufferedUSART<M, R, T>::frame_errors() const
+	{
+		return _frame_errors.load();
+	}
+
+
+template<class M, size_t R, size_t T>
+	inline uint8_t
+	BufferedUSART<M, R, T>::parity_errors() const
+	{
+		return _parity_errors.load();
+	}
+
+
+template<class M, size_t R, size_t T>
+	inline uint8_t
+	BufferedUSART<M, R, T>::rx_dropped() const
+	{
+		return _rx_dropped.load();
+	}
+
+
+template<class M, size_t R, size_t T>
+	inline void
+	BufferedUSART<M, R, T>::handle_rx_complete()
+	{
+		constexpr uint8_t kErrors = static_cast<uint8_t> (StatusFlags::FrameError) | static_cast<uint8_t> (StatusFlags::ParityError);
+
+		while (true)
+		{
+			// Error flags refer to the word at the front of the receive buffer, so read them before the word:
+			uint8_t const status = _usart.status();
+
+			if (!(status & static_cast<uint8_t> (StatusFlags::RxComplete)))
+				break;
+
+			uint8_t const word = _usart.read();
+
+			if (status & static_cast<uint8_t> (StatusFlags::BufferOverflow))
+				increment (_overruns);
+
+			if (status & kErrors)
+			{
+				if (status & static_cast<uint8_t> (StatusFlags::FrameError))
+					increment (_frame_errors);
+
+				if (status & static_cast<uint8_t> (StatusFlags::ParityError))
+					increment (_parity_errors);
+			}
+			else if (!_rx_ring.push (word))
+				increment (_rx_dropped);
+		}
+	}
+
+
+template<class M, size_t R, size_t T>
+	inline void
+	BufferedUSART<M, R, T>::handle_data_register_empty()
+	{
+		// Right after the transmitter moves the data register to an idle shift register, the data register is
+		// free again, so more than one byte can be written here:
+		while (_usart.status() & static_cast<uint8_t> (StatusFlags::DataRegisterEmpty))
+		{
+			uint8_t byte;
+
+			if (!_tx_ring.pop (byte))
+			{
+				_usart.set_data_register_empty (InterruptSystem::Level::Disabled);
+				break;
+			}
+
+			_usart.write (byte);
+		}
+	}
+
+
+template<class M, size_t R, size_t T>
+	inline void
+	BufferedUSART<M, R, T>::increment (Atomic<uint8_t>& counter)
+	{
+		// Counters are written only by the RXC handler:
+		counter.store (counter.load() + 1);
+	}
+
+} // namespace xmega_au
+} // namespace avr
+} // namespace mulabs
+
+#endif
+
@@ -0,0 +1,368 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__DEVICES__XMEGA_AU__VIRTUAL_PORT_H__INCLUDED
+#define MULABS_AVR__DEVICES__XMEGA_AU__VIRTUAL_PORT_H__INCLUDED
+
+// Mulabs:
+#include <mulabs_avr/devices/common/common_static_pin.h>
+#include <mulabs_avr/mcu/atxmega128-a1u-registers.h>
+#include <mulabs_avr/utility/bits.h>
+
+
+namespace mulabs {
+namespace avr {
+namespace xmega_au {
+
+/**
+ * Port accessed through one of the four virtual ports. Virtual port registers are in the I/O space and
+ * are StaticRegister8, so operations on pins known at compile time compile to SBI/CBI/SBIS/SBIC instructions.
+ * Call map() once to map the port onto the virtual port, before using other methods.
+ *
+ *   using Leds = xmega_au::VirtualPort<MCU, 0, MCU::port_d>;
+ *   Leds::map();
+ *   Leds::pin<3>().configure_as_output();
+ *   Leds::pin<3>().set_high();	// SBI 0x11, 3
+ *
+ * \param	pVirtualPortNumber
+ *			Virtual port number (0…3).
+ * \param	pPort
+ *			The real port (MCU::port_x).
+ */
+template<class pMCU, uint8_t pVirtualPortNumber, typename pMCU::Port const& pPort>
+	class VirtualPort
+	{
+		static_assert (pVirtualPortNumber < 4, "virtual port number must be 0…3");
+
+	  public:
+		using MCU				= pMCU;
+		using Port				= typename MCU::Port;
+		using PinBits			= typename MCU::PortIntegerType;
+
+		static constexpr size_t	kBaseAddress = kVPORT0_DIR + (kVPORT1_DIR - kVPORT0_DIR) * pVirtualPortNumber;
+
+		using DirRegister		= typename MCU::template StaticRegister8<kBaseAddress + 0x00>;
+		using OutRegister		= typename MCU::template StaticRegister8<kBaseAddress + 0x01>;
+		using InRegister		= typename MCU::template StaticRegister8<kBaseAddress + 0x02>;
+
+		template<uint8_t PinNumber>
+			using Pin = CommonStaticPin<VirtualPort, PinNumber>;
+
+	  public:
+		// Ctor
+		constexpr
+		VirtualPort() = default;
+
+		/**
+		 * Map the real port onto the virtual port (PORTCFG.VPCTRLA/VPCTRLB).
+		 */
+		static void
+		map();
+
+		/**
+		 * Return Pin object by bit number.
+		 */
+		template<uint8_t PinNumber>
+			static constexpr Pin<PinNumber>
+			pin();
+
+		/**
+		 * Return the real port's number (A is 0, B is 1, etc).
+		 */
+		static constexpr uint8_t
+		port_number();
+
+		/**
+		 * Return the real port.
+		 */
+		constexpr
+		operator Port() const;
+
+		/**
+		 * Read byte from the port.
+		 */
+		PinBits
+		get() const;
+
+		/**
+		 * Alias for get().
+		 */
+		operator PinBits() const;
+
+		/**
+		 * Write byte to all pins on port at once.
+		 */
+		void
+		set (PinBits pin_bits) const;
+
+		/**
+		 * Alias for set (uint8_t).
+		 */
+		VirtualPort const&
+		operator= (PinBits pin_bits) const;
+
+		/**
+		 * Set selected pins to high level.
+		 */
+		void
+		set_high (PinBits pin_bits) const;
+
+		/**
+		 * Set selected pins to low level.
+		 */
+		void
+		set_low (PinBits pin_bits) const;
+
+		/**
+		 * Toggle selected pins (switch levels).
+		 * Virtual ports don't have the OUTTGL register, so this uses the real port.
+		 */
+		void
+		toggle (PinBits pin_bits) const;
+
+		/**
+		 * Configure pins denoted by set bits as inputs.
+		 */
+		void
+		configure_as_inputs (PinBits pin_bits) const;
+
+		/**
+		 * Configure pins denoted by set bits as outputs.
+		 */
+		void
+		configure_as_outputs (PinBits pin_bits) const;
+
+		/**
+		 * Configure individual pin as input.
+		 */
+		void
+		pin_configure_as_input (uint8_t pin_number) const;
+
+		/**
+		 * Configure individual pin as output.
+		 */
+		void
+		pin_configure_as_output (uint8_t pin_number) const;
+
+		/**
+		 * Get individual pin level.
+		 */
+		bool
+		pin_get (uint8_t pin_number) const;
+
+		/**
+		 * Set individual pin to given logic value.
+		 */
+		void
+		pin_set (uint8_t pin_number, bool logic_value) const;
+
+		/**
+		 * Set individual pin to high level.
+		 */
+		void
+		pin_set_high (uint8_t pin_number) const;
+
+		/**
+		 * Set individual pin to low level.
+		 */
+		void
+		pin_set_low (uint8_t pin_number) const;
+
+		/**
+		 * Toggle individual pin level.
+		 */
+		void
+		pin_toggle (uint8_t pin_number) const;
+
+	  private:
+		static constexpr DirRegister	_dir	{ };
+		static constexpr OutRegister	_out	{ };
+		static constexpr InRegister		_in		{ };
+	};
+
+
+template<class M, uint8_t V, typename M::Port const& P>
+	inline void
+	VirtualPort<M, V, P>::map()
+	{
+		// Ports are 0x20 bytes apart starting at 0x0600, the map value is the port's index in that space:
+		constexpr uint8_t map_value = (P.base_address() - 0x0600) / 0x20;
+		constexpr uint8_t shift = (V % 2) * 4;
+		typename MCU::Register8 const vpctrl (V < 2 ? kPORTCFG_VPCTRLA : kPORTCFG_VPCTRLB);
+
+		vpctrl = (vpctrl.read() & ~(0x0f << shift)) | (map_value << shift);
+	}
+
+
+template<class M, uint8_t V, typename M::Port const& P>
+	template<uint8_t PinNumber>
+		constexpr auto
+		VirtualPort<M, V, P>::pin() -> Pin<PinNumber>
+		{
+			return Pin<PinNumber>();
+		}
+
+
+template<class M, uint8_t V, typename M::Port const& P>
+	constexpr uint8_t
+	VirtualPort<M, V, P>::port_number()
+	{
+		return P.port_number();
+	}
+
+
+template<class M, uint8_t V, typename M::Port const& P>
+	constexpr
+	VirtualPort<M, V, P>::operator Port() const
+	{
+		return P;
+	}
+
+
+template<class M, uint8_t V, typename M::Port const& P>
+	inline auto
+	VirtualPort<M, V, P>::get() const -> PinBits
+	{
+		return _in;
+	}
+
+
+template<class M, uint8_t V, typename M::Port const& P>
+	inline
+	VirtualPort<M, V, P>::operator PinBits() const
+	{
+		return get();
+	}
+
+
+template<class M, uint8_t V, typename M::Port const& P>
+	inline void
+	VirtualPort<M, V, P>::set (PinBits pin_bits) const
+	{
+		_out = pin_bits;
+	}
+
+
+template<class M, uint8_t V, typename M::Port const& P>
+	inline auto
+	VirtualPort<M, V, P>::operator= (PinBits pin_bits) const -> VirtualPort const&
+	{
+		set (pin_bits);
+		return *this;
+	}
+
+
+template<class M, uint8_t V, typename M::Port const& P>
+	inline void
+	VirtualPort<M, V, P>::set_high (PinBits pin_bits) const
+	{
+		_out.ref() |= pin_bits;
+	}
+
+
+template<class M, uint8_t V, typename M::Port const& P>
+	inline void
+	VirtualPort<M, V, P>::set_low (PinBits pin_bits) const
+	{
+		_out.ref() &= ~pin_bits;
+	}
+
+
+template<class M, uint8_t V, typename M::Port const& P>
+	inline void
+	VirtualPort<M, V, P>::toggle (PinBits pin_bits) const
+	{
+		P.toggle (pin_bits);
+	}
+
+
+template<class M, uint8_t V, typename M::Port const& P>
+	inline void
+	VirtualPort<M, V, P>::configure_as_inputs (PinBits pin_bits) const
+	{
+		_dir.ref() &= ~pin_bits;
+	}
+
+
+template<class M, uint8_t V, typename M::Port const& P>
+	inline void
+	VirtualPort<M, V, P>::configure_as_outputs (PinBits pin_bits) const
+	{
+		_dir.ref() |= pin_bits;
+	}
+
+
+template<class M, uint8_t V, typename M::Port const& P>
+	inline void
+	VirtualPort<M, V, P>::pin_configure_as_input (uint8_t pin_number) const
+	{
+		configure_as_inputs (1 << pin_number);
+	}
+
+
+template<class M, uint8_t V, typename M::Port const& P>
+	inline void
+	VirtualPort<M, V, P>::pin_configure_as_output (uint8_t pin_number) const
+	{
+		configure_as_outputs (1 << pin_number);
+	}
+
+
+template<class M, uint8_t V, typename M::Port const& P>
+	inline bool
+	VirtualPort<M, V, P>::pin_get (uint8_t pin_number) const
+	{
+		return get() & (1 << pin_number);
+	}
+
+
+template<class M, uint8_t V, typename M::Port const& P>
+	inline void
+	VirtualPort<M, V, P>::pin_set (uint8_t pin_number, bool logic_value) const
+	{
+		if (logic_value)
+			pin_set_high (pin_number);
+		else
+			pin_set_low (pin_number);
+	}
+
+
+template<class M, uint8_t V, typename M::Port const& P>
+	inline void
+	VirtualPort<M, V, P>::pin_set_high (uint8_t pin_number) const
+	{
+		set_high (1 << pin_number);
+	}
+
+
+template<class M, uint8_t V, typename M::Port const& P>
+	inline void
+	VirtualPort<M, V, P>::pin_set_low (uint8_t pin_number) const
+	{
+		set_low (1 << pin_number);
+	}
+
+
+template<class M, uint8_t V, typename M::Port const& P>
+	inline void
+	VirtualPort<M, V, P>::pin_toggle (uint8_t pin_number) const
+	{
+		toggle (1 << pin_number);
+	}
+
+} // namespace xmega_au
+} // namespace avr
+} // namespace mulabs
+
+#endif
+
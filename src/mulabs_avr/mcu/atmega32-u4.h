@@ -23,10 +23,13 @@
 #include <mulabs_avr/avr/avr_fixes.h>
 #include <mulabs_avr/avr/basic_register8.h>
 #include <mulabs_avr/avr/basic_register16.h>
+#include <mulabs_avr/avr/static_register8.h>
+#include <mulabs_avr/avr/static_register16.h>
 #include <mulabs_avr/devices/common/common_basic_io.h>
 #include <mulabs_avr/devices/common/common_basic_pin.h>
 #include <mulabs_avr/devices/common/common_basic_pin_set.h>
 #include <mulabs_avr/devices/mega32u4/basic_port.h>
+#include <mulabs_avr/devices/mega32u4/static_port.h>
 #include <mulabs_avr/devices/mega32u4/basic_jtag.h>
 #include <mulabs_avr/utility/array.h>
 #include <mulabs_avr/utility/type_traits.h>
@@ -46,18 +49,35 @@ class ATMega32U4
 	using Register16		= BasicRegister16;
 	using PortIntegerType	= uint8_t;
 
+	template<size_t Address>
+		using StaticRegister8	= avr::StaticRegister8<Address>;
+
+	template<size_t Address>
+		using StaticRegister16	= avr::StaticRegister16<Address>;
+
 	using IO				= CommonBasicIO<MCU>;
 	using Pin				= CommonBasicPin<MCU>;
 	using Port				= mega32u4::BasicPort<MCU>;
 	using PinSet			= CommonBasicPinSet<MCU>;
 	using JTAG				= mega32u4::BasicJTAG<MCU>;
 
+	// Ports with compile-time addresses; single-pin operations compile to SBI/CBI:
+	using StaticPortB		= mega32u4::StaticPort<MCU, 0, kPORTB_PIN, kPORTB_DDR, kPORTB_PORT>;
+	using StaticPortC		= mega32u4::StaticPort<MCU, 1, kPORTC_PIN, kPORTC_DDR, kPORTC_PORT>;
+	using StaticPortD		= mega32u4::StaticPort<MCU, 2, kPORTD_PIN, kPORTD_DDR, kPORTD_PORT>;
+	using StaticPortE		= mega32u4::StaticPort<MCU, 3, kPORTE_PIN, kPORTE_DDR, kPORTE_PORT>;
+	using StaticPortF		= mega32u4::StaticPort<MCU, 4, kPORTF_PIN, kPORTF_DDR, kPORTF_PORT>;
+
 	static_assert (is_literal_type<Register8>::value, "Register8 must be a literal type");
 	static_assert (is_literal_type<Register16>::value, "Register16 must be a literal type");
+	static_assert (is_literal_type<StaticRegister8<kPORTB_PORT>>::value, "StaticRegister8 must be a literal type");
+	static_assert (is_literal_type<StaticRegister16<0x0000>>::value, "StaticRegister16 must be a literal type");
 	static_assert (is_literal_type<IO>::value, "IO must be a literal type");
 	static_assert (is_literal_type<Pin>::value, "Pin must be a literal type");
 	static_assert (is_literal_type<PinSet>::value, "PinSet must be a literal type");
 	static_assert (is_literal_type<Port>::value, "Port must be a literal type");
+	static_assert (is_literal_type<StaticPortB>::value, "StaticPort must be a literal type");
+	static_assert (is_literal_type<StaticPortB::Pin<0>>::value, "StaticPort::Pin must be a literal type");
 
 #define MULABS_DECLARE_PORT(member_name, avr_port_prefix, port_number) \
 	static constexpr Port member_name { \
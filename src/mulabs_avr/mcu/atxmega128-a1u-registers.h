@@ -0,0 +1,50 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__MCU__ATXMEGA128_A1U_REGISTERS_H__INCLUDED
+#define MULABS_AVR__MCU__ATXMEGA128_A1U_REGISTERS_H__INCLUDED
+
+namespace mulabs {
+namespace avr {
+
+// Virtual ports are the only port registers within the I/O space (0x00…0x1f) on XMEGA, so only these
+// can be accessed with single-cycle SBI/CBI/SBIS/SBIC instructions. Use PORTCFG.VPCTRLA/VPCTRLB to map
+// real ports onto virtual ones. Unlike ATMega, there's no 0x20 offset between I/O and data space.
+static constexpr size_t kVPORT0_DIR			= 0x0010;
+static constexpr size_t kVPORT0_OUT			= 0x0011;
+static constexpr size_t kVPORT0_IN			= 0x0012;
+static constexpr size_t kVPORT0_INTFLAGS	= 0x0013;
+
+static constexpr size_t kVPORT1_DIR			= 0x0014;
+static constexpr size_t kVPORT1_OUT			= 0x0015;
+static constexpr size_t kVPORT1_IN			= 0x0016;
+static constexpr size_t kVPORT1_INTFLAGS	= 0x0017;
+
+static constexpr size_t kVPORT2_DIR			= 0x0018;
+static constexpr size_t kVPORT2_OUT			= 0x0019;
+static constexpr size_t kVPORT2_IN			= 0x001a;
+static constexpr size_t kVPORT2_INTFLAGS	= 0x001b;
+
+static constexpr size_t kVPORT3_DIR			= 0x001c;
+static constexpr size_t kVPORT3_OUT			= 0x001d;
+static constexpr size_t kVPORT3_IN			= 0x001e;
+static constexpr size_t kVPORT3_INTFLAGS	= 0x001f;
+
+static constexpr size_t kPORTCFG_VPCTRLA	= 0x00b2;
+static constexpr size_t kPORTCFG_VPCTRLB	= 0x00b3;
+
+} // namespace avr
+} // namespace mulabs
+
+#endif
+
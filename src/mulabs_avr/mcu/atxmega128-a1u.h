@@ -24,19 +24,24 @@
 #include <mulabs_avr/avr/avr_fixes.h>
 #include <mulabs_avr/avr/basic_register8.h>
 #include <mulabs_avr/avr/basic_register16.h>
+#include <mulabs_avr/avr/static_register8.h>
+#include <mulabs_avr/avr/static_register16.h>
 #include <mulabs_avr/devices/common/common_basic_io.h>
 #include <mulabs_avr/devices/common/common_basic_pin_set.h>
 #include <mulabs_avr/devices/xmega_au/basic_clock.h>
 #include <mulabs_avr/devices/xmega_au/basic_jtag.h>
 #include <mulabs_avr/devices/xmega_au/basic_pin.h>
 #include <mulabs_avr/devices/xmega_au/basic_port.h>
+#include <mulabs_avr/devices/xmega_au/basic_sleep.h>
 #include <mulabs_avr/devices/xmega_au/basic_timer_01.h>
 #include <mulabs_avr/devices/xmega_au/basic_usart.h>
 #include <mulabs_avr/devices/xmega_au/basic_usb_sie.h>
+#include <mulabs_avr/devices/xmega_au/virtual_port.h>
 #include <mulabs_avr/devices/xmega_au/event_system.h>
 #include <mulabs_avr/devices/xmega_au/interrupt_system.h>
 #include <mulabs_avr/std/type_traits.h>
 #include <mulabs_avr/utility/array.h>
+#include <mulabs_avr/mcu/atxmega128-a1u-registers.h>
 
 
 namespace mulabs {
@@ -52,11 +57,18 @@ class ATXMega128A1U
 	using Register16		= BasicRegister16;
 	using PortIntegerType	= uint8_t;
 
+	template<size_t Address>
+		using StaticRegister8	= avr::StaticRegister8<Address>;
+
+	template<size_t Address>
+		using StaticRegister16	= avr::StaticRegister16<Address>;
+
 	using Clock				= xmega_au::BasicClock<MCU>;
 	using IO				= CommonBasicIO<MCU>;
 	using Pin				= xmega_au::BasicPin<MCU>;
 	using Port				= xmega_au::BasicPort<MCU>;
 	using PinSet			= CommonBasicPinSet<MCU>;
+	using Sleep				= xmega_au::BasicSleep<MCU>;
 	using JTAG				= xmega_au::BasicJTAG<MCU>;
 	using Timer01			= xmega_au::BasicTimer01<MCU>;
 	using USART				= xmega_au::BasicUSART<MCU>;
@@ -64,6 +76,10 @@ class ATXMega128A1U
 	using EventSystem		= xmega_au::EventSystem;
 	using InterruptSystem	= xmega_au::InterruptSystem;
 
+	// Port mapped onto virtual port in the I/O space; single-pin operations compile to SBI/CBI:
+	template<uint8_t VirtualPortNumber, Port const& pPort>
+		using VirtualPort	= xmega_au::VirtualPort<MCU, VirtualPortNumber, pPort>;
+
 	enum SignatureRegister: uint8_t
 	{
 		// Auto-loaded:
@@ -105,11 +121,14 @@ class ATXMega128A1U
 
 	static_assert (std::is_literal_type<ATXMega128A1U::Register8>::value, "Register8 must be a literal type");
 	static_assert (std::is_literal_type<ATXMega128A1U::Register16>::value, "Register16 must be a literal type");
+	static_assert (std::is_literal_type<ATXMega128A1U::StaticRegister8<kVPORT0_OUT>>::value, "StaticRegister8 must be a literal type");
+	static_assert (std::is_literal_type<ATXMega128A1U::StaticRegister16<0x0000>>::value, "StaticRegister16 must be a literal type");
 	static_assert (std::is_literal_type<ATXMega128A1U::Clock>::value, "Clock must be a literal type");
 	static_assert (std::is_literal_type<ATXMega128A1U::IO>::value, "IO must be a literal type");
 	static_assert (std::is_literal_type<ATXMega128A1U::Pin>::value, "Pin must be a literal type");
 	static_assert (std::is_literal_type<ATXMega128A1U::Port>::value, "Port must be a literal type");
 	static_assert (std::is_literal_type<ATXMega128A1U::PinSet>::value, "PinSet must be a literal type");
+	static_assert (std::is_literal_type<ATXMega128A1U::Sleep>::value, "Sleep must be a literal type");
 	static_assert (std::is_literal_type<ATXMega128A1U::JTAG>::value, "JTAG must be a literal type");
 	static_assert (std::is_literal_type<ATXMega128A1U::Timer01>::value, "Timer01 must be a literal type");
 	static_assert (std::is_literal_type<ATXMega128A1U::USART>::value, "USART must be a literal type");
@@ -0,0 +1,47 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__MCU__HOST_REGISTERS_H__INCLUDED
+#define MULABS_AVR__MCU__HOST_REGISTERS_H__INCLUDED
+
+#ifdef __AVR__
+# error "host-registers.h is only for off-target builds"
+#endif
+
+// Mulabs AVR:
+#include <mulabs_avr/avr/host_register_file.h>
+
+
+// Replacements for avr-libc register macros and functions that are used directly by the drivers.
+// Addresses are the same as on XMEGA A1U. These access the simulated register file through
+// references, so they're not counted as register traffic.
+#define SREG		(::mulabs::avr::HostRegisterFile::ref8 (0x003f))
+#define CCP			(::mulabs::avr::HostRegisterFile::ref8 (0x0034))
+#define PMIC_CTRL	(::mulabs::avr::HostRegisterFile::ref8 (0x00a2))
+
+
+inline void
+cli()
+{
+	SREG = SREG & 0b01111111;
+}
+
+
+inline void
+sei()
+{
+	SREG = SREG | 0b10000000;
+}
+
+#endif
+
@@ -0,0 +1,202 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__MCU__HOST_H__INCLUDED
+#define MULABS_AVR__MCU__HOST_H__INCLUDED
+
+// Standard:
+#include <unistd.h>
+
+// Mulabs AVR:
+#include <mulabs_avr/mcu/host-registers.h>
+#include <mulabs_avr/avr/host_register8.h>
+#include <mulabs_avr/avr/host_register16.h>
+#include <mulabs_avr/avr/host_register_file.h>
+#include <mulabs_avr/devices/common/common_basic_io.h>
+#include <mulabs_avr/devices/common/common_basic_pin_set.h>
+#include <mulabs_avr/devices/xmega_au/basic_pin.h>
+#include <mulabs_avr/devices/xmega_au/basic_port.h>
+#include <mulabs_avr/devices/xmega_au/basic_timer_01.h>
+#include <mulabs_avr/devices/xmega_au/basic_usart.h>
+#include <mulabs_avr/devices/xmega_au/basic_usb_sie.h>
+#include <mulabs_avr/devices/xmega_au/interrupt_system.h>
+#include <mulabs_avr/std/type_traits.h>
+
+
+namespace mulabs {
+namespace avr {
+
+/**
+ * MCU policy for running drivers on the development machine (unit tests, register traffic measurements).
+ * Has the same peripherals at the same addresses as ATXMega128A1U, but registers are HostRegister8/HostRegister16
+ * backed by the HostRegisterFile. Oscillators, JTAG and event system are not simulated.
+ */
+class HostMCU
+{
+  public:
+	static constexpr uint8_t kNumPorts	= 11;
+
+	using MCU				= HostMCU;
+	using Register8			= HostRegister8;
+	using Register16		= HostRegister16;
+	using PortIntegerType	= uint8_t;
+
+	using IO				= CommonBasicIO<MCU>;
+	using Pin				= xmega_au::BasicPin<MCU>;
+	using Port				= xmega_au::BasicPort<MCU>;
+	using PinSet			= CommonBasicPinSet<MCU>;
+	using Timer01			= xmega_au::BasicTimer01<MCU>;
+	using USART				= xmega_au::BasicUSART<MCU>;
+	using USBSIE			= xmega_au::BasicUSBSIE<MCU>;
+	using InterruptSystem	= xmega_au::InterruptSystem;
+
+	enum SignatureRegister: uint8_t
+	{
+		USBCAL0			= 0x1a,
+		USBCAL1			= 0x1b,
+	};
+
+	static_assert (std::is_literal_type<HostMCU::Register8>::value, "Register8 must be a literal type");
+	static_assert (std::is_literal_type<HostMCU::Register16>::value, "Register16 must be a literal type");
+	static_assert (std::is_literal_type<HostMCU::IO>::value, "IO must be a literal type");
+	static_assert (std::is_literal_type<HostMCU::Pin>::value, "Pin must be a literal type");
+	static_assert (std::is_literal_type<HostMCU::Port>::value, "Port must be a literal type");
+	static_assert (std::is_literal_type<HostMCU::PinSet>::value, "PinSet must be a literal type");
+	static_assert (std::is_literal_type<HostMCU::Timer01>::value, "Timer01 must be a literal type");
+	static_assert (std::is_literal_type<HostMCU::USART>::value, "USART must be a literal type");
+	static_assert (std::is_literal_type<HostMCU::USBSIE>::value, "USBSIE must be a literal type");
+
+	static constexpr Port		port_a		{ 0x0600, 0 };
+	static constexpr Port		port_b		{ 0x0620, 1 };
+	static constexpr Port		port_c		{ 0x0640, 2 };
+	static constexpr Port		port_d		{ 0x0660, 3 };
+	static constexpr Port		port_e		{ 0x0680, 4 };
+	static constexpr Port		port_f		{ 0x06A0, 5 };
+	static constexpr Port		port_h		{ 0x06E0, 6 };
+	static constexpr Port		port_j		{ 0x0700, 7 };
+	static constexpr Port		port_k		{ 0x0720, 8 };
+	static constexpr Port		port_q		{ 0x07C0, 9 };
+	static constexpr Port		port_r		{ 0x07E0, 10 };
+
+	static constexpr Port	ports_index[kNumPorts] = { port_a, port_b, port_c, port_d, port_e,
+													   port_f, port_h, port_j, port_k, port_q, port_r };
+
+	static constexpr Timer01	timer_c0	{ 0x0800 };
+	static constexpr Timer01	timer_c1	{ 0x0840 };
+	static constexpr Timer01	timer_d0	{ 0x0900 };
+	static constexpr Timer01	timer_d1	{ 0x0940 };
+	static constexpr Timer01	timer_e0	{ 0x0a00 };
+	static constexpr Timer01	timer_e1	{ 0x0a40 };
+	static constexpr Timer01	timer_f0	{ 0x0b00 };
+	static constexpr Timer01	timer_f1	{ 0x0b40 };
+
+	static constexpr USART		usart_c0	{ 0x08a0 };
+	static constexpr USART		usart_c1	{ 0x08b0 };
+	static constexpr USART		usart_d0	{ 0x09a0 };
+	static constexpr USART		usart_d1	{ 0x09b0 };
+	static constexpr USART		usart_e0	{ 0x0aa0 };
+	static constexpr USART		usart_e1	{ 0x0ab0 };
+	static constexpr USART		usart_f0	{ 0x0ba0 };
+	static constexpr USART		usart_f1	{ 0x0bb0 };
+
+	static constexpr USBSIE		usb_sie		{ 0x04c0 };
+
+  public:
+	/**
+	 * Does nothing.
+	 */
+	static void
+	nop() noexcept
+	{ }
+
+	/**
+	 * Sleep for given number of milliseconds.
+	 */
+	static void
+	sleep_ms (int ms) noexcept
+	{
+		::usleep (1000 * ms);
+	}
+
+	/**
+	 * Sleep for given number of milliseconds.
+	 */
+	template<int MS>
+		static void
+		sleep_ms() noexcept
+		{
+			sleep_ms (MS);
+		}
+
+	/**
+	 * Sleep for given number of microseconds.
+	 */
+	static void
+	sleep_us (int us) noexcept
+	{
+		::usleep (us);
+	}
+
+	/**
+	 * Sleep for given number of microseconds.
+	 */
+	template<int US>
+		static void
+		sleep_us() noexcept
+		{
+			sleep_us (US);
+		}
+
+	/**
+	 * Writes the CCP signature, like on the MCU.
+	 */
+	static void
+	disable_configuration_change_protection_for_register()
+	{
+		CCP = 0xd8;
+	}
+
+	/**
+	 * Writes the CCP signature, like on the MCU.
+	 */
+	static void
+	disable_configuration_change_protection_for_spmlpm()
+	{
+		CCP = 0x9d;
+	}
+
+	/**
+	 * Read register from the simulated signature row.
+	 */
+	static uint8_t
+	read (SignatureRegister reg) noexcept
+	{
+		return signature_row()[reg];
+	}
+
+	/**
+	 * Simulated signature row, may be modified by tests. Zeroed by default.
+	 */
+	static uint8_t*
+	signature_row() noexcept
+	{
+		static uint8_t row[0x40];
+		return row;
+	}
+};
+
+} // namespace avr
+} // namespace mulabs
+
+#endif
+
@@ -18,6 +18,11 @@
 #include <stddef.h>
 #include <stdlib.h>
 
+// Mulabs:
+#include <mulabs_avr/utility/fixed_block_pool.h>
+
+
+#ifndef MULABS_AVR_CUSTOM_OPERATOR_NEW
 
 inline void*
 operator new (size_t size) noexcept
@@ -46,5 +51,43 @@ operator delete[] (void* pointer) noexcept
 	free (pointer);
 }
 
+#endif // MULABS_AVR_CUSTOM_OPERATOR_NEW
+
+
+/**
+ * Define operator new/delete that allocate from given BlockPools object instead of malloc().
+ * Use in exactly one translation unit and define MULABS_AVR_CUSTOM_OPERATOR_NEW for the whole program,
+ * so that the inline malloc()-based operators above are not defined. Eg.:
+ *
+ *   mulabs::avr::BlockPools<FixedBlockPool<8, 32>, FixedBlockPool<32, 8>> pools;
+ *   MULABS_AVR_OPERATOR_NEW_FROM_POOLS (pools)
+ *
+ * Allocations that don't fit any pool return nullptr.
+ */
+#define MULABS_AVR_OPERATOR_NEW_FROM_POOLS(pools)			\
+	void*													\
+	operator new (size_t size) noexcept						\
+	{														\
+		return (pools).allocate (size);						\
+	}														\
+															\
+	void*													\
+	operator new[] (size_t size) noexcept					\
+	{														\
+		return (pools).allocate (size);						\
+	}														\
+															\
+	void													\
+	operator delete (void* pointer) noexcept				\
+	{														\
+		(pools).deallocate (pointer);						\
+	}														\
+															\
+	void													\
+	operator delete[] (void* pointer) noexcept				\
+	{														\
+		(pools).deallocate (pointer);						\
+	}
+
 #endif
 
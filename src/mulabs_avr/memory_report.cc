@@ -0,0 +1,119 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifdef __AVR__
+
+// AVR:
+#include <avr/io.h>
+
+// Mulabs:
+#include <mulabs_avr/memory_report.h>
+
+
+// Symbols provided by the linker script and avr-libc:
+extern uint8_t __data_start;
+extern uint8_t __data_end;
+extern uint8_t __bss_start;
+extern uint8_t __bss_end;
+extern uint8_t __heap_start;
+extern uint8_t __stack;
+// Set by malloc(). Weak, so that programs which don't use malloc() don't pull it in:
+extern uint8_t* __brkval __attribute__((weak));
+
+
+/**
+ * Paint everything from the end of .bss up to the top of the stack with kStackPaintPattern.
+ * Runs in .init1, before the stack pointer is set up and before .data/.bss initialization, so it must not use
+ * the stack nor assume r1 == 0.
+ */
+extern "C" void
+mulabs_avr_paint_stack() __attribute__((naked, used, section (".init1")));
+
+static_assert (mulabs::avr::kStackPaintPattern == 0xc5, "update mulabs_avr_paint_stack()");
+
+
+extern "C" void
+mulabs_avr_paint_stack()
+{
+	asm volatile (
+		"	ldi		r30, lo8(__heap_start)		\n"
+		"	ldi		r31, hi8(__heap_start)		\n"
+		"	ldi		r24, 0xc5					\n" // kStackPaintPattern
+		"	ldi		r25, hi8(__stack)			\n"
+		"	rjmp	2f							\n"
+		"1:	st		Z+, r24						\n"
+		"2:	cpi		r30, lo8(__stack)			\n"
+		"	cpc		r31, r25					\n"
+		"	brlo	1b							\n"
+		"	breq	1b							\n"
+	);
+}
+
+
+namespace mulabs {
+namespace avr {
+
+namespace {
+
+uint8_t*
+heap_end()
+{
+	if (&__brkval && __brkval)
+		return __brkval;
+	else
+		return &__heap_start;
+}
+
+} // namespace
+
+
+MemoryReport
+memory_report()
+{
+	uint8_t* const stack_top = &__stack;
+	uint8_t* const sp = reinterpret_cast<uint8_t*> (SP);
+	uint8_t* const free_start = heap_end();
+
+	uint8_t* lowest_touched = free_start;
+
+	while (lowest_touched < sp && *lowest_touched == kStackPaintPattern)
+		++lowest_touched;
+
+	MemoryReport report;
+	report.data_size = &__data_end - &__data_start;
+	report.bss_size = &__bss_end - &__bss_start;
+	report.heap_size = free_start - &__heap_start;
+	report.stack_size = stack_top - sp;
+	report.stack_high_water = stack_top - lowest_touched + 1;
+	report.never_used = lowest_touched - free_start;
+	return report;
+}
+
+
+bool
+stack_canary_intact()
+{
+	uint8_t const* canary = heap_end();
+
+	for (size_t i = 0; i < kStackCanarySize; ++i)
+		if (canary[i] != kStackPaintPattern)
+			return false;
+
+	return true;
+}
+
+} // namespace avr
+} // namespace mulabs
+
+#endif // __AVR__
+
@@ -0,0 +1,82 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__MEMORY_REPORT_H__INCLUDED
+#define MULABS_AVR__MEMORY_REPORT_H__INCLUDED
+
+// Standard:
+#include <stddef.h>
+#include <stdint.h>
+
+
+namespace mulabs {
+namespace avr {
+
+/**
+ * Byte pattern written over free SRAM at startup (see memory_report.cc).
+ * Stack usage is measured by finding the lowest address where this pattern was overwritten.
+ */
+static constexpr uint8_t kStackPaintPattern = 0xc5;
+
+/**
+ * Number of bytes right above the heap that are checked by stack_canary_intact().
+ */
+static constexpr size_t kStackCanarySize = 16;
+
+
+/**
+ * SRAM usage, all values in bytes.
+ */
+struct MemoryReport
+{
+	size_t	data_size;			// Size of the .data section.
+	size_t	bss_size;			// Size of the .bss section.
+	size_t	heap_size;			// Memory taken from the heap by malloc() (and so by memory.h's operator new).
+	size_t	stack_size;			// Current stack usage.
+	size_t	stack_high_water;	// Maximum stack usage since startup.
+	size_t	never_used;			// Bytes between heap and deepest stack point that were never touched.
+};
+
+
+/**
+ * Gather memory statistics. Requires the stack painting done at startup by memory_report.cc.
+ * Finding the stack high-water mark scans the free memory, so it's not meant to be called often.
+ */
+MemoryReport
+memory_report();
+
+
+/**
+ * Return false if stack has grown into the guard zone of kStackCanarySize bytes right above the heap.
+ * Cheap enough to be called periodically, eg. from the main loop.
+ */
+bool
+stack_canary_intact();
+
+
+/**
+ * Call handler if stack_canary_intact() returns false.
+ */
+template<class Handler>
+	inline void
+	check_stack_canary (Handler&& handler)
+	{
+		if (!stack_canary_intact())
+			handler();
+	}
+
+} // namespace avr
+} // namespace mulabs
+
+#endif
+
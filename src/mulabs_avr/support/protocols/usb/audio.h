@@ -0,0 +1,450 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__SUPPORT__PROTOCOLS__AUDIO_H__INCLUDED
+#define MULABS_AVR__SUPPORT__PROTOCOLS__AUDIO_H__INCLUDED
+
+// Standard:
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Mulabs:
+#include <mulabs_avr/std/algorithm.h>
+#include <mulabs_avr/support/protocols/usb/device_definition.h>
+#include <mulabs_avr/support/protocols/usb/setup_packet.h>
+#include <mulabs_avr/utility/array.h>
+#include <mulabs_avr/utility/span.h>
+#include <mulabs_avr/utility/spsc_ring.h>
+
+
+namespace mulabs {
+namespace avr {
+namespace usb {
+namespace audio {
+
+constexpr DeviceSubClass	kAudioControlSubClass	{ 0x01 };
+constexpr DeviceSubClass	kAudioStreamingSubClass	{ 0x02 };
+
+// Terminal IDs used in the microphone topology:
+constexpr uint8_t			kInputTerminalID		= 1;
+constexpr uint8_t			kOutputTerminalID		= 2;
+
+
+namespace detail {
+
+template<uint8_t pStreamingInterface, uint8_t pChannels>
+	constexpr uint8_t kMicrophoneControlDescriptors[] = {
+		// Class-specific AC interface header, ADC 1.00, wTotalLength = 9 + 12 + 9:
+		0x09, 0x24, 0x01, 0x00, 0x01, 30, 0, 1, pStreamingInterface,
+		// Input terminal, microphone (0x0201):
+		0x0c, 0x24, 0x02, kInputTerminalID, 0x01, 0x02, 0x00, pChannels, 0x00, 0x00, 0x00, 0x00,
+		// Output terminal, USB streaming (0x0101), source is the input terminal:
+		0x09, 0x24, 0x03, kOutputTerminalID, 0x01, 0x01, 0x00, kInputTerminalID, 0x00,
+	};
+
+template<uint32_t pSampleRate, uint8_t pChannels, uint8_t pBytesPerSample>
+	constexpr uint8_t kStreamingDescriptors[] = {
+		// Class-specific AS general descriptor, linked to the output terminal, 1 frame delay, PCM format:
+		0x07, 0x24, 0x01, kOutputTerminalID, 0x01, 0x01, 0x00,
+		// Type I format descriptor with a single sample rate:
+		0x0b, 0x24, 0x02, 0x01, pChannels, pBytesPerSample, 8 * pBytesPerSample, 1,
+		static_cast<uint8_t> (pSampleRate >> 0), static_cast<uint8_t> (pSampleRate >> 8), static_cast<uint8_t> (pSampleRate >> 16),
+	};
+
+constexpr uint8_t kEndpointDescriptors[] = {
+	// Class-specific isochronous audio data endpoint descriptor, no controls:
+	0x07, 0x25, 0x01, 0x00, 0x00, 0x00, 0x00,
+};
+
+} // namespace detail
+
+
+/**
+ * Return class-specific descriptors of the AudioControl interface of a microphone:
+ * input terminal (microphone) connected to output terminal (USB streaming).
+ */
+template<uint8_t pStreamingInterface, uint8_t pChannels = 1>
+	constexpr ClassDescriptors
+	microphone_control_descriptors()
+	{
+		return ClassDescriptors (detail::kMicrophoneControlDescriptors<pStreamingInterface, pChannels>);
+	}
+
+
+/**
+ * Return class-specific descriptors of the AudioStreaming interface (operational alternate setting)
+ * for PCM data with given format.
+ */
+template<uint32_t pSampleRate, uint8_t pChannels = 1, uint8_t pBytesPerSample = 2>
+	constexpr ClassDescriptors
+	streaming_descriptors()
+	{
+		static_assert (pSampleRate < (1ul << 24), "sample rate must fit in 3 bytes");
+
+		return ClassDescriptors (detail::kStreamingDescriptors<pSampleRate, pChannels, pBytesPerSample>);
+	}
+
+
+/**
+ * Return class-specific descriptors of the isochronous data endpoint.
+ */
+constexpr ClassDescriptors
+endpoint_descriptors()
+{
+	return ClassDescriptors (detail::kEndpointDescriptors);
+}
+
+} // namespace audio
+
+
+namespace detail {
+
+/**
+ * Return SIE buffer-size setting for isochronous endpoint that can hold given number of bytes.
+ */
+template<class pEndpoint, size_t pBytes>
+	constexpr typename pEndpoint::IsochronousBufferSize
+	isochronous_buffer_size()
+	{
+		using Size = typename pEndpoint::IsochronousBufferSize;
+
+		static_assert (pBytes <= 1023, "isochronous packet can't be longer than 1023 bytes");
+
+		if constexpr (pBytes <= 8)
+			return Size::_8;
+		else if constexpr (pBytes <= 16)
+			return Size::_16;
+		else if constexpr (pBytes <= 32)
+			return Size::_32;
+		else if constexpr (pBytes <= 64)
+			return Size::_64;
+		else if constexpr (pBytes <= 128)
+			return Size::_128;
+		else if constexpr (pBytes <= 256)
+			return Size::_256;
+		else if constexpr (pBytes <= 512)
+			return Size::_512;
+		else
+			return Size::_1023;
+	}
+
+} // namespace detail
+
+
+/**
+ * USB Audio Class 1.0 microphone: streams PCM samples over an isochronous IN endpoint.
+ *
+ * Samples are pushed into a lock-free ring (eg. from ADC interrupt handler) with push(). On each SOF
+ * handle_start_of_frame() moves one frame's worth of samples from the ring into the free ping-pong bank of the
+ * endpoint, so there's always a packet ready for the host's next IN token. Sample clock is independent from USB
+ * frames (asynchronous endpoint), so packet size is adjusted to the ring level: nominally sample_rate/1000 samples
+ * (with fractional rates spread over frames), one more if the ring is filling up, one less if it's draining.
+ *
+ * Streaming starts when host selects alternate setting 1 of the streaming interface and stops on alternate setting 0.
+ *
+ * Device definition for a 16 kHz mono microphone:
+ *   usb::Interface (usb::Index (0), usb::AlternateIndex (0), usb::DeviceClass::Audio, usb::audio::kAudioControlSubClass,
+ *                   usb::DeviceProtocol (0), u"Control", usb::audio::microphone_control_descriptors<1>(), { }),
+ *   usb::Interface (usb::Index (1), usb::AlternateIndex (0), usb::DeviceClass::Audio, usb::audio::kAudioStreamingSubClass,
+ *                   usb::DeviceProtocol (0), u"Idle", { }),
+ *   usb::Interface (usb::Index (1), usb::AlternateIndex (1), usb::DeviceClass::Audio, usb::audio::kAudioStreamingSubClass,
+ *                   usb::DeviceProtocol (0), u"Stream", usb::audio::streaming_descriptors<16000>(), {
+ *       usb::Endpoint (usb::Index (1), usb::Direction::In, usb::TransferType::Isochronous, usb::SyncType::Async, usb::UsageType::Data,
+ *                      usb::MaxPacketSize (Microphone::kMaxPacketSize), usb::Interval (1),
+ *                      usb::AudioEndpoint (true), usb::audio::endpoint_descriptors(),
+ *                      usb::EndpointBuffer::ExternalPingPong),
+ *   }),
+ *
+ * \param	pSample
+ *			Sample type (eg. int16_t). For multiple channels, samples are interleaved.
+ * \param	pRingSize
+ *			Capacity of the sample ring in samples. Must hold at least two packets.
+ */
+template<class pInputEndpoint, uint32_t pSampleRate, uint8_t pChannels = 1, class pSample = int16_t, size_t pRingSize = 128>
+	class Microphone
+	{
+	  public:
+		using InputEndpoint	= pInputEndpoint;
+		using Endpoint		= typename InputEndpoint::Endpoint;
+		using Bank			= typename Endpoint::Buffer;
+		using Sample		= pSample;
+
+		static constexpr uint32_t	kSampleRate				= pSampleRate;
+		static constexpr uint8_t	kChannels				= pChannels;
+		static constexpr size_t		kNominalFrames			= (kSampleRate + 999) / 1000;
+		static constexpr size_t		kMaxFramesPerPacket		= kNominalFrames + 1;
+		static constexpr size_t		kMaxPacketSize			= kMaxFramesPerPacket * kChannels * sizeof (Sample);
+		static constexpr size_t		kRingFrames				= pRingSize / kChannels;
+		// Ring level (in frames) that packet sizing tries to keep:
+		static constexpr size_t		kTargetLevel			= kRingFrames / 2;
+
+		static_assert (kMaxPacketSize <= 1023, "isochronous packet can't be longer than 1023 bytes");
+		static_assert (kRingFrames >= 2 * kMaxFramesPerPacket, "sample ring must hold at least two packets");
+
+	  public:
+		// Ctor
+		template<class EndpointsTable>
+			explicit constexpr
+			Microphone (EndpointsTable&, uint8_t streaming_interface, uint8_t endpoint);
+
+		// Copy ctor
+		Microphone (Microphone const&) = delete;
+
+		// Copy operator
+		Microphone const&
+		operator= (Microphone const&) = delete;
+
+		/**
+		 * Handle SET_INTERFACE/GET_INTERFACE for the streaming interface, register the driver with State::set_interface_handler()
+		 * for the streaming interface.
+		 * Return true if request was handled.
+		 */
+		template<class Transfer>
+			bool
+			handle_request (SetupPacket const&, Span<uint8_t> output_data, Transfer&);
+
+		/**
+		 * Prepare next packet. Call from the USB interrupt handler on each SOF.
+		 */
+		void
+		handle_start_of_frame();
+
+		/**
+		 * Queue a sample. Return false if ring is full and sample was dropped.
+		 * Call from one context only (eg. ADC interrupt handler).
+		 */
+		bool
+		push (Sample);
+
+		/**
+		 * Return true if host is streaming (selected the operational alternate setting).
+		 */
+		bool
+		streaming() const;
+
+	  private:
+		void
+		start();
+
+		void
+		stop();
+
+		/**
+		 * Return number of frames to send in next packet.
+		 */
+		size_t
+		next_packet_frames();
+
+		InputEndpoint&
+		descriptor (uint8_t bank);
+
+	  private:
+		InputEndpoint							_bank_0;
+		InputEndpoint							_bank_1;
+		Array<Array<uint8_t, kMaxPacketSize>, 2>	_banks;
+		SpscRing<Sample, pRingSize>				_ring;
+		uint8_t									_interface;
+		uint8_t									_alternate_index	{ 0 };
+		uint8_t									_fill_bank			{ 0 };
+		uint16_t								_rate_accumulator	{ 0 };
+		bool									_primed				{ false };
+	};
+
+
+template<class IE, uint32_t R, uint8_t C, class S, size_t N>
+	template<class EndpointsTable>
+		constexpr
+		Microphone<IE, R, C, S, N>::Microphone (EndpointsTable& table, uint8_t streaming_interface, uint8_t endpoint):
+			_bank_0 (table.nth_input (endpoint)),
+			_bank_1 (table.nth_output (endpoint)),
+			_interface (streaming_interface)
+		{ }
+
+
+template<class IE, uint32_t R, uint8_t C, class S, size_t N>
+	template<class Transfer>
+		inline bool
+		Microphone<IE, R, C, S, N>::handle_request (SetupPacket const& setup, Span<uint8_t>, Transfer& transfer)
+		{
+			if (setup.type != SetupPacket::Type::Standard)
+				return false;
+
+			if (setup.recipient == SetupPacket::Recipient::Device &&
+				setup.request.device.type == SetupPacket::DeviceRequest::Type::SetConfiguration)
+			{
+				// Configuration starts with all interfaces in alternate setting 0; let the standard handling take place too:
+				stop();
+				return false;
+			}
+
+			if (setup.recipient != SetupPacket::Recipient::Interface)
+				return false;
+
+			using Type = SetupPacket::InterfaceRequest::Type;
+
+			switch (setup.request.interface.type)
+			{
+				case Type::SetInterface:
+					if (setup.request.interface.set_interface.interface != _interface)
+						return false;
+
+					if (setup.request.interface.set_interface.alternate_index == 0)
+						stop();
+					else
+						start();
+					return true;
+
+				case Type::GetInterface:
+					if (setup.request.interface.get_interface.interface != _interface)
+						return false;
+
+					transfer.buffer()[0] = _alternate_index;
+					transfer.set_transfer_size (1);
+					return true;
+
+				default:
+					return false;
+			}
+		}
+
+
+template<class IE, uint32_t R, uint8_t C, class S, size_t N>
+	inline void
+	Microphone<IE, R, C, S, N>::handle_start_of_frame()
+	{
+		if (!streaming())
+			return;
+
+		// SIE sets NACK flag after the bank was sent. If it wasn't, host skipped a frame, keep the samples in the ring:
+		if (!_bank_0.is_nack_all (_fill_bank == 0 ? Bank::_0 : Bank::_1))
+			return;
+
+		size_t const samples = next_packet_frames() * kChannels;
+		uint8_t* target = _banks[_fill_bank].data();
+
+		// Ring data may wrap, so it can take two regions:
+		for (size_t remaining = samples; remaining > 0; )
+		{
+			auto const region = _ring.data_region();
+			size_t const n = std::min (region.size(), remaining);
+			memcpy (target, region.data(), n * sizeof (Sample));
+			_ring.commit_pop (n);
+			target += n * sizeof (Sample);
+			remaining -= n;
+		}
+
+		descriptor (_fill_bank).set_transaction_size (samples * sizeof (Sample));
+		_bank_0.set_ready (_fill_bank == 0 ? Bank::_0 : Bank::_1);
+		_fill_bank ^= 1;
+	}
+
+
+template<class IE, uint32_t R, uint8_t C, class S, size_t N>
+	inline bool
+	Microphone<IE, R, C, S, N>::push (Sample sample)
+	{
+		return _ring.push (sample);
+	}
+
+
+template<class IE, uint32_t R, uint8_t C, class S, size_t N>
+	inline bool
+	Microphone<IE, R, C, S, N>::streaming() const
+	{
+		return _alternate_index != 0;
+	}
+
+
+template<class IE, uint32_t R, uint8_t C, class S, size_t N>
+	inline void
+	Microphone<IE, R, C, S, N>::start()
+	{
+		_alternate_index = 1;
+		_fill_bank = 0;
+		_rate_accumulator = 0;
+		_primed = false;
+		// Drop stale samples. Fine, since this is the consumer side:
+		_ring.clear();
+
+		_bank_1.initialize();
+		_bank_1.set_buffer (_banks[1].data());
+
+		_bank_0.initialize();
+		_bank_0.set (Endpoint::Type::Isochronous);
+		_bank_0.set_buffer (_banks[0].data(), detail::isochronous_buffer_size<Endpoint, kMaxPacketSize>());
+		_bank_0.set_ping_pong_enabled (true);
+		_bank_0.set_azlp_enabled (false);
+		_bank_0.set_nack_all (Bank::_0, true);
+		_bank_0.set_nack_all (Bank::_1, true);
+	}
+
+
+template<class IE, uint32_t R, uint8_t C, class S, size_t N>
+	inline void
+	Microphone<IE, R, C, S, N>::stop()
+	{
+		_alternate_index = 0;
+		_bank_0.set (Endpoint::Type::Disabled);
+	}
+
+
+template<class IE, uint32_t R, uint8_t C, class S, size_t N>
+	inline size_t
+	Microphone<IE, R, C, S, N>::next_packet_frames()
+	{
+		// Nominal number of frames, with the fractional part accumulated over SOFs (eg. 44.1 kHz gives nine
+		// 44-frame packets and one 45-frame packet):
+		_rate_accumulator += kSampleRate % 1000;
+		size_t frames = kSampleRate / 1000;
+
+		if (_rate_accumulator >= 1000)
+		{
+			_rate_accumulator -= 1000;
+			++frames;
+		}
+
+		size_t const level = _ring.size() / kChannels;
+
+		// Send empty packets until the ring fills up to the target level, so that there's room for adjustments:
+		if (!_primed)
+		{
+			if (level < kTargetLevel)
+				return 0;
+
+			_primed = true;
+		}
+
+		// Sample clock runs a bit faster or slower than USB frames; keep the ring level near the target:
+		if (level > kTargetLevel + kNominalFrames)
+			++frames;
+		else if (level + kNominalFrames < kTargetLevel && frames > 0)
+			--frames;
+
+		return std::min (frames, level);
+	}
+
+
+template<class IE, uint32_t R, uint8_t C, class S, size_t N>
+	inline auto
+	Microphone<IE, R, C, S, N>::descriptor (uint8_t bank) -> InputEndpoint&
+	{
+		return bank == 0 ? _bank_0 : _bank_1;
+	}
+
+} // namespace usb
+} // namespace avr
+} // namespace mulabs
+
+#endif
+
@@ -0,0 +1,461 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__SUPPORT__PROTOCOLS__BULK_ENDPOINT_H__INCLUDED
+#define MULABS_AVR__SUPPORT__PROTOCOLS__BULK_ENDPOINT_H__INCLUDED
+
+// Standard:
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Mulabs:
+#include <mulabs_avr/std/algorithm.h>
+#include <mulabs_avr/utility/array.h>
+#include <mulabs_avr/utility/span.h>
+
+
+namespace mulabs {
+namespace avr {
+namespace usb {
+
+namespace detail {
+
+/**
+ * Return SIE buffer-size setting for given bulk packet size.
+ */
+template<class pEndpoint, size_t pPacketSize>
+	constexpr typename pEndpoint::ControlBulkBufferSize
+	bulk_buffer_size()
+	{
+		using Size = typename pEndpoint::ControlBulkBufferSize;
+
+		static_assert (pPacketSize == 8 || pPacketSize == 16 || pPacketSize == 32 || pPacketSize == 64,
+					   "bulk packet size must be 8, 16, 32 or 64 bytes");
+
+		if constexpr (pPacketSize == 8)
+			return Size::_8;
+		else if constexpr (pPacketSize == 16)
+			return Size::_16;
+		else if constexpr (pPacketSize == 32)
+			return Size::_32;
+		else
+			return Size::_64;
+	}
+
+} // namespace detail
+
+
+/**
+ * Bulk IN endpoint with ping-pong (double) buffering and multipacket transfers.
+ *
+ * Ping-pong operation uses the OUT endpoint of the same number as the second bank, so that endpoint can't be used
+ * for anything else. Each bank holds up to pBankSize bytes which the SIE sends by itself as a series of
+ * pPacketSize packets (multipacket), so the CPU is involved only once per bank, not once per packet, and can fill
+ * one bank while the SIE drains the other.
+ *
+ * Banks are held here, so define the endpoint with usb::EndpointBuffer::ExternalPingPong, so that State doesn't
+ * allocate buffers for it.
+ *
+ * All methods are non-blocking and should be called from a single context.
+ *
+ * Usage:
+ *   usb::BulkInput<MCU::USBSIE::InputEndpoint, 256> bulk_in (endpoints_table, 1);
+ *   bulk_in.initialize();
+ *   …
+ *   data.remove_prefix (bulk_in.write (data));
+ */
+template<class pInputEndpoint, size_t pBankSize, size_t pPacketSize = 64>
+	class BulkInput
+	{
+	  public:
+		using InputEndpoint	= pInputEndpoint;
+		using Endpoint		= typename InputEndpoint::Endpoint;
+		using Bank			= typename Endpoint::Buffer;
+
+		static constexpr size_t	kBankSize	= pBankSize;
+		static constexpr size_t	kPacketSize	= pPacketSize;
+
+		static_assert (kBankSize % kPacketSize == 0, "bank size must be a multiple of the packet size");
+		static_assert (kBankSize <= 1023, "SIE can't handle multipacket transfers longer than 1023 bytes");
+
+	  public:
+		// Ctor
+		template<class EndpointsTable>
+			explicit constexpr
+			BulkInput (EndpointsTable&, uint8_t endpoint_index);
+
+		// Copy ctor
+		BulkInput (BulkInput const&) = delete;
+
+		// Copy operator
+		BulkInput const&
+		operator= (BulkInput const&) = delete;
+
+		/**
+		 * Configure the endpoint. Call when device gets configured.
+		 */
+		void
+		initialize();
+
+		/**
+		 * Copy as much data as possible into free banks. Full banks are handed over to the SIE immediately, partially
+		 * filled one waits for more data or flush(). Return number of bytes taken.
+		 */
+		size_t
+		write (Span<uint8_t const>);
+
+		/**
+		 * Send partially filled bank now.
+		 */
+		void
+		flush();
+
+		/**
+		 * Return true if all data written so far was sent to host.
+		 */
+		bool
+		flushed() const;
+
+		/**
+		 * Return number of bytes in the partially filled bank, waiting for more data or flush().
+		 */
+		size_t
+		pending() const;
+
+	  private:
+		/**
+		 * Return true if given bank is owned by the CPU (was sent or was never given to the SIE).
+		 */
+		bool
+		bank_free (uint8_t bank) const;
+
+		/**
+		 * Hand the bank being filled to the SIE and start filling the other one.
+		 */
+		void
+		commit();
+
+		InputEndpoint&
+		descriptor (uint8_t bank);
+
+	  private:
+		InputEndpoint							_bank_0;
+		InputEndpoint							_bank_1;
+		Array<Array<uint8_t, kBankSize>, 2>		_buffers;
+		uint8_t									_fill_bank	{ 0 };
+		size_t									_fill_size	{ 0 };
+	};
+
+
+/**
+ * Bulk OUT endpoint with ping-pong (double) buffering and multipacket transfers.
+ * See BulkInput. A bank is ready when it's full or when host sent a short packet.
+ *
+ * Usage:
+ *   usb::BulkOutput<MCU::USBSIE::OutputEndpoint, 256> bulk_out (endpoints_table, 2);
+ *   bulk_out.initialize();
+ *   …
+ *   size_t const received = bulk_out.read (buffer);
+ */
+template<class pOutputEndpoint, size_t pBankSize, size_t pPacketSize = 64>
+	class BulkOutput
+	{
+	  public:
+		using OutputEndpoint	= pOutputEndpoint;
+		using Endpoint			= typename OutputEndpoint::Endpoint;
+		using Bank				= typename Endpoint::Buffer;
+
+		static constexpr size_t	kBankSize	= pBankSize;
+		static constexpr size_t	kPacketSize	= pPacketSize;
+
+		static_assert (kBankSize % kPacketSize == 0, "bank size must be a multiple of the packet size");
+		static_assert (kBankSize <= 1023, "SIE can't handle multipacket transfers longer than 1023 bytes");
+
+	  public:
+		// Ctor
+		template<class EndpointsTable>
+			explicit constexpr
+			BulkOutput (EndpointsTable&, uint8_t endpoint_index);
+
+		// Copy ctor
+		BulkOutput (BulkOutput const&) = delete;
+
+		// Copy operator
+		BulkOutput const&
+		operator= (BulkOutput const&) = delete;
+
+		/**
+		 * Configure the endpoint and make both banks ready for receiving. Call when device gets configured.
+		 */
+		void
+		initialize();
+
+		/**
+		 * Copy received data into the target buffer. Banks that are completely read are given back to the SIE.
+		 * Return number of bytes copied.
+		 */
+		size_t
+		read (Span<uint8_t>);
+
+		/**
+		 * Return number of bytes that can be read without waiting for the host (in the current bank only).
+		 */
+		size_t
+		available() const;
+
+	  private:
+		/**
+		 * Return true if given bank has received data.
+		 */
+		bool
+		bank_filled (uint8_t bank) const;
+
+		/**
+		 * Make the bank ready for receiving again.
+		 */
+		void
+		rearm (uint8_t bank);
+
+		OutputEndpoint&
+		descriptor (uint8_t bank);
+
+		OutputEndpoint const&
+		descriptor (uint8_t bank) const;
+
+	  private:
+		OutputEndpoint							_bank_0;
+		OutputEndpoint							_bank_1;
+		Array<Array<uint8_t, kBankSize>, 2>		_buffers;
+		uint8_t									_read_bank		{ 0 };
+		size_t									_read_position	{ 0 };
+	};
+
+
+template<class IE, size_t B, size_t P>
+	template<class EndpointsTable>
+		constexpr
+		BulkInput<IE, B, P>::BulkInput (EndpointsTable& table, uint8_t endpoint_index):
+			_bank_0 (table.nth_input (endpoint_index)),
+			_bank_1 (table.nth_output (endpoint_index))
+		{ }
+
+
+template<class IE, size_t B, size_t P>
+	inline void
+	BulkInput<IE, B, P>::initialize()
+	{
+		_fill_bank = 0;
+		_fill_size = 0;
+
+		_bank_1.initialize();
+		_bank_1.set_buffer (_buffers[1].data());
+
+		_bank_0.initialize();
+		_bank_0.set (Endpoint::Type::Bulk);
+		_bank_0.set_buffer (_buffers[0].data(), detail::bulk_buffer_size<Endpoint, kPacketSize>());
+		_bank_0.set_multipacket_enabled (true);
+		_bank_0.set_ping_pong_enabled (true);
+		_bank_0.set_azlp_enabled (false);
+		// Both banks are owned by the CPU until filled:
+		_bank_0.set_nack_all (Bank::_0, true);
+		_bank_0.set_nack_all (Bank::_1, true);
+	}
+
+
+template<class IE, size_t B, size_t P>
+	inline size_t
+	BulkInput<IE, B, P>::write (Span<uint8_t const> data)
+	{
+		size_t written = 0;
+
+		while (!data.empty() && bank_free (_fill_bank))
+		{
+			size_t const n = std::min (kBankSize - _fill_size, data.size());
+			memcpy (_buffers[_fill_bank].data() + _fill_size, data.data(), n);
+			_fill_size += n;
+			data.remove_prefix (n);
+			written += n;
+
+			if (_fill_size == kBankSize)
+				commit();
+		}
+
+		return written;
+	}
+
+
+template<class IE, size_t B, size_t P>
+	inline void
+	BulkInput<IE, B, P>::flush()
+	{
+		if (_fill_size > 0)
+			commit();
+	}
+
+
+template<class IE, size_t B, size_t P>
+	inline bool
+	BulkInput<IE, B, P>::flushed() const
+	{
+		return _fill_size == 0 && bank_free (0) && bank_free (1);
+	}
+
+
+template<class IE, size_t B, size_t P>
+	inline size_t
+	BulkInput<IE, B, P>::pending() const
+	{
+		return _fill_size;
+	}
+
+
+template<class IE, size_t B, size_t P>
+	inline bool
+	BulkInput<IE, B, P>::bank_free (uint8_t bank) const
+	{
+		// SIE sets NACK flag after the bank was sent:
+		return _bank_0.is_nack_all (bank == 0 ? Bank::_0 : Bank::_1);
+	}
+
+
+template<class IE, size_t B, size_t P>
+	inline void
+	BulkInput<IE, B, P>::commit()
+	{
+		auto& bank_descriptor = descriptor (_fill_bank);
+		bank_descriptor.reset_total_transfer_size();
+		bank_descriptor.set_transaction_size (_fill_size);
+		_bank_0.set_ready (_fill_bank == 0 ? Bank::_0 : Bank::_1);
+
+		_fill_bank ^= 1;
+		_fill_size = 0;
+	}
+
+
+template<class IE, size_t B, size_t P>
+	inline auto
+	BulkInput<IE, B, P>::descriptor (uint8_t bank) -> InputEndpoint&
+	{
+		return bank == 0 ? _bank_0 : _bank_1;
+	}
+
+
+template<class OE, size_t B, size_t P>
+	template<class EndpointsTable>
+		constexpr
+		BulkOutput<OE, B, P>::BulkOutput (EndpointsTable& table, uint8_t endpoint_index):
+			_bank_0 (table.nth_output (endpoint_index)),
+			_bank_1 (table.nth_input (endpoint_index))
+		{ }
+
+
+template<class OE, size_t B, size_t P>
+	inline void
+	BulkOutput<OE, B, P>::initialize()
+	{
+		_read_bank = 0;
+		_read_position = 0;
+
+		_bank_1.initialize();
+		_bank_1.set_buffer (_buffers[1].data());
+
+		_bank_0.initialize();
+		_bank_0.set (Endpoint::Type::Bulk);
+		_bank_0.set_buffer (_buffers[0].data(), detail::bulk_buffer_size<Endpoint, kPacketSize>());
+		_bank_0.set_multipacket_enabled (true);
+		_bank_0.set_ping_pong_enabled (true);
+
+		rearm (0);
+		rearm (1);
+	}
+
+
+template<class OE, size_t B, size_t P>
+	inline size_t
+	BulkOutput<OE, B, P>::read (Span<uint8_t> target)
+	{
+		size_t copied = 0;
+
+		while (!target.empty() && bank_filled (_read_bank))
+		{
+			size_t const bank_size = descriptor (_read_bank).transaction_size();
+			size_t const n = std::min (bank_size - _read_position, target.size());
+			memcpy (target.data(), _buffers[_read_bank].data() + _read_position, n);
+			_read_position += n;
+			target.remove_prefix (n);
+			copied += n;
+
+			if (_read_position == bank_size)
+			{
+				rearm (_read_bank);
+				_read_bank ^= 1;
+				_read_position = 0;
+			}
+		}
+
+		return copied;
+	}
+
+
+template<class OE, size_t B, size_t P>
+	inline size_t
+	BulkOutput<OE, B, P>::available() const
+	{
+		if (bank_filled (_read_bank))
+			return descriptor (_read_bank).transaction_size() - _read_position;
+		else
+			return 0;
+	}
+
+
+template<class OE, size_t B, size_t P>
+	inline bool
+	BulkOutput<OE, B, P>::bank_filled (uint8_t bank) const
+	{
+		return _bank_0.transaction_complete (bank == 0 ? Bank::_0 : Bank::_1);
+	}
+
+
+template<class OE, size_t B, size_t P>
+	inline void
+	BulkOutput<OE, B, P>::rearm (uint8_t bank)
+	{
+		auto& bank_descriptor = descriptor (bank);
+		bank_descriptor.reset_transaction_size();
+		bank_descriptor.set_total_transfer_size (kBankSize);
+		_bank_0.set_ready (bank == 0 ? Bank::_0 : Bank::_1);
+	}
+
+
+template<class OE, size_t B, size_t P>
+	inline auto
+	BulkOutput<OE, B, P>::descriptor (uint8_t bank) -> OutputEndpoint&
+	{
+		return bank == 0 ? _bank_0 : _bank_1;
+	}
+
+
+template<class OE, size_t B, size_t P>
+	inline auto
+	BulkOutput<OE, B, P>::descriptor (uint8_t bank) const -> OutputEndpoint const&
+	{
+		return bank == 0 ? _bank_0 : _bank_1;
+	}
+
+} // namespace usb
+} // namespace avr
+} // namespace mulabs
+
+#endif
+
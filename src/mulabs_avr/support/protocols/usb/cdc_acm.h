@@ -0,0 +1,576 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__SUPPORT__PROTOCOLS__CDC_ACM_H__INCLUDED
+#define MULABS_AVR__SUPPORT__PROTOCOLS__CDC_ACM_H__INCLUDED
+
+// Standard:
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Mulabs:
+#include <mulabs_avr/support/protocols/usb/bulk_endpoint.h>
+#include <mulabs_avr/support/protocols/usb/device_definition.h>
+#include <mulabs_avr/support/protocols/usb/setup_packet.h>
+#include <mulabs_avr/utility/array.h>
+#include <mulabs_avr/utility/span.h>
+#include <mulabs_avr/utility/spsc_ring.h>
+
+
+namespace mulabs {
+namespace avr {
+namespace usb {
+namespace cdc {
+
+/**
+ * Subclass code of the Abstract Control Model communication interface.
+ */
+constexpr DeviceSubClass	kACMSubClass	{ 0x02 };
+
+/**
+ * Class-specific requests used by ACM.
+ */
+enum class Request: uint8_t
+{
+	SendEncapsulatedCommand	= 0x00,
+	GetEncapsulatedResponse	= 0x01,
+	SetLineCoding			= 0x20,
+	GetLineCoding			= 0x21,
+	SetControlLineState		= 0x22,
+	SendBreak				= 0x23,
+};
+
+/**
+ * Bits of the SET_CONTROL_LINE_STATE value.
+ */
+enum ControlLine: uint16_t
+{
+	DTR						= 1u << 0,
+	RTS						= 1u << 1,
+};
+
+/**
+ * Bits of the SERIAL_STATE notification.
+ */
+enum SerialState: uint16_t
+{
+	DCD						= 1u << 0,
+	DSR						= 1u << 1,
+	Break					= 1u << 2,
+	Ring					= 1u << 3,
+	FramingError			= 1u << 4,
+	ParityError				= 1u << 5,
+	Overrun					= 1u << 6,
+};
+
+
+/**
+ * Data of the SET_LINE_CODING/GET_LINE_CODING requests.
+ */
+struct LineCoding
+{
+	uint32_t	baud_rate	= 115200;
+	uint8_t		stop_bits	= 0;	// 0 - 1 bit, 1 - 1.5 bits, 2 - 2 bits.
+	uint8_t		parity		= 0;	// 0 - none, 1 - odd, 2 - even, 3 - mark, 4 - space.
+	uint8_t		data_bits	= 8;
+} __attribute__((packed));
+
+static_assert (sizeof (LineCoding) == 7);
+
+
+/**
+ * SERIAL_STATE notification sent over the notification endpoint.
+ */
+struct SerialStateNotification
+{
+	uint8_t		request_type	= 0xa1;	// Class request, device-to-host, recipient interface.
+	uint8_t		notification	= 0x20;	// SERIAL_STATE.
+	uint16_t	value			= 0;
+	uint16_t	interface		= 0;
+	uint16_t	length			= 2;
+	uint16_t	state			= 0;
+} __attribute__((packed));
+
+static_assert (sizeof (SerialStateNotification) == 10);
+
+
+namespace detail {
+
+template<uint8_t pCommunicationInterface, uint8_t pDataInterface>
+	constexpr uint8_t kFunctionalDescriptors[] = {
+		// Header functional descriptor, CDC 1.10:
+		0x05, 0x24, 0x00, 0x10, 0x01,
+		// Call management functional descriptor, device doesn't handle call management:
+		0x05, 0x24, 0x01, 0x00, pDataInterface,
+		// ACM functional descriptor, supports SET_LINE_CODING, GET_LINE_CODING, SET_CONTROL_LINE_STATE and SERIAL_STATE:
+		0x04, 0x24, 0x02, 0x02,
+		// Union functional descriptor:
+		0x05, 0x24, 0x06, pCommunicationInterface, pDataInterface,
+	};
+
+} // namespace detail
+
+
+/**
+ * Return CDC functional descriptors for the communication interface. Use as ClassDescriptors of that interface:
+ *
+ *   usb::Interface (usb::Index (0), usb::AlternateIndex (0), usb::DeviceClass::CDC, usb::cdc::kACMSubClass, usb::DeviceProtocol (0),
+ *                   u"Control", usb::cdc::functional_descriptors<0, 1>(), {
+ *       usb::Endpoint (usb::Index (1), usb::Direction::In, usb::TransferType::Interrupt, …, usb::Interval (16),
+ *                      usb::EndpointBuffer::External),
+ *   }),
+ *   usb::Interface (usb::Index (1), usb::AlternateIndex (0), usb::DeviceClass::CDCData, usb::DeviceSubClass (0), usb::DeviceProtocol (0),
+ *                   u"Data", {
+ *       usb::Endpoint (…, usb::MaxPacketSize (64), usb::Interval (0), usb::EndpointBuffer::ExternalPingPong),
+ *       usb::Endpoint (…, usb::MaxPacketSize (64), usb::Interval (0), usb::EndpointBuffer::ExternalPingPong),
+ *   }),
+ */
+template<uint8_t pCommunicationInterface, uint8_t pDataInterface>
+	constexpr ClassDescriptors
+	functional_descriptors()
+	{
+		return ClassDescriptors (detail::kFunctionalDescriptors<pCommunicationInterface, pDataInterface>);
+	}
+
+} // namespace cdc
+
+
+/**
+ * CDC-ACM (virtual serial port) class driver.
+ *
+ * Data path is split between two contexts by lock-free rings: the main loop calls write()/read(), the USB interrupt
+ * handler calls handle_interrupt()/handle_start_of_frame(), which move data between the rings and the ping-pong bulk
+ * endpoints (see BulkInput/BulkOutput). Small writes are batched into full packets; a partially filled packet is sent
+ * only after no new data came for set_flush_timeout() frames (SOFs), so the host sees mostly full packets.
+ *
+ * Ping-pong mode uses both directions of the bulk endpoints, so data IN, data OUT and notification endpoints must all
+ * have different numbers. All buffers are held here, so define the endpoints with external buffers (see
+ * functional_descriptors()).
+ *
+ * Register the driver for both interfaces, so that it can configure the endpoints again after SET_INTERFACE
+ * (SetupConductor disables them):
+ *   usb_state.set_interface_handler (0, cdc);
+ *   usb_state.set_interface_handler (1, cdc);
+ *
+ * and in the USB interrupt handler:
+ *   usb_state.handle_interrupt (trace);
+ *   cdc.handle_interrupt();
+ *   if (usb_sie.triggered (USBSIE::InterruptFlag::StartOfFrame))
+ *       cdc.handle_start_of_frame();
+ */
+template<class pInputEndpoint, class pOutputEndpoint, size_t pTxRingSize = 128, size_t pRxRingSize = 128, size_t pPacketSize = 64>
+	class CDCACM
+	{
+	  public:
+		using InputEndpoint		= pInputEndpoint;
+		using OutputEndpoint	= pOutputEndpoint;
+		using Endpoint			= typename InputEndpoint::Endpoint;
+
+		static constexpr size_t	kPacketSize	= pPacketSize;
+
+	  public:
+		// Ctor
+		template<class EndpointsTable>
+			explicit constexpr
+			CDCACM (EndpointsTable&, uint8_t communication_interface, uint8_t data_interface,
+					uint8_t notification_endpoint, uint8_t data_input_endpoint, uint8_t data_output_endpoint);
+
+		// Copy ctor
+		CDCACM (CDCACM const&) = delete;
+
+		// Copy operator
+		CDCACM const&
+		operator= (CDCACM const&) = delete;
+
+		/**
+		 * Configure the endpoints. Called automatically by handle_request() when host sets configuration,
+		 * can also be called manually.
+		 */
+		void
+		initialize();
+
+		/**
+		 * Return true after the endpoints were configured.
+		 */
+		bool
+		configured() const;
+
+		/**
+		 * Handle CDC class requests, register the driver with State::set_interface_handler() for the communication
+		 * and data interfaces. Return true if request was handled.
+		 */
+		template<class Transfer>
+			bool
+			handle_request (SetupPacket const&, Span<uint8_t> output_data, Transfer&);
+
+		/**
+		 * Move data between rings and endpoints. Call from the USB interrupt handler.
+		 */
+		void
+		handle_interrupt();
+
+		/**
+		 * Count frames for the TX flush timeout. Call from the USB interrupt handler on each SOF.
+		 */
+		void
+		handle_start_of_frame();
+
+		/**
+		 * Set number of frames (1 ms each) after which partially filled packet is sent.
+		 * 0 means sending it on next SOF.
+		 */
+		void
+		set_flush_timeout (uint8_t frames);
+
+		/**
+		 * Queue data for sending. Non-blocking, return number of bytes queued.
+		 * Call from the main loop.
+		 */
+		size_t
+		write (Span<uint8_t const>);
+
+		/**
+		 * Read received data. Non-blocking, return number of bytes read.
+		 * Call from the main loop.
+		 */
+		size_t
+		read (Span<uint8_t>);
+
+		/**
+		 * Send SERIAL_STATE notification if the notification endpoint is free.
+		 * Return false if previous notification hasn't been sent yet.
+		 */
+		bool
+		notify (uint16_t serial_state);
+
+		/**
+		 * Return line coding last set by host.
+		 */
+		cdc::LineCoding const&
+		line_coding() const;
+
+		/**
+		 * Return control lines state (cdc::ControlLine bits) last set by host.
+		 */
+		uint16_t
+		control_lines() const;
+
+		/**
+		 * Return true if host has opened the port (DTR is set).
+		 */
+		bool
+		dtr() const;
+
+	  private:
+		void
+		initialize_notification_endpoint();
+
+		void
+		initialize_data_endpoints();
+
+		void
+		pump_tx();
+
+		void
+		pump_rx();
+
+	  private:
+		InputEndpoint									_notification_endpoint;
+		Array<uint8_t, 16>								_notification_buffer;
+		BulkInput<InputEndpoint, kPacketSize, kPacketSize>
+														_data_input;
+		BulkOutput<OutputEndpoint, kPacketSize, kPacketSize>
+														_data_output;
+		SpscRing<uint8_t, pTxRingSize>					_tx_ring;
+		SpscRing<uint8_t, pRxRingSize>					_rx_ring;
+		cdc::LineCoding									_line_coding;
+		uint16_t										_control_lines		{ 0 };
+		uint8_t											_interface;
+		uint8_t											_data_interface;
+		uint8_t											_flush_timeout		{ 1 };
+		uint8_t											_idle_frames		{ 0 };
+		uint8_t											_last_pending		{ 0 };
+		bool											_configured			{ false };
+	};
+
+
+template<class IE, class OE, size_t T, size_t R, size_t P>
+	template<class EndpointsTable>
+		constexpr
+		CDCACM<IE, OE, T, R, P>::CDCACM (EndpointsTable& table, uint8_t communication_interface, uint8_t data_interface,
+										 uint8_t notification_endpoint, uint8_t data_input_endpoint, uint8_t data_output_endpoint):
+			_notification_endpoint (table.nth_input (notification_endpoint)),
+			_data_input (table, data_input_endpoint),
+			_data_output (table, data_output_endpoint),
+			_interface (communication_interface),
+			_data_interface (data_interface)
+		{ }
+
+
+template<class IE, class OE, size_t T, size_t R, size_t P>
+	inline void
+	CDCACM<IE, OE, T, R, P>::initialize()
+	{
+		initialize_notification_endpoint();
+		initialize_data_endpoints();
+		_configured = true;
+	}
+
+
+template<class IE, class OE, size_t T, size_t R, size_t P>
+	inline bool
+	CDCACM<IE, OE, T, R, P>::configured() const
+	{
+		return _configured;
+	}
+
+
+template<class IE, class OE, size_t T, size_t R, size_t P>
+	template<class Transfer>
+		inline bool
+		CDCACM<IE, OE, T, R, P>::handle_request (SetupPacket const& setup, Span<uint8_t> output_data, Transfer& transfer)
+		{
+			if (setup.type == SetupPacket::Type::Standard)
+			{
+				// Endpoints need to be configured, but let the standard handling take place too:
+				if (setup.recipient == SetupPacket::Recipient::Device &&
+					setup.request.device.type == SetupPacket::DeviceRequest::Type::SetConfiguration)
+				{
+					if (setup.request.device.set_configuration.configuration_value != 0)
+						initialize();
+					else
+						_configured = false;
+				}
+				// SET_INTERFACE disables the interface's endpoints, configure them again:
+				else if (_configured && setup.recipient == SetupPacket::Recipient::Interface &&
+						 setup.request.interface.type == SetupPacket::InterfaceRequest::Type::SetInterface)
+				{
+					if (setup.request.interface.set_interface.interface == _interface)
+						initialize_notification_endpoint();
+					else if (setup.request.interface.set_interface.interface == _data_interface)
+						initialize_data_endpoints();
+				}
+
+				return false;
+			}
+
+			if (setup.type != SetupPacket::Type::Class || setup.recipient != SetupPacket::Recipient::Interface ||
+				setup.request.class_request.index != _interface)
+			{
+				return false;
+			}
+
+			switch (static_cast<cdc::Request> (setup.request.class_request.type))
+			{
+				case cdc::Request::SetLineCoding:
+					if (output_data.size() < sizeof (cdc::LineCoding))
+						return false;
+
+					memcpy (&_line_coding, output_data.data(), sizeof (_line_coding));
+					return true;
+
+				case cdc::Request::GetLineCoding:
+					memcpy (transfer.buffer().data(), &_line_coding, sizeof (_line_coding));
+					transfer.set_transfer_size (sizeof (_line_coding));
+					return true;
+
+				case cdc::Request::SetControlLineState:
+					_control_lines = setup.request.class_request.value;
+					return true;
+
+				case cdc::Request::SendBreak:
+					return true;
+
+				default:
+					return false;
+			}
+		}
+
+
+template<class IE, class OE, size_t T, size_t R, size_t P>
+	inline void
+	CDCACM<IE, OE, T, R, P>::handle_interrupt()
+	{
+		if (!_configured)
+			return;
+
+		pump_tx();
+		pump_rx();
+	}
+
+
+template<class IE, class OE, size_t T, size_t R, size_t P>
+	inline void
+	CDCACM<IE, OE, T, R, P>::handle_start_of_frame()
+	{
+		if (!_configured)
+			return;
+
+		pump_rx();
+		pump_tx();
+
+		size_t const pending = _data_input.pending();
+
+		// Count frames in which the partially filled packet didn't grow:
+		if (pending == 0 || pending != _last_pending)
+			_idle_frames = 0;
+		else if (_idle_frames < _flush_timeout)
+			++_idle_frames;
+
+		if (pending > 0 && _idle_frames >= _flush_timeout)
+		{
+			_data_input.flush();
+			_idle_frames = 0;
+		}
+
+		_last_pending = _data_input.pending();
+	}
+
+
+template<class IE, class OE, size_t T, size_t R, size_t P>
+	inline void
+	CDCACM<IE, OE, T, R, P>::set_flush_timeout (uint8_t frames)
+	{
+		_flush_timeout = frames;
+	}
+
+
+template<class IE, class OE, size_t T, size_t R, size_t P>
+	inline size_t
+	CDCACM<IE, OE, T, R, P>::write (Span<uint8_t const> data)
+	{
+		return _tx_ring.push_span (data);
+	}
+
+
+template<class IE, class OE, size_t T, size_t R, size_t P>
+	inline size_t
+	CDCACM<IE, OE, T, R, P>::read (Span<uint8_t> data)
+	{
+		return _rx_ring.pop_span (data);
+	}
+
+
+template<class IE, class OE, size_t T, size_t R, size_t P>
+	inline bool
+	CDCACM<IE, OE, T, R, P>::notify (uint16_t serial_state)
+	{
+		if (!_configured || !_notification_endpoint.is_nack_all (Endpoint::Buffer::_0))
+			return false;
+
+		// Build the notification directly in the endpoint buffer:
+		auto& notification = _notification_buffer.template as<cdc::SerialStateNotification>();
+		notification = cdc::SerialStateNotification();
+		notification.interface = _interface;
+		notification.state = serial_state;
+		_notification_endpoint.set_ready (sizeof (notification));
+		return true;
+	}
+
+
+template<class IE, class OE, size_t T, size_t R, size_t P>
+	inline cdc::LineCoding const&
+	CDCACM<IE, OE, T, R, P>::line_coding() const
+	{
+		return _line_coding;
+	}
+
+
+template<class IE, class OE, size_t T, size_t R, size_t P>
+	inline uint16_t
+	CDCACM<IE, OE, T, R, P>::control_lines() const
+	{
+		return _control_lines;
+	}
+
+
+template<class IE, class OE, size_t T, size_t R, size_t P>
+	inline bool
+	CDCACM<IE, OE, T, R, P>::dtr() const
+	{
+		return _control_lines & cdc::ControlLine::DTR;
+	}
+
+
+template<class IE, class OE, size_t T, size_t R, size_t P>
+	inline void
+	CDCACM<IE, OE, T, R, P>::initialize_notification_endpoint()
+	{
+		_notification_endpoint.initialize();
+		// Interrupt endpoints are configured the same way as bulk ones:
+		_notification_endpoint.set (Endpoint::Type::Bulk);
+		_notification_endpoint.set_buffer (_notification_buffer.data(), Endpoint::ControlBulkBufferSize::_16);
+		_notification_endpoint.set_azlp_enabled (false);
+		_notification_endpoint.set_nack_all (Endpoint::Buffer::_0, true);
+	}
+
+
+template<class IE, class OE, size_t T, size_t R, size_t P>
+	inline void
+	CDCACM<IE, OE, T, R, P>::initialize_data_endpoints()
+	{
+		_data_input.initialize();
+		_data_output.initialize();
+		_idle_frames = 0;
+		_last_pending = 0;
+	}
+
+
+template<class IE, class OE, size_t T, size_t R, size_t P>
+	inline void
+	CDCACM<IE, OE, T, R, P>::pump_tx()
+	{
+		// Ring data may wrap, so it can take two regions:
+		for (int i = 0; i < 2; ++i)
+		{
+			auto const region = _tx_ring.data_region();
+
+			if (region.empty())
+				break;
+
+			size_t const taken = _data_input.write (region);
+			_tx_ring.commit_pop (taken);
+
+			if (taken < region.size())
+				break;
+		}
+	}
+
+
+template<class IE, class OE, size_t T, size_t R, size_t P>
+	inline void
+	CDCACM<IE, OE, T, R, P>::pump_rx()
+	{
+		// When the ring is full, data stays in the endpoint banks and the SIE NAKs the host until there's space:
+		for (int i = 0; i < 2; ++i)
+		{
+			auto region = _rx_ring.free_region();
+
+			if (region.empty())
+				break;
+
+			size_t const received = _data_output.read (region);
+			_rx_ring.commit_push (received);
+
+			if (received < region.size())
+				break;
+		}
+	}
+
+} // namespace usb
+} // namespace avr
+} // namespace mulabs
+
+#endif
+
@@ -15,6 +15,7 @@
 #define MULABS_AVR__SUPPORT__PROTOCOLS__CONTROL_TRANSFER_H__INCLUDED
 
 // Mulabs:
+#include <mulabs_avr/utility/flash_span.h>
 #include <mulabs_avr/utility/span.h>
 
 
@@ -23,14 +24,21 @@ namespace avr {
 namespace usb {
 
 /**
- * Handles and buffers control transfers (Setup packets and responses).
+ * Handles control transfers (Setup packets and responses).
  *
  * Has three main states:
  *   • waiting for Setup packet (initial state)
  *   • waiting for output transaction(s) to complete
  *   • waiting for input transaction(s) to complete
+ *
+ * Works directly on the endpoint buffers, there's no intermediate buffer: Setup packets are parsed where the SIE
+ * put them, OUT data is passed to the user as a Span over the OUT endpoint buffer, and short responses are written
+ * by the user directly into the IN endpoint buffer (see buffer()). Longer responses can be streamed from program
+ * memory (see set_transfer_data()), one endpoint buffer at a time.
+ *
+ * Because of that, OUT data stage can't be longer than a single packet.
  */
-template<class pInputEndpoint, class pInputBuffer, class pOutputEndpoint, class pOutputBuffer, size_t pSize>
+template<class pInputEndpoint, class pInputBuffer, class pOutputEndpoint, class pOutputBuffer>
 	class ControlTransfer
 	{
 	  public:
@@ -38,11 +46,9 @@ template<class pInputEndpoint, class pInputBuffer, class pOutputEndpoint, class
 		using InputBuffer				= pInputBuffer;
 		using OutputEndpoint			= pOutputEndpoint;
 		using OutputBuffer				= pOutputBuffer;
-		using Buffer					= Array<uint8_t, pSize>;
-
-		static constexpr size_t kSize	= pSize;
 
-		static_assert (kSize >= 8, "buffer size must be at least 8 bytes (for Setup packets)");
+		static_assert (InputBuffer::size() >= sizeof (SetupPacket), "IN buffer must be at least 8 bytes (for Setup packets)");
+		static_assert (OutputBuffer::size() >= sizeof (SetupPacket), "OUT buffer must be at least 8 bytes (for Setup packets)");
 
 		enum class Error
 		{
@@ -63,7 +69,6 @@ template<class pInputEndpoint, class pInputBuffer, class pOutputEndpoint, class
 
 		enum class NextOutputResult
 		{
-			More,
 			Finished,
 			Overflow,
 		};
@@ -77,17 +82,18 @@ template<class pInputEndpoint, class pInputBuffer, class pOutputEndpoint, class
 	  public:
 		// Ctor
 		explicit constexpr
-		ControlTransfer (InputEndpoint&, InputBuffer&, OutputEndpoint&, OutputBuffer&, Buffer&) noexcept;
+		ControlTransfer (InputEndpoint&, InputBuffer&, OutputEndpoint&, OutputBuffer&) noexcept;
 
 		/**
 		 * Check enpoints state, read buffers when necessary and update state of the transfer.
 		 *
-		 * \param	on_setup (Setup const&) -> bool
+		 * \param	on_setup (Setup const&, Span<uint8_t> output_data) -> bool
 		 *			Called when setup request is received.
-		 *			If a host-to-device request was received, then also OUT transaction was received and is buffered
-		 *			and ready to use. If on_setup returns true, ACK (ZLP) is sent to the host.
+		 *			If a host-to-device request was received, then also OUT transaction was received and is available
+		 *			as output_data (valid only during the call). If on_setup returns true, ACK (ZLP) is sent to the host.
 		 *			If a device-to-host request was received, when the on_setup function returns true, it's expected
 		 *			that the buffer is filled with data and transaction size is set, so that it will be sent back to host.
+		 *			If on_setup returns false, the request is answered with STALL.
 		 * \param	on_finished
 		 *			Called when transfer is complete, that is ACK was sent or received as necessary.
 		 * \param	on_error (Error) -> void
@@ -98,7 +104,7 @@ template<class pInputEndpoint, class pInputBuffer, class pOutputEndpoint, class
 			handle_interrupt (OnSetup&& on_setup, OnFinished&& on_finished, OnError&& on_error) noexcept;
 
 		/**
-		 * Get ready for handling next OUT token.
+		 * Check received OUT data.
 		 */
 		[[nodiscard]]
 		NextOutputResult
@@ -117,6 +123,13 @@ template<class pInputEndpoint, class pInputBuffer, class pOutputEndpoint, class
 		void
 		reset() noexcept;
 
+		/**
+		 * Answer the rest of the current transfer with STALL handshakes (eg. when request isn't supported).
+		 * Stall condition is cleared when next Setup packet arrives.
+		 */
+		void
+		stall() noexcept;
+
 		/**
 		 * Reset to given state so that fresh transfer can be done.
 		 * Performs necessary endpoints setup for requested state.
@@ -125,61 +138,69 @@ template<class pInputEndpoint, class pInputBuffer, class pOutputEndpoint, class
 		reset (State) noexcept;
 
 		/**
-		 * Access the buffer object.
+		 * Return the buffer for short IN responses. This is the IN endpoint buffer itself, so the response can't be
+		 * longer than a single packet.
 		 */
-		Buffer&
+		Span<uint8_t>
 		buffer() noexcept;
 
 		/**
-		 * Access the buffer object.
+		 * Set IN transfer size. Data will be sent from the buffer, but no more than host requested.
 		 */
-		Buffer const&
-		buffer() const noexcept;
+		void
+		set_transfer_size (size_t bytes) noexcept;
 
 		/**
-		 * Set IN transfer size.
+		 * Send given data from program memory in the IN data stage, but no more than host requested.
+		 * Data is copied to the endpoint buffer lazily, packet by packet, so it can be longer than the buffer.
 		 */
 		void
-		set_transfer_size (size_t bytes) noexcept;
+		set_transfer_data (FlashSpan) noexcept;
+
+	  private:
+		/**
+		 * Return Setup packet of the current transfer, if it has an OUT data stage.
+		 * It's kept in the IN endpoint buffer, which isn't used until the status stage (which is a ZLP anyway).
+		 */
+		SetupPacket const&
+		parked_setup() const noexcept;
 
 	  private:
 		InputEndpoint&		_input_endpoint;
 		InputBuffer&		_input_buffer;
 		OutputEndpoint&		_output_endpoint;
 		OutputBuffer&		_output_buffer;
-		SetupPacket			_setup;
-		Buffer&				_buffer;
-		State				_state			{ State::Wait4SetupToken };
-		size_t				_position		{ 0 };
-		size_t				_total_size		{ 0 };
+		State				_state				{ State::Wait4SetupToken };
+		FlashSpan			_flash_data;
+		uint16_t			_requested_size		{ 0 };
+		size_t				_position			{ 0 };
+		size_t				_total_size			{ 0 };
+		bool				_send_zlp			{ false };
 	};
 
 
-template<class IE, class IB, class OE, class OB, size_t S>
+template<class IE, class IB, class OE, class OB>
 	constexpr
-	ControlTransfer<IE, IB, OE, OB, S>::ControlTransfer (InputEndpoint& input_endpoint, InputBuffer& input_buffer, OutputEndpoint& output_endpoint, OutputBuffer& output_buffer, Buffer& buffer) noexcept:
+	ControlTransfer<IE, IB, OE, OB>::ControlTransfer (InputEndpoint& input_endpoint, InputBuffer& input_buffer, OutputEndpoint& output_endpoint, OutputBuffer& output_buffer) noexcept:
 		_input_endpoint (input_endpoint),
 		_input_buffer (input_buffer),
 		_output_endpoint (output_endpoint),
-		_output_buffer (output_buffer),
-		_buffer (buffer)
+		_output_buffer (output_buffer)
 	{
 		reset();
 	}
 
 
-template<class IE, class IB, class OE, class OB, size_t S>
+template<class IE, class IB, class OE, class OB>
 	template<class OnSetup, class OnFinished, class OnError>
 		inline void
-		ControlTransfer<IE, IB, OE, OB, S>::handle_interrupt (OnSetup&& on_setup, OnFinished&& on_finished, OnError&& on_error) noexcept
+		ControlTransfer<IE, IB, OE, OB>::handle_interrupt (OnSetup&& on_setup, OnFinished&& on_finished, OnError&& on_error) noexcept
 		{
 			// Setup token always has priority:
 			if (_output_endpoint.setup_transaction_complete())
 			{
-				_total_size = _output_endpoint.transaction_size();
-
 				// Setup transaction must be 8 bytes, if it's not, discard:
-				if (_total_size != sizeof (usb::SetupPacket))
+				if (_output_endpoint.transaction_size() != sizeof (usb::SetupPacket))
 				{
 					on_error (Error::SetupTransactionNot8Bytes);
 					_output_endpoint.set_ready();
@@ -187,29 +208,44 @@ template<class IE, class IB, class OE, class OB, size_t S>
 				// If valid size:
 				else
 				{
-					_setup = _output_buffer.template as<usb::SetupPacket>();
+					// Parse the packet in place. OUT buffer won't be touched by the SIE until the endpoint is made ready again.
+					SetupPacket const& setup = _output_buffer.template as<usb::SetupPacket>();
+					_requested_size = setup.length;
+
+					// New Setup packet ends the stall condition of the previous request:
+					_input_endpoint.set_stalled (false);
+					_output_endpoint.set_stalled (false);
 
-					switch (_setup.transfer_direction)
+					switch (setup.transfer_direction)
 					{
 						case SetupPacket::TransferDirection::HostToDevice:
-							_total_size = _setup.length;
+							_total_size = setup.length;
 
-							if (_total_size > 0)
+							if (_total_size > _output_buffer.size())
+							{
+								on_error (Error::BufferOverflow);
+								stall();
+							}
+							else if (_total_size > 0)
+							{
+								// Next OUT transaction will overwrite the Setup packet, so move it aside:
+								_input_buffer.template as<usb::SetupPacket>() = setup;
 								reset (State::Wait4OutputToken);
+							}
 							else
 							{
-								if (on_setup (_setup, Span<uint8_t>()))
+								if (on_setup (setup, Span<uint8_t>()))
 									reset (State::Wait4HostToDeviceAck);
 								else
-									reset (State::Wait4SetupToken);
+									stall();
 							}
 							break;
 
 						case SetupPacket::TransferDirection::DeviceToHost:
-							if (on_setup (_setup, Span<uint8_t>()))
+							if (on_setup (setup, Span<uint8_t>()))
 								reset (State::Wait4InputToken);
 							else
-								reset (State::Wait4SetupToken);
+								stall();
 							break;
 					}
 				}
@@ -234,15 +270,15 @@ template<class IE, class IB, class OE, class OB, size_t S>
 							switch (post_output())
 							{
 								case NextOutputResult::Finished:
-									if (on_setup (_setup, Span (_buffer.data(), _position)))
+									if (on_setup (parked_setup(), Span (_output_buffer.data(), _position)))
 										reset (State::Wait4HostToDeviceAck);
-									break;
-
-								case NextOutputResult::More:
+									else
+										stall();
 									break;
 
 								case NextOutputResult::Overflow:
 									on_error (Error::BufferOverflow);
+									stall();
 									break;
 							}
 						}
@@ -287,43 +323,39 @@ template<class IE, class IB, class OE, class OB, size_t S>
 		}
 
 
-template<class IE, class IB, class OE, class OB, size_t S>
+template<class IE, class IB, class OE, class OB>
 	inline auto
-	ControlTransfer<IE, IB, OE, OB, S>::post_output() noexcept -> NextOutputResult
+	ControlTransfer<IE, IB, OE, OB>::post_output() noexcept -> NextOutputResult
 	{
 		size_t const transaction_size = _output_endpoint.transaction_size();
 
-		// If there's still room for input:
-		if (_position + transaction_size <= _total_size || transaction_size == 0)
+		// Whole OUT data stage must fit in a single packet:
+		if (transaction_size <= _total_size)
 		{
-			for (size_t i = 0; i < transaction_size; ++i, ++_position)
-				_buffer[_position] = _output_buffer[i];
-
-			// If last packet:
-			if (transaction_size < _output_buffer.size())
-				return NextOutputResult::Finished;
-			else
-			{
-				_output_endpoint.set_ready();
-				return NextOutputResult::More;
-			}
+			_position = transaction_size;
+			return NextOutputResult::Finished;
 		}
 		else
 			return NextOutputResult::Overflow;
 	}
 
 
-template<class IE, class IB, class OE, class OB, size_t S>
+template<class IE, class IB, class OE, class OB>
 	inline auto
-	ControlTransfer<IE, IB, OE, OB, S>::pre_input() noexcept -> NextInputResult
+	ControlTransfer<IE, IB, OE, OB>::pre_input() noexcept -> NextInputResult
 	{
-		if (_position < _total_size)
+		if (_position < _total_size || _send_zlp)
 		{
-			size_t to_send = std::min (_total_size - _position, _input_buffer.size());
+			size_t const to_send = std::min (_total_size - _position, _input_buffer.size());
 
-			for (size_t i = 0; i < to_send; ++i, ++_position)
-				_input_buffer[i] = _buffer[_position];
+			// Data from buffer() is already in place, only data from flash needs to be copied:
+			if (!_flash_data.empty())
+				_flash_data.copy_to (Span (_input_buffer.data(), to_send), _position);
 
+			_position += to_send;
+			// If the data ends with a full packet and it's shorter than what host requested, host needs a ZLP to know
+			// that the transfer is complete:
+			_send_zlp = _position == _total_size && to_send == _input_buffer.size() && _total_size < _requested_size;
 			_input_endpoint.set_ready (to_send);
 
 			return NextInputResult::More;
@@ -333,23 +365,27 @@ template<class IE, class IB, class OE, class OB, size_t S>
 	}
 
 
-template<class IE, class IB, class OE, class OB, size_t S>
+template<class IE, class IB, class OE, class OB>
 	inline void
-	ControlTransfer<IE, IB, OE, OB, S>::reset() noexcept
+	ControlTransfer<IE, IB, OE, OB>::reset() noexcept
 	{
 		reset (State::Wait4SetupToken);
 	}
 
 
-template<class IE, class IB, class OE, class OB, size_t S>
+template<class IE, class IB, class OE, class OB>
 	inline void
-	ControlTransfer<IE, IB, OE, OB, S>::reset (State state) noexcept
+	ControlTransfer<IE, IB, OE, OB>::reset (State state) noexcept
 	{
 		_state = state;
 		_position = 0;
+		_send_zlp = false;
 
-		if (state != State::Wait4InputToken)
+		if (state != State::Wait4InputToken && state != State::Wait4OutputToken)
+		{
 			_total_size = 0;
+			_flash_data = FlashSpan();
+		}
 
 		switch (state)
 		{
@@ -370,6 +406,8 @@ template<class IE, class IB, class OE, class OB, size_t S>
 				break;
 
 			case State::Wait4InputToken:
+				// Data stage has at least one packet, if there's no data (or host requested none) it's a ZLP:
+				_send_zlp = _total_size == 0;
 				static_cast<void> (pre_input());
 				break;
 
@@ -382,27 +420,47 @@ template<class IE, class IB, class OE, class OB, size_t S>
 	}
 
 
-template<class IE, class IB, class OE, class OB, size_t S>
-	inline auto
-	ControlTransfer<IE, IB, OE, OB, S>::buffer() noexcept -> Buffer&
+template<class IE, class IB, class OE, class OB>
+	inline void
+	ControlTransfer<IE, IB, OE, OB>::stall() noexcept
+	{
+		reset (State::Wait4SetupToken);
+		_input_endpoint.set_stalled (true);
+		_output_endpoint.set_stalled (true);
+	}
+
+
+template<class IE, class IB, class OE, class OB>
+	inline Span<uint8_t>
+	ControlTransfer<IE, IB, OE, OB>::buffer() noexcept
 	{
-		return _buffer;
+		return { _input_buffer.data(), _input_buffer.size() };
 	}
 
 
-template<class IE, class IB, class OE, class OB, size_t S>
-	inline auto
-	ControlTransfer<IE, IB, OE, OB, S>::buffer() const noexcept -> Buffer const&
+template<class IE, class IB, class OE, class OB>
+	inline void
+	ControlTransfer<IE, IB, OE, OB>::set_transfer_size (size_t bytes) noexcept
 	{
-		return const_cast<ControlTransfer<IE, IB, OE, OB, S>*> (this)->buffer();
+		_flash_data = FlashSpan();
+		_total_size = std::min<size_t> (std::min<size_t> (bytes, _requested_size), _input_buffer.size());
 	}
 
 
-template<class IE, class IB, class OE, class OB, size_t S>
+template<class IE, class IB, class OE, class OB>
 	inline void
-	ControlTransfer<IE, IB, OE, OB, S>::set_transfer_size (size_t bytes) noexcept
+	ControlTransfer<IE, IB, OE, OB>::set_transfer_data (FlashSpan data) noexcept
 	{
-		_total_size = bytes;
+		_flash_data = data;
+		_total_size = std::min<size_t> (data.size(), _requested_size);
+	}
+
+
+template<class IE, class IB, class OE, class OB>
+	inline SetupPacket const&
+	ControlTransfer<IE, IB, OE, OB>::parked_setup() const noexcept
+	{
+		return _input_buffer.template as<usb::SetupPacket>();
 	}
 
 } // namespace usb
@@ -410,4 +468,3 @@ template<class IE, class IB, class OE, class OB, size_t S>
 } // namespace mulabs
 
 #endif
-
@@ -0,0 +1,458 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__SUPPORT__PROTOCOLS__DESCRIPTOR_TABLE_H__INCLUDED
+#define MULABS_AVR__SUPPORT__PROTOCOLS__DESCRIPTOR_TABLE_H__INCLUDED
+
+// Standard:
+#include <stddef.h>
+#include <stdint.h>
+
+// Mulabs:
+#include <mulabs_avr/support/protocols/usb/descriptors.h>
+#include <mulabs_avr/support/protocols/usb/device_definition.h>
+#include <mulabs_avr/utility/array.h>
+#include <mulabs_avr/utility/flash_span.h>
+
+
+namespace mulabs {
+namespace avr {
+namespace usb {
+
+/**
+ * Position of a single descriptor within DescriptorTable's blob.
+ */
+struct DescriptorTableEntry
+{
+	DescriptorType	type	= DescriptorType::Device;
+	uint8_t			index	= 0;
+	uint16_t		offset	= 0;
+	uint16_t		size	= 0;
+};
+
+
+/**
+ * Serialized descriptors and the index of descriptors within the blob.
+ */
+template<size_t pBlobSize, size_t pEntriesCount>
+	struct DescriptorTableContents
+	{
+		Array<uint8_t, pBlobSize>						blob	{ };
+		Array<DescriptorTableEntry, pEntriesCount>		entries	{ };
+	};
+
+
+namespace detail {
+
+/**
+ * Serializes descriptors into a byte array in the USB (little-endian) wire format.
+ * Unlike Span::as<>() it doesn't need reinterpret_cast<>, so it works in constant expressions.
+ */
+template<size_t pSize>
+	class DescriptorWriter
+	{
+	  public:
+		// Ctor
+		explicit constexpr
+		DescriptorWriter (Array<uint8_t, pSize>& target);
+
+		/**
+		 * Return number of bytes written so far.
+		 */
+		constexpr size_t
+		position() const;
+
+		constexpr void
+		put8 (uint8_t);
+
+		constexpr void
+		put16 (uint16_t);
+
+		constexpr void
+		put (DeviceDescriptor const&);
+
+		constexpr void
+		put (ConfigurationDescriptor const&);
+
+		constexpr void
+		put (InterfaceDescriptor const&);
+
+		constexpr void
+		put (EndpointDescriptor const&);
+
+		/**
+		 * Write string descriptor for given string.
+		 */
+		constexpr void
+		put_string (String const&);
+
+	  private:
+		Array<uint8_t, pSize>&	_target;
+		size_t					_position	{ 0 };
+	};
+
+
+template<size_t S>
+	constexpr
+	DescriptorWriter<S>::DescriptorWriter (Array<uint8_t, S>& target):
+		_target (target)
+	{ }
+
+
+template<size_t S>
+	constexpr size_t
+	DescriptorWriter<S>::position() const
+	{
+		return _position;
+	}
+
+
+template<size_t S>
+	constexpr void
+	DescriptorWriter<S>::put8 (uint8_t value)
+	{
+		_target[_position++] = value;
+	}
+
+
+template<size_t S>
+	constexpr void
+	DescriptorWriter<S>::put16 (uint16_t value)
+	{
+		put8 (value & 0xff);
+		put8 (value >> 8);
+	}
+
+
+template<size_t S>
+	constexpr void
+	DescriptorWriter<S>::put (DeviceDescriptor const& d)
+	{
+		put8 (d.length);
+		put8 (static_cast<uint8_t> (d.descriptor_type));
+		put16 (static_cast<uint16_t> (d.usb_version));
+		put8 (static_cast<uint8_t> (d.device_class));
+		put8 (d.device_sub_class);
+		put8 (d.device_protocol);
+		put8 (d.max_packet_size_0);
+		put16 (d.vendor_id);
+		put16 (d.product_id);
+		put16 (d.release_id);
+		put8 (d.manufacturer_index);
+		put8 (d.product_index);
+		put8 (d.serial_number_index);
+		put8 (d.num_configurations);
+	}
+
+
+template<size_t S>
+	constexpr void
+	DescriptorWriter<S>::put (ConfigurationDescriptor const& d)
+	{
+		put8 (d.length);
+		put8 (static_cast<uint8_t> (d.descriptor_type));
+		put16 (d.total_length);
+		put8 (d.number_of_interfaces);
+		put8 (d.configuration_value);
+		put8 (d.description_index);
+		put8 (d.flags);
+		put8 (d.max_power_2_milli_amps);
+	}
+
+
+template<size_t S>
+	constexpr void
+	DescriptorWriter<S>::put (InterfaceDescriptor const& d)
+	{
+		put8 (d.length);
+		put8 (static_cast<uint8_t> (d.descriptor_type));
+		put8 (d.index);
+		put8 (d.alternate_index);
+		put8 (d.num_endpoints);
+		put8 (static_cast<uint8_t> (d.interface_class));
+		put8 (d.interface_sub_class);
+		put8 (d.interface_protocol);
+		put8 (d.description_index);
+	}
+
+
+template<size_t S>
+	constexpr void
+	DescriptorWriter<S>::put (EndpointDescriptor const& d)
+	{
+		put8 (d.length);
+		put8 (static_cast<uint8_t> (d.descriptor_type));
+		put8 (d.address);
+		put8 (d.attributes);
+		put16 (d.max_packet_size);
+		put8 (d.interval);
+	}
+
+
+template<size_t S>
+	constexpr void
+	DescriptorWriter<S>::put_string (String const& string)
+	{
+		if (string.size() > kMaxStringDescriptorLength)
+			throw StringTooLong();
+
+		put8 (sizeof (StringDescriptor) + string.size() * sizeof (String::Char));
+		put8 (static_cast<uint8_t> (DescriptorType::String));
+
+		for (size_t i = 0; i < string.size(); ++i)
+			put16 (string[i]);
+	}
+
+
+/**
+ * Return size of the full configuration descriptor (with all interface and endpoint descriptors).
+ */
+constexpr size_t
+full_configuration_descriptor_size (Configuration const& configuration)
+{
+	size_t size = sizeof (ConfigurationDescriptor);
+
+	for (auto const& interface: configuration.interfaces)
+	{
+		size += sizeof (InterfaceDescriptor) + interface.class_descriptors.size();
+
+		for (auto const& endpoint: interface.endpoints)
+			size += endpoint.descriptor_size() + endpoint.class_descriptors.size();
+	}
+
+	return size;
+}
+
+
+/**
+ * Return number of bytes needed for all descriptors of given device.
+ */
+template<Device const& pDevice>
+	constexpr size_t
+	descriptor_blob_size()
+	{
+		constexpr DeviceStrings<pDevice> strings;
+		size_t size = sizeof (DeviceDescriptor);
+
+		for (auto const& configuration: pDevice.configurations)
+			size += full_configuration_descriptor_size (configuration);
+
+		size += sizeof (StringDescriptorZero) + sizeof (LanguageID);
+
+		for (size_t i = 0; i < strings.strings.size(); ++i)
+			size += sizeof (StringDescriptor) + strings.strings[i].size() * sizeof (String::Char);
+
+		return size;
+	}
+
+
+/**
+ * Return number of descriptors of given device: device descriptor, configuration descriptors and string descriptors
+ * (including string descriptor 0). make_descriptor_blob() writes entries in this order, so that DescriptorTable
+ * can compute entry's position from descriptor type and index.
+ */
+template<Device const& pDevice>
+	constexpr size_t
+	descriptor_entries_count()
+	{
+		return 1 + pDevice.configurations.size() + 1 + pDevice.max_string_index();
+	}
+
+
+/**
+ * Serialize all descriptors of the device into a single blob and fill in the index of descriptors within it.
+ */
+template<Device const& pDevice, size_t pBlobSize, size_t pEntriesCount>
+	constexpr void
+	make_descriptor_blob (Array<uint8_t, pBlobSize>& blob, Array<DescriptorTableEntry, pEntriesCount>& entries)
+	{
+		constexpr DeviceStrings<pDevice> strings;
+		DescriptorWriter writer (blob);
+		size_t entry_index = 0;
+
+		auto add_entry = [&] (DescriptorType type, uint8_t index, size_t start) {
+			auto& entry = entries[entry_index++];
+			entry.type = type;
+			entry.index = index;
+			entry.offset = start;
+			entry.size = writer.position() - start;
+		};
+
+		// Device descriptor:
+		{
+			size_t const start = writer.position();
+			writer.put (make_device_descriptor (pDevice));
+			add_entry (DescriptorType::Device, 0, start);
+		}
+
+		// Configuration descriptors, each followed by its interfaces and endpoints:
+		for (uint8_t i = 0; i < pDevice.configurations.size(); ++i)
+		{
+			auto const configuration = pDevice.configuration_for_index (i);
+			auto configuration_descriptor = make_configuration_descriptor (pDevice, i);
+			configuration_descriptor.total_length = full_configuration_descriptor_size (configuration);
+
+			size_t const start = writer.position();
+			writer.put (configuration_descriptor);
+
+			for (uint8_t position = 0; position < configuration.interfaces.size(); ++position)
+			{
+				Interface const& interface = *(configuration.interfaces.begin() + position);
+
+				writer.put (make_interface_descriptor (interface, pDevice.interface_string_index (i, position)));
+
+				for (size_t k = 0; k < interface.class_descriptors.size(); ++k)
+					writer.put8 (interface.class_descriptors[k]);
+
+				for (auto const& endpoint: interface.endpoints)
+				{
+					writer.put (make_endpoint_descriptor (endpoint));
+
+					// bRefresh and bSynchAddress of audio endpoints:
+					for (size_t k = sizeof (EndpointDescriptor); k < endpoint.descriptor_size(); ++k)
+						writer.put8 (0);
+
+					for (size_t k = 0; k < endpoint.class_descriptors.size(); ++k)
+						writer.put8 (endpoint.class_descriptors[k]);
+				}
+			}
+
+			add_entry (DescriptorType::Configuration, i, start);
+		}
+
+		// String descriptor 0 (list of supported languages):
+		{
+			size_t const start = writer.position();
+			writer.put8 (sizeof (StringDescriptorZero) + sizeof (LanguageID));
+			writer.put8 (static_cast<uint8_t> (DescriptorType::String));
+			writer.put16 (static_cast<uint16_t> (LanguageID::English));
+			add_entry (DescriptorType::String, 0, start);
+		}
+
+		// Rest of string descriptors:
+		for (uint8_t i = 0; i < strings.strings.size(); ++i)
+		{
+			size_t const start = writer.position();
+			writer.put_string (strings.strings[i]);
+			add_entry (DescriptorType::String, i + 1, start);
+		}
+	}
+
+
+template<Device const& pDevice>
+	constexpr auto
+	make_descriptor_table_contents()
+	{
+		DescriptorTableContents<descriptor_blob_size<pDevice>(), descriptor_entries_count<pDevice>()> result;
+		make_descriptor_blob<pDevice> (result.blob, result.entries);
+		return result;
+	}
+
+} // namespace detail
+
+
+/**
+ * All descriptors of a Device serialized at compile time into a single blob stored in program memory,
+ * along with an index table. Answering GET_DESCRIPTOR is then just a lookup and a copy from flash, no need
+ * to walk the Device tree or convert strings at runtime, and no SRAM is needed for the strings.
+ */
+template<Device const& pDevice>
+	class DescriptorTable
+	{
+	  public:
+		static constexpr Device const&	device			= pDevice;
+		static constexpr size_t			kBlobSize		= detail::descriptor_blob_size<pDevice>();
+		static constexpr size_t			kEntriesCount	= detail::descriptor_entries_count<pDevice>();
+		// Positions of the first entry of each type:
+		static constexpr size_t			kConfigurationsEntry	= 1;
+		static constexpr size_t			kStringsEntry			= kConfigurationsEntry + pDevice.configurations.size();
+
+		using Contents	= DescriptorTableContents<kBlobSize, kEntriesCount>;
+
+	  public:
+		/**
+		 * Return descriptor of given type and index. Takes constant time: position of the entry is computed
+		 * from the type and index, and only that entry is read from flash.
+		 * Return empty FlashSpan if there's no such descriptor.
+		 */
+		static FlashSpan
+		descriptor (DescriptorType, uint8_t index);
+
+	  public:
+		static constexpr Contents contents PROGMEM = detail::make_descriptor_table_contents<pDevice>();
+	};
+
+
+template<Device const& D>
+	inline FlashSpan
+	DescriptorTable<D>::descriptor (DescriptorType type, uint8_t index)
+	{
+		size_t first = 0;
+		size_t end = 0;
+
+		switch (type)
+		{
+			case DescriptorType::Device:
+				first = 0;
+				end = kConfigurationsEntry;
+				break;
+
+			case DescriptorType::Configuration:
+				first = kConfigurationsEntry;
+				end = kStringsEntry;
+				break;
+
+			case DescriptorType::String:
+				first = kStringsEntry;
+				end = kEntriesCount;
+				break;
+
+			default:
+				return { };
+		}
+
+		if (index >= end - first)
+			return { };
+
+		DescriptorTableEntry entry;
+		flash_copy (&entry, &contents.entries[first + index], sizeof (entry));
+		return FlashSpan (contents.blob.data() + entry.offset, entry.size);
+	}
+
+
+namespace detail {
+
+// Compile-time check that configuration attributes survive serialization (bmAttributes of a self-powered,
+// remote-wakeup configuration must be 0xe0). The list is a separate constant, so that its elements have static
+// storage and Device can be used as a template argument:
+constexpr Configuration kAttributesCheckConfiguration (ConfigurationValue (1), u"", SelfPowered (true), RemoteWakeup (true),
+													   MaxPowerMilliAmps (100), { });
+
+constexpr std::initializer_list<Configuration> kAttributesCheckConfigurations = { kAttributesCheckConfiguration };
+
+constexpr Device kAttributesCheckDevice (USBVersion::_1_1, VendorID (0), ProductID (0), ReleaseID (0),
+										 DeviceClass::VendorSpecified, DeviceSubClass (0), DeviceProtocol (0),
+										 Manufacturer (u""), Product (u""), Serial (u""), MaxPacketSize0 (8),
+										 kAttributesCheckConfigurations);
+
+static_assert (make_descriptor_table_contents<kAttributesCheckDevice>().blob[sizeof (DeviceDescriptor) + 7] == 0xe0,
+			   "bad bmAttributes in the configuration descriptor");
+
+} // namespace detail
+
+} // namespace usb
+} // namespace avr
+} // namespace mulabs
+
+#endif
+
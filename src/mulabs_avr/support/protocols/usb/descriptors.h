@@ -17,6 +17,7 @@
 // Mulabs:
 #include <mulabs_avr/support/protocols/usb/device_definition.h>
 #include <mulabs_avr/support/protocols/usb/types.h>
+#include <mulabs_avr/utility/flash_constring.h>
 #include <mulabs_avr/utility/span.h>
 #include <mulabs_avr/utility/strong_type.h>
 
@@ -53,6 +54,19 @@ class InsufficientBufferSize
 { };
 
 
+/**
+ * Thrown when a string doesn't fit in a string descriptor (its bLength is a single byte).
+ */
+class StringTooLong
+{ };
+
+
+/**
+ * Maximum number of UTF-16 code units in a string descriptor.
+ */
+constexpr size_t kMaxStringDescriptorLength = (255 - 2) / 2;
+
+
 struct DeviceDescriptor
 {
 	// This layout is required by the USB standard:
@@ -172,11 +186,12 @@ ConfigurationDescriptor::make_flags (USBVersion usb_version, SelfPowered self_po
 	if (usb_version >= USBVersion::_1_1)
 		result = 0b10000000;
 
+	// Plain bit operations, set_bit<>() takes a volatile reference and can't be used in constant expressions:
 	if (*self_powered)
-		set_bit<6> (result);
+		result |= 1u << 6;
 
 	if (*remote_wakeup)
-		set_bit<5> (result);
+		result |= 1u << 5;
 
 	return result;
 }
@@ -216,65 +231,69 @@ EndpointDescriptor::make_attributes (TransferType transfer_type, SyncType sync_t
 /**
  * Make a DeviceDescriptor for the provided Device.
  */
-template<class pDeviceStrings>
-	constexpr DeviceDescriptor
-	make_device_descriptor (Device const& device, pDeviceStrings const& strings)
-	{
-		DeviceDescriptor descriptor;
-		descriptor.usb_version = device.usb_version;
-		descriptor.device_class = device.device_class;
-		descriptor.device_sub_class = *device.device_sub_class;
-		descriptor.device_protocol = *device.device_protocol;
-		descriptor.max_packet_size_0 = *device.max_packet_size_0;
-		descriptor.vendor_id = *device.vendor_id;
-		descriptor.product_id = *device.product_id;
-		descriptor.release_id = *device.release_id;
-		descriptor.manufacturer_index = strings.index_for_string (*device.manufacturer);
-		descriptor.product_index = strings.index_for_string (*device.product);
-		descriptor.serial_number_index = strings.index_for_string (*device.serial);
-		descriptor.num_configurations = device.configurations.size();
-		return descriptor;
-	}
+constexpr DeviceDescriptor
+make_device_descriptor (Device const& device)
+{
+	DeviceDescriptor descriptor;
+	descriptor.usb_version = device.usb_version;
+	descriptor.device_class = device.device_class;
+	descriptor.device_sub_class = *device.device_sub_class;
+	descriptor.device_protocol = *device.device_protocol;
+	descriptor.max_packet_size_0 = *device.max_packet_size_0;
+	descriptor.vendor_id = *device.vendor_id;
+	descriptor.product_id = *device.product_id;
+	descriptor.release_id = *device.release_id;
+	descriptor.manufacturer_index = Device::kManufacturerStringIndex;
+	descriptor.product_index = Device::kProductStringIndex;
+	descriptor.serial_number_index = Device::kSerialStringIndex;
+	descriptor.num_configurations = device.configurations.size();
+	return descriptor;
+}
 
 
 /**
- * Make a configuration descriptor.
+ * Make a descriptor of Nth configuration.
  */
-template<class pDeviceStrings>
-	constexpr ConfigurationDescriptor
-	make_configuration_descriptor (Device const& device, Configuration const& configuration, pDeviceStrings const& strings)
-	{
-		ConfigurationDescriptor descriptor;
-		descriptor.total_length = descriptor.length;
-		descriptor.number_of_interfaces = configuration.interfaces.size();
-		descriptor.configuration_value = *configuration.value;
-		descriptor.description_index = strings.index_for_string (configuration.description);
-		descriptor.flags = descriptor.make_flags (device.usb_version, configuration.self_powered, configuration.remote_wakeup);
-		descriptor.max_power_2_milli_amps = *configuration.max_power_milli_amps / 2;
-		return descriptor;
-	}
+constexpr ConfigurationDescriptor
+make_configuration_descriptor (Device const& device, uint8_t configuration_index)
+{
+	Configuration const& configuration = *(device.configurations.begin() + configuration_index);
+	ConfigurationDescriptor descriptor;
+	descriptor.total_length = descriptor.length;
+	descriptor.number_of_interfaces = configuration.number_of_interfaces();
+	descriptor.configuration_value = *configuration.value;
+	descriptor.description_index = device.configuration_string_index (configuration_index);
+	descriptor.flags = descriptor.make_flags (device.usb_version, configuration.self_powered, configuration.remote_wakeup);
+	descriptor.max_power_2_milli_amps = *configuration.max_power_milli_amps / 2;
+	return descriptor;
+}
 
 
-template<class pDeviceStrings>
-	constexpr InterfaceDescriptor
-	make_interface_descriptor (Interface const& interface, pDeviceStrings const& strings)
-	{
-		InterfaceDescriptor descriptor;
-		descriptor.index = *interface.index;
-		descriptor.alternate_index = *interface.alternate_index;
-		descriptor.num_endpoints = interface.endpoints.size();
-		descriptor.interface_class = interface.interface_class;
-		descriptor.interface_sub_class = *interface.interface_sub_class;
-		descriptor.interface_protocol = *interface.interface_protocol;
-		descriptor.description_index = strings.index_for_string (interface.description);
-		return descriptor;
-	}
+/**
+ * Make an interface descriptor. Description index is the string-descriptor index of the interface description
+ * (see Device::interface_string_index()).
+ */
+constexpr InterfaceDescriptor
+make_interface_descriptor (Interface const& interface, uint8_t description_index)
+{
+	InterfaceDescriptor descriptor;
+	descriptor.index = *interface.index;
+	descriptor.alternate_index = *interface.alternate_index;
+	descriptor.num_endpoints = interface.endpoints.size();
+	descriptor.interface_class = interface.interface_class;
+	descriptor.interface_sub_class = *interface.interface_sub_class;
+	descriptor.interface_protocol = *interface.interface_protocol;
+	descriptor.description_index = description_index;
+	return descriptor;
+}
 
 
 constexpr EndpointDescriptor
-make_endpoint_descriptor ([[maybe_unused]] Endpoint const& endpoint)
+make_endpoint_descriptor (Endpoint const& endpoint)
 {
 	EndpointDescriptor descriptor;
+	// Audio endpoints are longer, rest of the fields is appended by the serializer:
+	descriptor.length = endpoint.descriptor_size();
 	descriptor.address = EndpointDescriptor::make_address (endpoint.index, endpoint.direction);
 	descriptor.attributes = EndpointDescriptor::make_attributes (endpoint.transfer_type, endpoint.sync_type, endpoint.usage_type);
 	descriptor.max_packet_size = *endpoint.max_packet_size;
@@ -283,42 +302,6 @@ make_endpoint_descriptor ([[maybe_unused]] Endpoint const& endpoint)
 }
 
 
-/**
- * Make a configuration descriptor and also the rest of the hierarchy for that configuration.
- * Put it all into a buffer.
- */
-template<class pDeviceStrings>
-	[[nodiscard]]
-	constexpr size_t
-	make_full_configuration_descriptor (Span<uint8_t> target_buffer, Device const& device, uint8_t configuration_index, pDeviceStrings const& strings)
-	{
-		Configuration const configuration = device.configuration_for_index (configuration_index);
-		auto const initial_pointer = target_buffer.data();
-
-		auto& configuration_descriptor = target_buffer.template as<ConfigurationDescriptor>();
-		configuration_descriptor = make_configuration_descriptor (device, configuration, strings);
-		target_buffer.remove_prefix (sizeof (configuration_descriptor));
-
-		for (auto const& interface: configuration.interfaces)
-		{
-			auto& interface_descriptor = target_buffer.template as<InterfaceDescriptor>();
-			interface_descriptor = make_interface_descriptor (interface, strings);
-			target_buffer.remove_prefix (sizeof (interface_descriptor));
-
-			for (auto const& endpoint: interface.endpoints)
-			{
-				auto& endpoint_descriptor = target_buffer.template as<EndpointDescriptor>();
-				endpoint_descriptor = make_endpoint_descriptor (endpoint);
-				target_buffer.remove_prefix (sizeof (endpoint_descriptor));
-			}
-		}
-
-		size_t const total_length = target_buffer.data() - initial_pointer;
-		configuration_descriptor.total_length = total_length;
-		return total_length;
-	}
-
-
 namespace detail {
 
 template<class ...pLanguageIDs>
@@ -364,14 +347,16 @@ template<class ...pLanguageIDs>
  * Make a string descriptor.
  */
 [[nodiscard]]
-constexpr size_t
+inline size_t
 make_string_descriptor (Span<uint8_t> target_buffer, String const& string)
 {
 	auto& descriptor = target_buffer.template as<StringDescriptor>();
 	size_t string_size_bytes = string.size() * sizeof (String::Char);
 	size_t total_bytes = sizeof (descriptor) + string_size_bytes;
 
-	if (total_bytes > target_buffer.size())
+	if (string.size() > kMaxStringDescriptorLength)
+		throw StringTooLong();
+	else if (total_bytes > target_buffer.size())
 		throw InsufficientBufferSize();
 	else
 	{
@@ -386,6 +371,33 @@ make_string_descriptor (Span<uint8_t> target_buffer, String const& string)
 	return total_bytes;
 }
 
+
+/**
+ * Make a string descriptor from a string stored in program memory.
+ */
+[[nodiscard]]
+inline size_t
+make_string_descriptor (Span<uint8_t> target_buffer, FlashConstring<char16_t> const& string)
+{
+	auto& descriptor = target_buffer.template as<StringDescriptor>();
+	size_t string_size_bytes = string.size() * sizeof (char16_t);
+	size_t total_bytes = sizeof (descriptor) + string_size_bytes;
+
+	if (string.size() > kMaxStringDescriptorLength)
+		throw StringTooLong();
+	else if (total_bytes > target_buffer.size())
+		throw InsufficientBufferSize();
+	else
+	{
+		descriptor = StringDescriptor();
+		descriptor.length += string_size_bytes;
+		target_buffer.remove_prefix (sizeof (descriptor));
+		string.copy_to (target_buffer);
+	}
+
+	return total_bytes;
+}
+
 } // namespace usb
 } // namespace avr
 } // namespace mulabs
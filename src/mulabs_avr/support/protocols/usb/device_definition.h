@@ -20,6 +20,7 @@
 #include <mulabs_avr/support/protocols/usb/types.h>
 #include <mulabs_avr/utility/array.h>
 #include <mulabs_avr/utility/constring.h>
+#include <mulabs_avr/utility/span.h>
 #include <mulabs_avr/utility/strong_type.h>
 
 
@@ -32,6 +33,12 @@ using Manufacturer	= StrongType<String, struct ManufacturerType>;
 using Product		= StrongType<String, struct ProductType>;
 using Serial		= StrongType<String, struct SerialType>;
 
+/**
+ * Serialized class-specific descriptors (eg. CDC functional descriptors or HID descriptor), that go right after
+ * the interface descriptor in the configuration descriptor. Must point to constexpr data.
+ */
+using ClassDescriptors	= Span<uint8_t const>;
+
 enum class Direction: uint8_t
 {
 	Out					= 0b0,
@@ -61,6 +68,20 @@ enum class UsageType: uint8_t
 	ExplicitFeedback	= 0b10,
 };
 
+/**
+ * Where endpoint buffers come from. Buffers from the pool are allocated by State, which also configures such endpoints
+ * on SET_CONFIGURATION and SET_INTERFACE. Ping-pong endpoints use the descriptor of the opposite direction as the
+ * second bank, so their index can't be used in the other direction.
+ */
+enum class EndpointBuffer: uint8_t
+{
+	Single,
+	PingPong,
+	// Buffers are provided by the user (eg. by a class driver like BulkInput), which also configures the endpoint:
+	External,
+	ExternalPingPong,
+};
+
 
 /**
  * Base class for all exceptions here.
@@ -99,19 +120,67 @@ class Endpoint
 	class InvalidEndpointIndex: public Exception
 	{ };
 
+	// Thrown when max packet size is not supported by the SIE (more than 64 bytes, or 1023 for isochronous endpoints).
+	class InvalidMaxPacketSize: public Exception
+	{ };
+
+	// Thrown when control endpoint is set to use ping-pong mode.
+	class PingPongNotAllowed: public Exception
+	{ };
+
   public:
 	// Ctor
 	explicit constexpr
-	Endpoint (Index, Direction, TransferType, SyncType, UsageType, MaxPacketSize, Interval = Interval (0));
+	Endpoint (Index, Direction, TransferType, SyncType, UsageType, MaxPacketSize, Interval = Interval (0),
+			  EndpointBuffer = EndpointBuffer::Single);
+
+	// Ctor
+	// Class descriptors go right after the endpoint descriptor (eg. class-specific isochronous audio endpoint descriptor).
+	explicit constexpr
+	Endpoint (Index, Direction, TransferType, SyncType, UsageType, MaxPacketSize, Interval, AudioEndpoint, ClassDescriptors,
+			  EndpointBuffer = EndpointBuffer::Single);
+
+	/**
+	 * Return size of the endpoint descriptor, which depends on whether it's an audio endpoint or not.
+	 */
+	constexpr size_t
+	descriptor_size() const;
+
+	/**
+	 * Return true if endpoint uses ping-pong mode.
+	 */
+	constexpr bool
+	ping_pong() const;
+
+	/**
+	 * Return true if endpoint buffers come from the State's pool.
+	 */
+	constexpr bool
+	pooled() const;
+
+	/**
+	 * Return size of a single bank: max_packet_size rounded up to the nearest buffer size supported by the SIE.
+	 */
+	constexpr size_t
+	bank_size() const;
+
+	/**
+	 * Return number of bytes the endpoint needs from the State's buffer pool.
+	 */
+	constexpr size_t
+	buffers_size() const;
 
   public:
-	Index			index;
-	Direction		direction;
-	TransferType	transfer_type;
-	SyncType		sync_type;
-	UsageType		usage_type;
-	MaxPacketSize	max_packet_size;
-	Interval		interval;
+	Index				index;
+	Direction			direction;
+	TransferType		transfer_type;
+	SyncType			sync_type;
+	UsageType			usage_type;
+	MaxPacketSize		max_packet_size;
+	Interval			interval;
+	AudioEndpoint		audio_endpoint;
+	ClassDescriptors	class_descriptors;
+	EndpointBuffer		buffer;
 };
 
 
@@ -127,6 +196,17 @@ class Interface
 	explicit constexpr
 	Interface (Index, AlternateIndex, DeviceClass, DeviceSubClass, DeviceProtocol, String description, std::initializer_list<Endpoint>);
 
+	// Ctor
+	explicit constexpr
+	Interface (Index, AlternateIndex, DeviceClass, DeviceSubClass, DeviceProtocol, String description, ClassDescriptors,
+			   std::initializer_list<Endpoint>);
+
+	/**
+	 * Return number of bytes needed from the State's buffer pool by all endpoints of this interface.
+	 */
+	constexpr size_t
+	buffers_size() const;
+
   public:
 	Index							index;
 	AlternateIndex					alternate_index;
@@ -134,6 +214,7 @@ class Interface
 	DeviceSubClass					interface_sub_class;
 	DeviceProtocol					interface_protocol;
 	String							description;
+	ClassDescriptors				class_descriptors;
 	std::initializer_list<Endpoint>	endpoints;
 };
 
@@ -145,15 +226,14 @@ class Configuration
 	class ConfigurationValueMustNotBe0: public Exception
 	{ };
 
-	// Thrown when interface indices are not sequentially ordered starting from 0.
+	// Thrown when interface indices are not sequentially ordered starting from 0, or alternate settings of an interface
+	// don't follow it sequentially starting from 0.
 	class InvalidIndexSequence: public Exception
 	{ };
 
-	// Thrown when interface specified in alternate_index isn't defined.
-	class AlternateInterfaceIndexNotFound: public Exception
-	{ };
-
-	// Thrown when within single configuration there are two or more endpoints with the same index.
+	// Thrown when within single configuration there are two or more endpoints with the same index
+	// (other than in different alternate settings of the same interface), or a ping-pong endpoint
+	// shares its index with an endpoint of the other direction.
 	class ConflictingEndpointIndices: public Exception
 	{ };
 
@@ -162,6 +242,25 @@ class Configuration
 	explicit constexpr
 	Configuration (ConfigurationValue, String description, SelfPowered, RemoteWakeup, MaxPowerMilliAmps, std::initializer_list<Interface>);
 
+	/**
+	 * Return number of interfaces, not counting alternate settings.
+	 */
+	constexpr uint8_t
+	number_of_interfaces() const;
+
+	/**
+	 * Return interface with given index and alternate setting, or nullptr if there's no such interface.
+	 */
+	constexpr Interface const*
+	find_interface (uint8_t index, uint8_t alternate_index) const;
+
+	/**
+	 * Return number of bytes needed from the State's buffer pool. Alternate settings of an interface share
+	 * the same buffers, since only one of them is active at a time.
+	 */
+	constexpr size_t
+	buffers_size() const;
+
   public:
 	ConfigurationValue					value;
 	String								description;
@@ -174,6 +273,14 @@ class Configuration
 
 class Device
 {
+  public:
+	// String-descriptor indices of the device strings. String descriptors are numbered in the order of the definition:
+	// device strings, then each configuration's description followed by descriptions of its interfaces
+	// (see DeviceStrings), so indices are known without looking the strings up:
+	static constexpr uint8_t kManufacturerStringIndex	= 1;
+	static constexpr uint8_t kProductStringIndex		= 2;
+	static constexpr uint8_t kSerialStringIndex			= 3;
+
   public:
 	// Thrown when configuration indices are found not to be unique numbers.
 	class ConfigurationValueNotUnique: public Exception
@@ -195,12 +302,37 @@ class Device
 	constexpr uint8_t
 	maximum_endpoint_address() const;
 
+	/**
+	 * Return maximum number of interfaces (not counting alternate settings) among all configurations.
+	 */
+	constexpr uint8_t
+	maximum_number_of_interfaces() const;
+
+	/**
+	 * Return size of the buffer pool needed for endpoints of the most demanding configuration.
+	 */
+	constexpr size_t
+	endpoint_buffers_size() const;
+
 	/**
 	 * Return maximum index of string-descriptor used by this configuration.
 	 */
 	constexpr size_t
 	max_string_index() const;
 
+	/**
+	 * Return string-descriptor index of the description of Nth configuration.
+	 */
+	constexpr uint8_t
+	configuration_string_index (uint8_t configuration_index) const;
+
+	/**
+	 * Return string-descriptor index of the description of Nth interface (counting alternate settings)
+	 * of Nth configuration.
+	 */
+	constexpr uint8_t
+	interface_string_index (uint8_t configuration_index, uint8_t interface_position) const;
+
 	/**
 	 * Return configuration descriptor by index.
 	 * Valid indices are 0…N-1.
@@ -214,6 +346,13 @@ class Device
 	constexpr Configuration
 	configuration_for_value (ConfigurationValue) const;
 
+	/**
+	 * Return configuration with given configuration-value, or nullptr if there's no such configuration.
+	 * Unlike configuration_for_value() it doesn't throw, so it can be used at run-time.
+	 */
+	constexpr Configuration const*
+	find_configuration (uint8_t value) const;
+
   public:
 	USBVersion								usb_version;
 	VendorID								vendor_id;
@@ -246,9 +385,6 @@ template<Device const& pDevice>
 		constexpr String
 		string_for_index (uint8_t descriptor_index) const;
 
-		constexpr uint8_t
-		index_for_string (String) const;
-
 	  private:
 		constexpr StringsArray
 		collect_strings();
@@ -262,14 +398,26 @@ template<Device const& pDevice>
 
 constexpr
 Endpoint::Endpoint (Index index, Direction direction, TransferType transfer_type, SyncType sync_type,
-					UsageType usage_type, MaxPacketSize max_packet_size, Interval interval):
+					UsageType usage_type, MaxPacketSize max_packet_size, Interval interval, EndpointBuffer buffer):
+	Endpoint (index, direction, transfer_type, sync_type, usage_type, max_packet_size, interval, AudioEndpoint (false), ClassDescriptors(),
+			  buffer)
+{ }
+
+
+constexpr
+Endpoint::Endpoint (Index index, Direction direction, TransferType transfer_type, SyncType sync_type,
+					UsageType usage_type, MaxPacketSize max_packet_size, Interval interval,
+					AudioEndpoint audio_endpoint, ClassDescriptors class_descriptors, EndpointBuffer buffer):
 	index (index),
 	direction (direction),
 	transfer_type (transfer_type),
 	sync_type (sync_type),
 	usage_type (usage_type),
 	max_packet_size (max_packet_size),
-	interval (interval)
+	interval (interval),
+	audio_endpoint (audio_endpoint),
+	class_descriptors (class_descriptors),
+	buffer (buffer)
 {
 	// Ensure that endpoint 0 is not specified here:
 	if (*index == 0)
@@ -292,14 +440,66 @@ Endpoint::Endpoint (Index index, Direction direction, TransferType transfer_type
 			// Isochronous must use interval 1:
 			if (*interval != 1)
 				throw Use1ForInterval();
-
-			if (sync_type != SyncType::NoSync)
-				throw MustBeNoSync();
 			break;
 
 		case TransferType::Interrupt:
 			break;
 	}
+
+	// Only isochronous endpoints can use synchronization:
+	if (transfer_type != TransferType::Isochronous && sync_type != SyncType::NoSync)
+		throw MustBeNoSync();
+
+	if (*max_packet_size > (transfer_type == TransferType::Isochronous ? 1023 : 64))
+		throw InvalidMaxPacketSize();
+
+	if (transfer_type == TransferType::Control && ping_pong())
+		throw PingPongNotAllowed();
+}
+
+
+constexpr size_t
+Endpoint::descriptor_size() const
+{
+	// Audio endpoints have additional bRefresh and bSynchAddress fields:
+	return *audio_endpoint ? 9 : 7;
+}
+
+
+constexpr bool
+Endpoint::ping_pong() const
+{
+	return buffer == EndpointBuffer::PingPong || buffer == EndpointBuffer::ExternalPingPong;
+}
+
+
+constexpr bool
+Endpoint::pooled() const
+{
+	return buffer == EndpointBuffer::Single || buffer == EndpointBuffer::PingPong;
+}
+
+
+constexpr size_t
+Endpoint::bank_size() const
+{
+	size_t size = 8;
+
+	while (size < *max_packet_size)
+		size *= 2;
+
+	// Isochronous 1023-byte buffer gets 1024 bytes, so that next buffers stay aligned:
+	return size;
+}
+
+
+constexpr size_t
+Endpoint::buffers_size() const
+{
+	if (!pooled())
+		return 0;
+
+	return (ping_pong() ? 2 : 1) * bank_size();
 }
 
 
@@ -307,12 +507,21 @@ constexpr
 Interface::Interface (Index index, AlternateIndex alternate_index,
 					  DeviceClass interface_class, DeviceSubClass interface_sub_class, DeviceProtocol interface_protocol, String description,
 					  std::initializer_list<Endpoint> endpoints):
+	Interface (index, alternate_index, interface_class, interface_sub_class, interface_protocol, description, ClassDescriptors(), endpoints)
+{ }
+
+
+constexpr
+Interface::Interface (Index index, AlternateIndex alternate_index,
+					  DeviceClass interface_class, DeviceSubClass interface_sub_class, DeviceProtocol interface_protocol, String description,
+					  ClassDescriptors class_descriptors, std::initializer_list<Endpoint> endpoints):
 	index (index),
 	alternate_index (alternate_index),
 	interface_class (interface_class),
 	interface_sub_class (interface_sub_class),
 	interface_protocol (interface_protocol),
 	description (description),
+	class_descriptors (class_descriptors),
 	endpoints (endpoints)
 {
 	// Ensure that interface doesn't say the device class is interface-specified, because we're the interface:
@@ -321,6 +530,18 @@ Interface::Interface (Index index, AlternateIndex alternate_index,
 }
 
 
+constexpr size_t
+Interface::buffers_size() const
+{
+	size_t size = 0;
+
+	for (auto const& endpoint: endpoints)
+		size += endpoint.buffers_size();
+
+	return size;
+}
+
+
 constexpr
 Configuration::Configuration (ConfigurationValue value, String description, SelfPowered self_powered, RemoteWakeup remote_wakeup,
 							  MaxPowerMilliAmps max_power_milli_amps, std::initializer_list<Interface> interfaces):
@@ -334,27 +555,32 @@ Configuration::Configuration (ConfigurationValue value, String description, Self
 	if (*value == 0)
 		throw ConfigurationValueMustNotBe0();
 
-	// Ensure that interfaces are numbered sequentially from 0 as required by the USB standard:
-	auto interface = interfaces.begin();
+	// Ensure that interfaces are numbered sequentially from 0 as required by the USB standard,
+	// and that alternate settings of each interface follow it, also numbered sequentially from 0:
+	uint8_t next_index = 0;
+	uint8_t next_alternate_index = 0;
 
-	for (size_t i = 0; i < interfaces.size(); ++i, ++interface)
-	{
-		if (*interface->index != i)
-			throw InvalidIndexSequence();
-	}
-
-	// Ensure that this->alternate_index refers to an existing interface:
 	for (auto const& interface: interfaces)
 	{
-		bool const found = std::any_of (interfaces.begin(), interfaces.end(), [&](auto const& other) {
-			return *interface.alternate_index == *other.index;
-		});
+		if (*interface.alternate_index == 0)
+		{
+			if (*interface.index != next_index)
+				throw InvalidIndexSequence();
 
-		if (!found)
-			throw AlternateInterfaceIndexNotFound();
+			++next_index;
+			next_alternate_index = 1;
+		}
+		else
+		{
+			if (next_index == 0 || *interface.index != next_index - 1 || *interface.alternate_index != next_alternate_index)
+				throw InvalidIndexSequence();
+
+			++next_alternate_index;
+		}
 	}
 
-	// Ensure that endpoints with the same direction have unique indices within configuration:
+	// Ensure that endpoints with the same direction have unique indices within configuration. Different alternate
+	// settings of the same interface may reuse endpoints, since only one of them is active at a time:
 	for (auto const& interface: interfaces)
 	{
 		for (auto const& endpoint: interface.endpoints)
@@ -363,9 +589,18 @@ Configuration::Configuration (ConfigurationValue value, String description, Self
 			size_t number = 0;
 
 			for (auto const& other_interface: interfaces)
-				for (auto const& other_endpoint: other_interface.endpoints)
-					if (*endpoint.index == *other_endpoint.index && endpoint.direction == other_endpoint.direction)
-						++number;
+			{
+				bool const other_alternate = *interface.index == *other_interface.index &&
+											 *interface.alternate_index != *other_interface.alternate_index;
+
+				if (!other_alternate)
+					for (auto const& other_endpoint: other_interface.endpoints)
+						if (*endpoint.index == *other_endpoint.index &&
+							(endpoint.direction == other_endpoint.direction || endpoint.ping_pong() || other_endpoint.ping_pong()))
+						{
+							++number;
+						}
+			}
 
 			if (number != 1)
 				throw ConflictingEndpointIndices();
@@ -374,6 +609,52 @@ Configuration::Configuration (ConfigurationValue value, String description, Self
 }
 
 
+constexpr uint8_t
+Configuration::number_of_interfaces() const
+{
+	uint8_t n = 0;
+
+	for (auto const& interface: interfaces)
+		if (*interface.alternate_index == 0)
+			++n;
+
+	return n;
+}
+
+
+constexpr Interface const*
+Configuration::find_interface (uint8_t index, uint8_t alternate_index) const
+{
+	for (auto const& interface: interfaces)
+		if (*interface.index == index && *interface.alternate_index == alternate_index)
+			return &interface;
+
+	return nullptr;
+}
+
+
+constexpr size_t
+Configuration::buffers_size() const
+{
+	size_t size = 0;
+	size_t interface_size = 0;
+
+	for (auto const& interface: interfaces)
+	{
+		// Alternate settings always follow their interface:
+		if (*interface.alternate_index == 0)
+		{
+			size += interface_size;
+			interface_size = 0;
+		}
+
+		interface_size = std::max (interface_size, interface.buffers_size());
+	}
+
+	return size + interface_size;
+}
+
+
 constexpr
 Device::Device (USBVersion usb_version, VendorID vendor_id, ProductID product_id, ReleaseID release_id,
 				DeviceClass device_class, DeviceSubClass device_sub_class, DeviceProtocol device_protocol,
@@ -422,6 +703,30 @@ Device::maximum_endpoint_address() const
 }
 
 
+constexpr uint8_t
+Device::maximum_number_of_interfaces() const
+{
+	uint8_t max = 0;
+
+	for (auto const& configuration: configurations)
+		max = std::max (max, configuration.number_of_interfaces());
+
+	return max;
+}
+
+
+constexpr size_t
+Device::endpoint_buffers_size() const
+{
+	size_t max = 0;
+
+	for (auto const& configuration: configurations)
+		max = std::max (max, configuration.buffers_size());
+
+	return max;
+}
+
+
 constexpr size_t
 Device::max_string_index() const
 {
@@ -436,6 +741,25 @@ Device::max_string_index() const
 }
 
 
+constexpr uint8_t
+Device::configuration_string_index (uint8_t configuration_index) const
+{
+	uint8_t index = kSerialStringIndex + 1;
+
+	for (uint8_t c = 0; c < configuration_index; ++c)
+		index += 1 + (configurations.begin() + c)->interfaces.size();
+
+	return index;
+}
+
+
+constexpr uint8_t
+Device::interface_string_index (uint8_t configuration_index, uint8_t interface_position) const
+{
+	return configuration_string_index (configuration_index) + 1 + interface_position;
+}
+
+
 constexpr Configuration
 Device::configuration_for_index (uint8_t index) const
 {
@@ -469,6 +793,17 @@ Device::configuration_for_value (ConfigurationValue value) const
 }
 
 
+constexpr Configuration const*
+Device::find_configuration (uint8_t value) const
+{
+	for (auto const& configuration: configurations)
+		if (*configuration.value == value)
+			return &configuration;
+
+	return nullptr;
+}
+
+
 template<Device const& D>
 	constexpr
 	DeviceStrings<D>::DeviceStrings():
@@ -487,35 +822,24 @@ template<Device const& D>
 	}
 
 
-template<Device const& D>
-	constexpr uint8_t
-	DeviceStrings<D>::index_for_string (String string) const
-	{
-		for (uint8_t i = 0; i < strings.size(); ++i)
-			if (strings[i] == string)
-				return i + 1;
-
-		return 0;
-	}
-
-
 template<Device const& D>
 	constexpr auto
 	DeviceStrings<D>::collect_strings() -> StringsArray
 	{
 		StringsArray result;
-		size_t i = 0;
 
-		result[i++] = *device.manufacturer;
-		result[i++] = *device.product;
-		result[i++] = *device.serial;
+		result[Device::kManufacturerStringIndex - 1] = *device.manufacturer;
+		result[Device::kProductStringIndex - 1] = *device.product;
+		result[Device::kSerialStringIndex - 1] = *device.serial;
 
-		for (auto const& configuration: device.configurations)
+		for (uint8_t c = 0; c < device.configurations.size(); ++c)
 		{
-			result[i++] = configuration.description;
+			Configuration const& configuration = *(device.configurations.begin() + c);
+
+			result[device.configuration_string_index (c) - 1] = configuration.description;
 
-			for (auto const& interface: configuration.interfaces)
-				result[i++] = interface.description;
+			for (uint8_t i = 0; i < configuration.interfaces.size(); ++i)
+				result[device.interface_string_index (c, i) - 1] = (configuration.interfaces.begin() + i)->description;
 		}
 
 		return result;
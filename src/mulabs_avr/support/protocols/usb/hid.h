@@ -0,0 +1,750 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__SUPPORT__PROTOCOLS__HID_H__INCLUDED
+#define MULABS_AVR__SUPPORT__PROTOCOLS__HID_H__INCLUDED
+
+// Standard:
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Mulabs:
+#include <mulabs_avr/std/algorithm.h>
+#include <mulabs_avr/std/utility.h>
+#include <mulabs_avr/support/protocols/usb/bulk_endpoint.h>
+#include <mulabs_avr/support/protocols/usb/device_definition.h>
+#include <mulabs_avr/support/protocols/usb/setup_packet.h>
+#include <mulabs_avr/utility/array.h>
+#include <mulabs_avr/utility/atomic.h>
+#include <mulabs_avr/utility/flash_span.h>
+#include <mulabs_avr/utility/span.h>
+
+
+namespace mulabs {
+namespace avr {
+namespace usb {
+namespace hid {
+
+/**
+ * Class-specific descriptor types.
+ */
+enum class DescriptorType: uint8_t
+{
+	HID						= 0x21,
+	Report					= 0x22,
+};
+
+/**
+ * Class-specific requests.
+ */
+enum class Request: uint8_t
+{
+	GetReport				= 0x01,
+	GetIdle					= 0x02,
+	GetProtocol				= 0x03,
+	SetReport				= 0x09,
+	SetIdle					= 0x0a,
+	SetProtocol				= 0x0b,
+};
+
+/**
+ * Report types used in GET_REPORT/SET_REPORT (high byte of wValue).
+ */
+enum class ReportType: uint8_t
+{
+	Input					= 0x01,
+	Output					= 0x02,
+	Feature					= 0x03,
+};
+
+enum class Collection: uint8_t
+{
+	Physical				= 0x00,
+	Application				= 0x01,
+	Logical					= 0x02,
+};
+
+/**
+ * Flags for Input, Output and Feature items. Combine with |.
+ */
+struct ItemFlags
+{
+	enum: uint8_t
+	{
+		Data				= 0,
+		Constant			= 1u << 0,
+		Array				= 0,
+		Variable			= 1u << 1,
+		Absolute			= 0,
+		Relative			= 1u << 2,
+	};
+};
+
+
+/**
+ * Single short item of a report descriptor. Use the functions below to create items.
+ */
+struct Item
+{
+	uint8_t		prefix		= 0;	// Tag and type, without the size bits.
+	int32_t		value		= 0;
+	bool		has_data	= false;
+	bool		is_signed	= false;
+};
+
+
+namespace detail {
+
+constexpr Item
+make_item (uint8_t prefix, int32_t value, bool is_signed = false)
+{
+	Item item;
+	item.prefix = prefix;
+	item.value = value;
+	item.has_data = true;
+	item.is_signed = is_signed;
+	return item;
+}
+
+} // namespace detail
+
+
+// Main items:
+
+constexpr Item
+input (uint8_t flags)
+{
+	return detail::make_item (0x80, flags);
+}
+
+
+constexpr Item
+output (uint8_t flags)
+{
+	return detail::make_item (0x90, flags);
+}
+
+
+constexpr Item
+feature (uint8_t flags)
+{
+	return detail::make_item (0xb0, flags);
+}
+
+
+constexpr Item
+collection (Collection collection)
+{
+	return detail::make_item (0xa0, static_cast<uint8_t> (collection));
+}
+
+
+constexpr Item
+end_collection()
+{
+	Item item;
+	item.prefix = 0xc0;
+	return item;
+}
+
+
+// Global items:
+
+constexpr Item
+usage_page (uint16_t page)
+{
+	return detail::make_item (0x04, page);
+}
+
+
+constexpr Item
+logical_minimum (int32_t value)
+{
+	return detail::make_item (0x14, value, true);
+}
+
+
+constexpr Item
+logical_maximum (int32_t value)
+{
+	return detail::make_item (0x24, value, true);
+}
+
+
+constexpr Item
+report_size (uint8_t bits)
+{
+	return detail::make_item (0x74, bits);
+}
+
+
+constexpr Item
+report_id (uint8_t id)
+{
+	return detail::make_item (0x84, id);
+}
+
+
+constexpr Item
+report_count (uint8_t count)
+{
+	return detail::make_item (0x94, count);
+}
+
+
+// Local items:
+
+constexpr Item
+usage (uint16_t usage)
+{
+	return detail::make_item (0x08, usage);
+}
+
+
+constexpr Item
+usage_minimum (uint16_t usage)
+{
+	return detail::make_item (0x18, usage);
+}
+
+
+constexpr Item
+usage_maximum (uint16_t usage)
+{
+	return detail::make_item (0x28, usage);
+}
+
+
+namespace detail {
+
+/**
+ * Return number of data bytes needed for given item (0, 1, 2 or 4).
+ */
+constexpr uint8_t
+item_data_size (Item const& item)
+{
+	if (!item.has_data)
+		return 0;
+	else if (item.is_signed)
+		return (item.value >= -128 && item.value <= 127) ? 1 : (item.value >= -32768 && item.value <= 32767) ? 2 : 4;
+	else
+		return (static_cast<uint32_t> (item.value) <= 0xff) ? 1 : (static_cast<uint32_t> (item.value) <= 0xffff) ? 2 : 4;
+}
+
+
+template<size_t pItemsCount>
+	constexpr size_t
+	report_descriptor_size (Item const (&items)[pItemsCount])
+	{
+		size_t size = 0;
+
+		for (auto const& item: items)
+			size += 1 + item_data_size (item);
+
+		return size;
+	}
+
+
+template<size_t pSize, size_t pItemsCount>
+	constexpr Array<uint8_t, pSize>
+	make_report_descriptor (Item const (&items)[pItemsCount])
+	{
+		Array<uint8_t, pSize> result { };
+		size_t position = 0;
+
+		for (auto const& item: items)
+		{
+			uint8_t const data_size = item_data_size (item);
+			// Size code 0b11 means 4 bytes:
+			result[position++] = item.prefix | (data_size == 4 ? 0b11 : data_size);
+
+			for (uint8_t i = 0; i < data_size; ++i)
+				result[position++] = static_cast<uint32_t> (item.value) >> (8 * i);
+		}
+
+		return result;
+	}
+
+} // namespace detail
+
+
+/**
+ * Report descriptor built at compile time from a constexpr list of items and stored in program memory,
+ * along with the HID class descriptor that refers to it.
+ *
+ * Usage:
+ *   constexpr usb::hid::Item kMouseItems[] = {
+ *       usb::hid::usage_page (0x01), usb::hid::usage (0x02), usb::hid::collection (usb::hid::Collection::Application),
+ *       …
+ *       usb::hid::end_collection(),
+ *   };
+ *   using MouseReportDescriptor = usb::hid::ReportDescriptor<kMouseItems>;
+ *
+ * Then use MouseReportDescriptor::class_descriptors() as ClassDescriptors of the HID interface.
+ */
+template<auto const& pItems>
+	class ReportDescriptor
+	{
+	  public:
+		static constexpr size_t	kSize	= detail::report_descriptor_size (pItems);
+
+	  public:
+		/**
+		 * Return the HID class descriptor for use in interface definition.
+		 */
+		static constexpr ClassDescriptors
+		class_descriptors();
+
+		/**
+		 * Return the report descriptor.
+		 */
+		static FlashSpan
+		report_descriptor();
+
+		/**
+		 * Return the HID class descriptor.
+		 */
+		static FlashSpan
+		hid_descriptor();
+
+	  public:
+		static constexpr Array<uint8_t, kSize> report_data PROGMEM = detail::make_report_descriptor<kSize> (pItems);
+
+		static constexpr uint8_t hid_data[9] PROGMEM = {
+			9,											// bLength
+			static_cast<uint8_t> (DescriptorType::HID),	// bDescriptorType
+			0x11, 0x01,									// bcdHID 1.11
+			0x00,										// bCountryCode
+			1,											// bNumDescriptors
+			static_cast<uint8_t> (DescriptorType::Report),
+			static_cast<uint8_t> (kSize & 0xff),		// wDescriptorLength
+			static_cast<uint8_t> (kSize >> 8),
+		};
+	};
+
+
+template<auto const& I>
+	constexpr ClassDescriptors
+	ReportDescriptor<I>::class_descriptors()
+	{
+		return ClassDescriptors (hid_data);
+	}
+
+
+template<auto const& I>
+	inline FlashSpan
+	ReportDescriptor<I>::report_descriptor()
+	{
+		return FlashSpan (report_data);
+	}
+
+
+template<auto const& I>
+	inline FlashSpan
+	ReportDescriptor<I>::hid_descriptor()
+	{
+		return FlashSpan (hid_data, sizeof (hid_data));
+	}
+
+} // namespace hid
+
+
+/**
+ * HID class driver with a single input report sent over an interrupt IN endpoint.
+ *
+ * The IN endpoint works in ping-pong mode, with the input report struct living directly in the endpoint banks:
+ * next_report() returns the bank that's free, user fills it in place and calls send_report() to hand it over to the
+ * SIE, so there's no copying between report update and the moment the report can be sent. The bank returned by
+ * next_report() contains a report from two reports ago, so it needs to be filled in completely. Ping-pong uses both
+ * directions of the endpoint number and the banks are held here, so define the endpoint with
+ * EndpointBuffer::ExternalPingPong. For lowest latency define the endpoint as TransferType::Interrupt with
+ * Interval (1), so that the host polls it every frame (1 ms).
+ *
+ * Also handles GET_DESCRIPTOR for the HID and report descriptors, GET_REPORT/SET_REPORT, GET_IDLE/SET_IDLE and
+ * GET_PROTOCOL/SET_PROTOCOL. The idle rate is handled in handle_start_of_frame(). It repeats the last report through
+ * the same banks, so it's held off between next_report() and send_report(): after next_report() returned a report,
+ * always call send_report().
+ *
+ * \param	pReportDescriptor
+ *			hid::ReportDescriptor<> class.
+ * \param	pInputReport
+ *			Input report struct, must match the report descriptor.
+ * \param	pOutputReportSize
+ *			Size of output reports accepted by SET_REPORT (0 if there are none).
+ */
+template<class pInputEndpoint, class pReportDescriptor, class pInputReport, size_t pOutputReportSize = 0>
+	class HID
+	{
+	  public:
+		using InputEndpoint			= pInputEndpoint;
+		using Endpoint				= typename InputEndpoint::Endpoint;
+		using ReportDescriptorType	= pReportDescriptor;
+		using InputReport			= pInputReport;
+
+		static constexpr size_t	kInputReportSize	= sizeof (InputReport);
+		static constexpr size_t	kOutputReportSize	= pOutputReportSize;
+		static constexpr size_t	kPacketSize			= kInputReportSize <= 8 ? 8 : kInputReportSize <= 16 ? 16 : kInputReportSize <= 32 ? 32 : 64;
+
+		static_assert (kInputReportSize <= 64, "input report must fit in a single packet");
+
+	  public:
+		// Ctor
+		template<class EndpointsTable>
+			explicit constexpr
+			HID (EndpointsTable&, uint8_t interface, uint8_t endpoint);
+
+		// Copy ctor
+		HID (HID const&) = delete;
+
+		// Copy operator
+		HID const&
+		operator= (HID const&) = delete;
+
+		/**
+		 * Configure the endpoint. Called automatically by handle_request() when host sets configuration,
+		 * can also be called manually.
+		 */
+		void
+		initialize();
+
+		/**
+		 * Return true after the endpoint was configured.
+		 */
+		bool
+		configured() const;
+
+		/**
+		 * Handle HID requests, register the driver with State::set_interface_handler() for its interface.
+		 * Return true if request was handled.
+		 */
+		template<class Transfer>
+			bool
+			handle_request (SetupPacket const&, Span<uint8_t> output_data, Transfer&);
+
+		/**
+		 * Handle idle rate. Call from the USB interrupt handler on each SOF.
+		 */
+		void
+		handle_start_of_frame();
+
+		/**
+		 * Return input report to be filled in place, or nullptr if both banks wait to be sent to the host.
+		 * Idle repeats are held off until send_report() is called.
+		 */
+		InputReport*
+		next_report();
+
+		/**
+		 * Send the report returned by next_report().
+		 */
+		void
+		send_report();
+
+		/**
+		 * Return last output report received with SET_REPORT.
+		 */
+		Span<uint8_t const>
+		output_report() const;
+
+		/**
+		 * Return true if an output report was received since last call.
+		 */
+		bool
+		output_report_received();
+
+		/**
+		 * Return current protocol: 0 - boot protocol, 1 - report protocol.
+		 */
+		uint8_t
+		protocol() const;
+
+	  private:
+		InputReport&
+		report_in_bank (uint8_t bank);
+
+		/**
+		 * Return true if the SIE already sent the fill bank.
+		 */
+		bool
+		fill_bank_free() const;
+
+		/**
+		 * Give the fill bank to the SIE and switch to the other one.
+		 */
+		void
+		arm_fill_bank();
+
+	  private:
+		InputEndpoint										_bank_0;
+		InputEndpoint										_bank_1;
+		Array<Array<uint8_t, kInputReportSize>, 2>			_banks;
+		Array<uint8_t, (kOutputReportSize > 0 ? kOutputReportSize : 1)>
+															_output_report;
+		uint8_t												_interface;
+		Atomic<uint8_t>										_fill_bank				{ 0 };
+		uint8_t												_idle_rate				{ 0 };	// In 4 ms units.
+		uint16_t											_frames_since_report	{ 0 };
+		uint8_t												_protocol				{ 1 };
+		bool												_report_sent			{ false };
+		Atomic<bool>										_filling				{ false };	// Between next_report() and send_report().
+		bool												_output_report_received	{ false };
+		bool												_configured				{ false };
+	};
+
+
+template<class IE, class RD, class IR, size_t O>
+	template<class EndpointsTable>
+		constexpr
+		HID<IE, RD, IR, O>::HID (EndpointsTable& table, uint8_t interface, uint8_t endpoint):
+			_bank_0 (table.nth_input (endpoint)),
+			_bank_1 (table.nth_output (endpoint)),
+			_interface (interface)
+		{ }
+
+
+template<class IE, class RD, class IR, size_t O>
+	inline void
+	HID<IE, RD, IR, O>::initialize()
+	{
+		_banks[0].fill (0);
+		_banks[1].fill (0);
+		_fill_bank.store (0);
+		_frames_since_report = 0;
+		_report_sent = false;
+		_filling.store (false);
+
+		_bank_1.initialize();
+		_bank_1.set_buffer (_banks[1].data());
+
+		_bank_0.initialize();
+		// Interrupt endpoints are configured the same way as bulk ones:
+		_bank_0.set (Endpoint::Type::Bulk);
+		_bank_0.set_buffer (_banks[0].data(), usb::detail::bulk_buffer_size<Endpoint, kPacketSize>());
+		_bank_0.set_ping_pong_enabled (true);
+		_bank_0.set_azlp_enabled (false);
+		_bank_0.set_nack_all (Endpoint::Buffer::_0, true);
+		_bank_0.set_nack_all (Endpoint::Buffer::_1, true);
+		// Reports always have the same size:
+		_bank_0.set_transaction_size (kInputReportSize);
+		_bank_1.set_transaction_size (kInputReportSize);
+
+		_configured = true;
+	}
+
+
+template<class IE, class RD, class IR, size_t O>
+	inline bool
+	HID<IE, RD, IR, O>::configured() const
+	{
+		return _configured;
+	}
+
+
+template<class IE, class RD, class IR, size_t O>
+	template<class Transfer>
+		inline bool
+		HID<IE, RD, IR, O>::handle_request (SetupPacket const& setup, Span<uint8_t> output_data, Transfer& transfer)
+		{
+			auto const& request = setup.request.class_request;
+
+			if (setup.type == SetupPacket::Type::Standard)
+			{
+				if (setup.recipient == SetupPacket::Recipient::Device &&
+					setup.request.device.type == SetupPacket::DeviceRequest::Type::SetConfiguration)
+				{
+					// Let the standard handling take place too:
+					if (setup.request.device.set_configuration.configuration_value != 0)
+						initialize();
+					else
+						_configured = false;
+				}
+				else if (setup.recipient == SetupPacket::Recipient::Interface && request.index == _interface &&
+						 setup.request.device.type == SetupPacket::DeviceRequest::Type::GetDescriptor)
+				{
+					switch (static_cast<hid::DescriptorType> (request.value >> 8))
+					{
+						case hid::DescriptorType::HID:
+							transfer.set_transfer_data (ReportDescriptorType::hid_descriptor());
+							return true;
+
+						case hid::DescriptorType::Report:
+							transfer.set_transfer_data (ReportDescriptorType::report_descriptor());
+							return true;
+
+						default:
+							break;
+					}
+				}
+
+				return false;
+			}
+
+			if (setup.type != SetupPacket::Type::Class || setup.recipient != SetupPacket::Recipient::Interface || request.index != _interface)
+				return false;
+
+			switch (static_cast<hid::Request> (request.type))
+			{
+				case hid::Request::GetReport:
+					if (static_cast<hid::ReportType> (request.value >> 8) != hid::ReportType::Input)
+						return false;
+
+					// Return the last report handed over to the SIE:
+					memcpy (transfer.buffer().data(), _banks[_fill_bank.load() ^ 1].data(), kInputReportSize);
+					transfer.set_transfer_size (kInputReportSize);
+					return true;
+
+				case hid::Request::SetReport:
+					if constexpr (kOutputReportSize > 0)
+					{
+						if (static_cast<hid::ReportType> (request.value >> 8) != hid::ReportType::Output)
+							return false;
+
+						memcpy (_output_report.data(), output_data.data(), std::min (output_data.size(), kOutputReportSize));
+						_output_report_received = true;
+						return true;
+					}
+					else
+						return false;
+
+				case hid::Request::GetIdle:
+					transfer.buffer()[0] = _idle_rate;
+					transfer.set_transfer_size (1);
+					return true;
+
+				case hid::Request::SetIdle:
+					_idle_rate = request.value >> 8;
+					_frames_since_report = 0;
+					return true;
+
+				case hid::Request::GetProtocol:
+					transfer.buffer()[0] = _protocol;
+					transfer.set_transfer_size (1);
+					return true;
+
+				case hid::Request::SetProtocol:
+					_protocol = request.value & 0xff;
+					return true;
+
+				default:
+					return false;
+			}
+		}
+
+
+template<class IE, class RD, class IR, size_t O>
+	inline void
+	HID<IE, RD, IR, O>::handle_start_of_frame()
+	{
+		// While user fills a report, the fill bank and _frames_since_report belong to the main loop. The SIE sends
+		// banks alternately, so the repeat can't go to the other bank either; just wait for send_report():
+		if (!_configured || _idle_rate == 0 || !_report_sent || _filling.load())
+			return;
+
+		// Idle rate is in 4 ms units. If there was no new report for that long, repeat the last one:
+		if (++_frames_since_report >= 4u * _idle_rate)
+		{
+			if (fill_bank_free())
+			{
+				uint8_t const fill_bank = _fill_bank.load();
+				memcpy (_banks[fill_bank].data(), _banks[fill_bank ^ 1].data(), kInputReportSize);
+				arm_fill_bank();
+				_frames_since_report = 0;
+			}
+		}
+	}
+
+
+template<class IE, class RD, class IR, size_t O>
+	inline auto
+	HID<IE, RD, IR, O>::next_report() -> InputReport*
+	{
+		// Hold off idle repeats before looking at the fill bank:
+		_filling.store (true);
+
+		if (_configured && fill_bank_free())
+			return &report_in_bank (_fill_bank.load());
+
+		_filling.store (false);
+		return nullptr;
+	}
+
+
+template<class IE, class RD, class IR, size_t O>
+	inline void
+	HID<IE, RD, IR, O>::send_report()
+	{
+		arm_fill_bank();
+		_frames_since_report = 0;
+		_report_sent = true;
+		_filling.store (false);
+	}
+
+
+template<class IE, class RD, class IR, size_t O>
+	inline Span<uint8_t const>
+	HID<IE, RD, IR, O>::output_report() const
+	{
+		return { _output_report.data(), kOutputReportSize };
+	}
+
+
+template<class IE, class RD, class IR, size_t O>
+	inline bool
+	HID<IE, RD, IR, O>::output_report_received()
+	{
+		return std::exchange (_output_report_received, false);
+	}
+
+
+template<class IE, class RD, class IR, size_t O>
+	inline uint8_t
+	HID<IE, RD, IR, O>::protocol() const
+	{
+		return _protocol;
+	}
+
+
+template<class IE, class RD, class IR, size_t O>
+	inline auto
+	HID<IE, RD, IR, O>::report_in_bank (uint8_t bank) -> InputReport&
+	{
+		return _banks[bank].template as<InputReport>();
+	}
+
+
+template<class IE, class RD, class IR, size_t O>
+	inline bool
+	HID<IE, RD, IR, O>::fill_bank_free() const
+	{
+		// SIE sets NACK flag after the bank was sent:
+		return _bank_0.is_nack_all (_fill_bank.load() == 0 ? Endpoint::Buffer::_0 : Endpoint::Buffer::_1);
+	}
+
+
+template<class IE, class RD, class IR, size_t O>
+	inline void
+	HID<IE, RD, IR, O>::arm_fill_bank()
+	{
+		uint8_t const fill_bank = _fill_bank.load();
+		// Transaction size is already set in initialize(), only give the bank to the SIE:
+		_bank_0.set_ready (fill_bank == 0 ? Endpoint::Buffer::_0 : Endpoint::Buffer::_1);
+		_fill_bank.store (fill_bank ^ 1);
+	}
+
+} // namespace usb
+} // namespace avr
+} // namespace mulabs
+
+#endif
+
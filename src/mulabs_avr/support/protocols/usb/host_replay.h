@@ -0,0 +1,583 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__SUPPORT__PROTOCOLS__HOST_REPLAY_H__INCLUDED
+#define MULABS_AVR__SUPPORT__PROTOCOLS__HOST_REPLAY_H__INCLUDED
+
+// Standard:
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Mulabs:
+#include <mulabs_avr/avr/host_register_file.h>
+#include <mulabs_avr/std/algorithm.h>
+#include <mulabs_avr/utility/array.h>
+#include <mulabs_avr/utility/span.h>
+#include <mulabs_avr/utility/trace.h>
+
+
+namespace mulabs {
+namespace avr {
+namespace usb {
+
+/**
+ * Single step of a recorded control-pipe session: either a bus reset or a complete control transfer
+ * (SETUP, optional DATA stage, STATUS stage).
+ */
+struct ReplayStep
+{
+	enum class Expect: uint8_t
+	{
+		Any,		// Don't check the outcome
+		Ack,		// Transfer must complete
+		Stall,		// Transfer must be answered with STALL
+	};
+
+	bool					bus_reset		{ false };
+	uint8_t					request_type	{ 0 };
+	uint8_t					request			{ 0 };
+	uint16_t				value			{ 0 };
+	uint16_t				index			{ 0 };
+	uint16_t				length			{ 0 };
+	// Data sent in the OUT data stage of host-to-device requests (length should be equal to its size):
+	Span<uint8_t const>		out_data;
+	Expect					expect			{ Expect::Ack };
+
+	/**
+	 * Make a step that does a control transfer with given Setup packet.
+	 */
+	static constexpr ReplayStep
+	setup (uint8_t request_type, uint8_t request, uint16_t value, uint16_t index, uint16_t length, Expect = Expect::Ack);
+
+	/**
+	 * Make a step that does a control transfer with given Setup packet and OUT data stage.
+	 */
+	static constexpr ReplayStep
+	setup (uint8_t request_type, uint8_t request, uint16_t value, uint16_t index, Span<uint8_t const> out_data, Expect = Expect::Ack);
+
+	/**
+	 * Make a bus reset step.
+	 */
+	static constexpr ReplayStep
+	reset();
+};
+
+
+constexpr ReplayStep
+ReplayStep::setup (uint8_t request_type, uint8_t request, uint16_t value, uint16_t index, uint16_t length, Expect expect)
+{
+	ReplayStep step;
+	step.request_type = request_type;
+	step.request = request;
+	step.value = value;
+	step.index = index;
+	step.length = length;
+	step.expect = expect;
+	return step;
+}
+
+
+constexpr ReplayStep
+ReplayStep::setup (uint8_t request_type, uint8_t request, uint16_t value, uint16_t index, Span<uint8_t const> out_data, Expect expect)
+{
+	ReplayStep step = setup (request_type, request, value, index, out_data.size(), expect);
+	step.out_data = out_data;
+	return step;
+}
+
+
+constexpr ReplayStep
+ReplayStep::reset()
+{
+	ReplayStep step;
+	step.bus_reset = true;
+	step.expect = Expect::Any;
+	return step;
+}
+
+
+/**
+ * Outcome of a single ReplayStep.
+ */
+struct ReplayResult
+{
+	// Violations of the USB protocol (or of the expectation of the step) detected during the step:
+	enum Violation: uint8_t
+	{
+		NoResponse		= 1u << 0,	// Device NAK-ed a token for good (real host would time out)
+		DataOverrun		= 1u << 1,	// IN data stage was longer than wLength
+		PacketTooLong	= 1u << 2,	// IN packet was longer than EP0 max packet size
+		BadStatusStage	= 1u << 3,	// IN packet in the status stage wasn't a ZLP
+		EarlyAddress	= 1u << 4,	// SET_ADDRESS took effect before its status stage completed
+		AddressNotSet	= 1u << 5,	// SET_ADDRESS didn't take effect after its status stage completed
+		UnexpectedStall	= 1u << 6,	// Step expected Ack, but got a STALL
+		ExpectedStall	= 1u << 7,	// Step expected Stall, but transfer completed
+	};
+
+	// Register accesses (including endpoint descriptors in SRAM) done in the interrupt handler during the step:
+	HostRegisterFile::Traffic	traffic;
+	// Number of interrupts handled during the step:
+	size_t						interrupts		{ 0 };
+	// Total bytes received in the IN data stage:
+	size_t						in_size			{ 0 };
+	bool						stalled			{ false };
+	// Bitwise-or of Violation flags:
+	uint8_t						violations		{ 0 };
+};
+
+
+/**
+ * Control-pipe sessions recorded from real hosts enumerating a full-speed device.
+ * Host asks for wTotalLength of the configuration descriptor first, here it's replaced by asking for 255 bytes
+ * (which is also what Windows does), so that the same recording works with any device. The device must have
+ * a configuration with value 1.
+ */
+struct RecordedEnumerations
+{
+	using Expect = ReplayStep::Expect;
+
+	// Linux (usbcore, "new" enumeration scheme):
+	static constexpr ReplayStep linux_host[] = {
+		ReplayStep::reset(),
+		ReplayStep::setup (0x80, 0x06, 0x0100, 0x0000, 64),		// GET_DESCRIPTOR Device
+		ReplayStep::reset(),
+		ReplayStep::setup (0x00, 0x05, 0x0001, 0x0000, 0),		// SET_ADDRESS 1
+		ReplayStep::setup (0x80, 0x06, 0x0100, 0x0000, 18),		// GET_DESCRIPTOR Device
+		ReplayStep::setup (0x80, 0x06, 0x0200, 0x0000, 9),		// GET_DESCRIPTOR Configuration
+		ReplayStep::setup (0x80, 0x06, 0x0200, 0x0000, 255),	// GET_DESCRIPTOR Configuration
+		ReplayStep::setup (0x80, 0x06, 0x0300, 0x0000, 255),	// GET_DESCRIPTOR String 0
+		ReplayStep::setup (0x80, 0x06, 0x0302, 0x0409, 255),	// GET_DESCRIPTOR String Product
+		ReplayStep::setup (0x80, 0x06, 0x0301, 0x0409, 255),	// GET_DESCRIPTOR String Manufacturer
+		ReplayStep::setup (0x80, 0x06, 0x0303, 0x0409, 255),	// GET_DESCRIPTOR String Serial
+		ReplayStep::setup (0x00, 0x09, 0x0001, 0x0000, 0),		// SET_CONFIGURATION 1
+	};
+
+	// Windows 10 (usbhub3):
+	static constexpr ReplayStep windows_host[] = {
+		ReplayStep::reset(),
+		ReplayStep::setup (0x80, 0x06, 0x0100, 0x0000, 64),		// GET_DESCRIPTOR Device
+		ReplayStep::reset(),
+		ReplayStep::setup (0x00, 0x05, 0x0002, 0x0000, 0),		// SET_ADDRESS 2
+		ReplayStep::setup (0x80, 0x06, 0x0100, 0x0000, 18),		// GET_DESCRIPTOR Device
+		ReplayStep::setup (0x80, 0x06, 0x0200, 0x0000, 255),	// GET_DESCRIPTOR Configuration
+		ReplayStep::setup (0x80, 0x06, 0x0303, 0x0409, 255),	// GET_DESCRIPTOR String Serial
+		ReplayStep::setup (0x80, 0x06, 0x0300, 0x0000, 255),	// GET_DESCRIPTOR String 0
+		ReplayStep::setup (0x80, 0x06, 0x0302, 0x0409, 255),	// GET_DESCRIPTOR String Product
+		ReplayStep::setup (0x80, 0x06, 0x0600, 0x0000, 10,		// GET_DESCRIPTOR Device Qualifier
+						   Expect::Stall),						// (full-speed only devices must STALL it)
+		ReplayStep::setup (0x80, 0x06, 0x0100, 0x0000, 18),		// GET_DESCRIPTOR Device
+		ReplayStep::setup (0x80, 0x06, 0x0200, 0x0000, 9),		// GET_DESCRIPTOR Configuration
+		ReplayStep::setup (0x80, 0x06, 0x0200, 0x0000, 255),	// GET_DESCRIPTOR Configuration
+		ReplayStep::setup (0x80, 0x00, 0x0000, 0x0000, 2),		// GET_STATUS Device
+		ReplayStep::setup (0x00, 0x09, 0x0001, 0x0000, 0),		// SET_CONFIGURATION 1
+	};
+};
+
+
+/**
+ * Off-target test harness for the default control pipe, for use with HostMCU. Plays the role of both the USB host
+ * and the SIE: replays ReplaySteps by putting packets into the EP0 buffers, updating EP0 descriptors in the endpoints
+ * table the same way the SIE would (setup/transaction-complete flags, counters, NACK and STALL handshakes)
+ * and calling SetupConductor::handle_interrupt() as the USB interrupt would.
+ *
+ * For each step it reports how much work the interrupt handler did (register traffic counted by HostRegisterFile
+ * and number of interrupts, since there are no cycle counts off-target) and flags protocol violations.
+ *
+ * Example:
+ *
+ *   usb::HostReplay replay (conductor, table.table(), input_buffer, output_buffer);
+ *   auto summary = replay.replay (usb::RecordedEnumerations::linux_host, [] (auto const& step, auto const& result) {
+ *       printf ("%02x %02x: %zu reads, %zu writes\n", step.request_type, step.request, result.traffic.reads, result.traffic.writes);
+ *   });
+ *   // summary.violations should be 0.
+ *
+ * \param	pSetupConductor
+ *			SetupConductor instantiated for HostMCU.
+ */
+template<class pSetupConductor>
+	class HostReplay
+	{
+	  public:
+		using SetupConductorType = pSetupConductor;
+
+		// Bytes of the IN data stage kept for inspection (see received()):
+		static constexpr size_t kMaxReceivedSize = 1024;
+
+	  private:
+		using SIEEndpoint = typename SetupConductorType::USBSIE::Endpoint;
+
+		// Offsets of registers within the endpoint descriptor (see BasicUSBSIEEndpoint), register bits
+		// are taken from SIEEndpoint:
+		static constexpr size_t		kStatus						= 0;
+		static constexpr size_t		kCtrl						= 1;
+		static constexpr size_t		kCnt						= 2;
+		static constexpr uint16_t	kCntMask					= 0x03ff;
+
+		enum class Token
+		{
+			Sent,		// Transaction completed
+			Nak,		// Endpoint wasn't ready
+			Stall,		// Endpoint answered with STALL
+		};
+
+	  public:
+		// Ctor
+		explicit
+		HostReplay (SetupConductorType&, uint8_t* endpoints_table, Span<uint8_t> input_buffer, Span<uint8_t> output_buffer);
+
+		/**
+		 * Run given step and return its result.
+		 */
+		ReplayResult
+		run (ReplayStep const&);
+
+		/**
+		 * Run all steps, call callback (ReplayStep const&, ReplayResult const&) after each one.
+		 * Return summary of all steps: sum of traffic, interrupts and IN data sizes, bitwise-or of violations.
+		 * Stalled is true if any of the steps was stalled.
+		 */
+		template<size_t N, class Callback>
+			ReplayResult
+			replay (ReplayStep const (&steps)[N], Callback&&);
+
+		/**
+		 * Return data received in the IN data stage of the last step (no more than kMaxReceivedSize bytes).
+		 */
+		Span<uint8_t const>
+		received() const noexcept;
+
+	  private:
+		/**
+		 * Deliver SETUP transaction to EP0.
+		 */
+		void
+		setup (ReplayStep const&, ReplayResult&);
+
+		/**
+		 * Send IN token to EP0, append received data (if any) to the received buffer.
+		 * Return handshake; set packet_size to size of the received packet.
+		 */
+		Token
+		in (ReplayResult&, size_t& packet_size);
+
+		/**
+		 * Deliver OUT transaction with given data to EP0.
+		 */
+		Token
+		out (Span<uint8_t const> data, ReplayResult&);
+
+		/**
+		 * Call the interrupt handler, count its register traffic.
+		 */
+		void
+		interrupt (ReplayResult&);
+
+		uint8_t*
+		input_endpoint() const noexcept;
+
+		uint8_t*
+		output_endpoint() const noexcept;
+
+		static uint16_t
+		count (uint8_t const* endpoint) noexcept;
+
+		static void
+		set_count (uint8_t* endpoint, uint16_t) noexcept;
+
+	  private:
+		SetupConductorType&					_conductor;
+		uint8_t*							_endpoints_table;
+		Span<uint8_t>						_input_buffer;
+		Span<uint8_t>						_output_buffer;
+		Array<uint8_t, kMaxReceivedSize>	_received			{ };
+		size_t								_received_size		{ 0 };
+	};
+
+
+template<class C>
+	inline
+	HostReplay<C>::HostReplay (SetupConductorType& conductor, uint8_t* endpoints_table, Span<uint8_t> input_buffer, Span<uint8_t> output_buffer):
+		_conductor (conductor),
+		_endpoints_table (endpoints_table),
+		_input_buffer (input_buffer),
+		_output_buffer (output_buffer)
+	{ }
+
+
+template<class C>
+	inline ReplayResult
+	HostReplay<C>::run (ReplayStep const& step)
+	{
+		ReplayResult result;
+		_received_size = 0;
+
+		if (step.bus_reset)
+		{
+			// SIE resets the address on bus reset:
+			SetupConductorType::usb_sie.set_address (0);
+			HostRegisterFile::Probe probe (result.traffic);
+			_conductor.reset();
+			return result;
+		}
+
+		bool const device_to_host = step.request_type & 0x80;
+		bool const set_address = step.request_type == 0x00 && step.request == 0x05;
+		uint8_t const old_address = SetupConductorType::usb_sie.address();
+
+		setup (step, result);
+
+		auto stalled = [&] (Token token) {
+			if (token == Token::Stall)
+				result.stalled = true;
+			else if (token == Token::Nak)
+				result.violations |= ReplayResult::NoResponse;
+
+			return token != Token::Sent;
+		};
+
+		// Data and status stages:
+		if (device_to_host)
+		{
+			size_t const max_packet_size = _input_buffer.size();
+
+			while (true)
+			{
+				size_t packet_size = 0;
+
+				if (stalled (in (result, packet_size)))
+					break;
+
+				if (packet_size > max_packet_size)
+					result.violations |= ReplayResult::PacketTooLong;
+
+				if (result.in_size > step.length)
+					result.violations |= ReplayResult::DataOverrun;
+
+				// Data stage ends with a short packet or when host got all it asked for:
+				if (packet_size < max_packet_size || result.in_size >= step.length)
+				{
+					static_cast<void> (stalled (out (Span<uint8_t const>(), result)));
+					break;
+				}
+			}
+		}
+		else
+		{
+			bool data_ok = true;
+
+			for (Span<uint8_t const> data = step.out_data; !data.empty(); )
+			{
+				Span<uint8_t const> packet (data.data(), std::min (data.size(), _output_buffer.size()));
+				data.remove_prefix (packet.size());
+
+				if (stalled (out (packet, result)))
+				{
+					data_ok = false;
+					break;
+				}
+			}
+
+			if (data_ok)
+			{
+				// New address must not be used until the status stage completes:
+				if (set_address && SetupConductorType::usb_sie.address() != old_address)
+					result.violations |= ReplayResult::EarlyAddress;
+
+				size_t packet_size = 0;
+				Token const token = in (result, packet_size);
+
+				if (!stalled (token))
+				{
+					if (packet_size != 0)
+						result.violations |= ReplayResult::BadStatusStage;
+				}
+			}
+		}
+
+		if (set_address && !result.stalled)
+			if (SetupConductorType::usb_sie.address() != (step.value & 0x7f))
+				result.violations |= ReplayResult::AddressNotSet;
+
+		switch (step.expect)
+		{
+			case ReplayStep::Expect::Any:
+				break;
+
+			case ReplayStep::Expect::Ack:
+				if (result.stalled)
+					result.violations |= ReplayResult::UnexpectedStall;
+				break;
+
+			case ReplayStep::Expect::Stall:
+				if (!result.stalled)
+					result.violations |= ReplayResult::ExpectedStall;
+				break;
+		}
+
+		return result;
+	}
+
+
+template<class C>
+	template<size_t N, class Callback>
+		inline ReplayResult
+		HostReplay<C>::replay (ReplayStep const (&steps)[N], Callback&& callback)
+		{
+			ReplayResult summary;
+
+			for (auto const& step: steps)
+			{
+				ReplayResult const result = run (step);
+				callback (step, result);
+
+				summary.traffic.reads += result.traffic.reads;
+				summary.traffic.writes += result.traffic.writes;
+				summary.interrupts += result.interrupts;
+				summary.in_size += result.in_size;
+				summary.stalled |= result.stalled;
+				summary.violations |= result.violations;
+			}
+
+			return summary;
+		}
+
+
+template<class C>
+	inline Span<uint8_t const>
+	HostReplay<C>::received() const noexcept
+	{
+		return { _received.data(), _received_size };
+	}
+
+
+template<class C>
+	inline void
+	HostReplay<C>::setup (ReplayStep const& step, ReplayResult& result)
+	{
+		uint8_t const packet[8] = {
+			step.request_type, step.request,
+			static_cast<uint8_t> (step.value), static_cast<uint8_t> (step.value >> 8),
+			static_cast<uint8_t> (step.index), static_cast<uint8_t> (step.index >> 8),
+			static_cast<uint8_t> (step.length), static_cast<uint8_t> (step.length >> 8),
+		};
+
+		// SETUP transactions are always accepted, even if the endpoint is stalled or NACK-ing:
+		uint8_t* const endpoint = output_endpoint();
+		memcpy (_output_buffer.data(), packet, sizeof (packet));
+		set_count (endpoint, sizeof (packet));
+		endpoint[kStatus] |= SIEEndpoint::kSetupTransactionComplete | SIEEndpoint::kBusNack0;
+		interrupt (result);
+	}
+
+
+template<class C>
+	inline auto
+	HostReplay<C>::in (ReplayResult& result, size_t& packet_size) -> Token
+	{
+		uint8_t* const endpoint = input_endpoint();
+
+		if (endpoint[kCtrl] & SIEEndpoint::kControlStall)
+		{
+			endpoint[kStatus] |= SIEEndpoint::kStall;
+			return Token::Stall;
+		}
+
+		if (endpoint[kStatus] & SIEEndpoint::kBusNack0)
+			return Token::Nak;
+
+		packet_size = count (endpoint) & kCntMask;
+		size_t const to_copy = std::min (std::min (packet_size, _input_buffer.size()), kMaxReceivedSize - _received_size);
+		memcpy (_received.data() + _received_size, _input_buffer.data(), to_copy);
+		_received_size += to_copy;
+		result.in_size += packet_size;
+
+		endpoint[kStatus] |= SIEEndpoint::kTransactionComplete | SIEEndpoint::kBusNack0;
+		interrupt (result);
+		return Token::Sent;
+	}
+
+
+template<class C>
+	inline auto
+	HostReplay<C>::out (Span<uint8_t const> data, ReplayResult& result) -> Token
+	{
+		uint8_t* const endpoint = output_endpoint();
+
+		if (endpoint[kCtrl] & SIEEndpoint::kControlStall)
+		{
+			endpoint[kStatus] |= SIEEndpoint::kStall;
+			return Token::Stall;
+		}
+
+		if (endpoint[kStatus] & SIEEndpoint::kBusNack0)
+			return Token::Nak;
+
+		if (!data.empty())
+			memcpy (_output_buffer.data(), data.data(), data.size());
+
+		set_count (endpoint, data.size());
+		endpoint[kStatus] |= SIEEndpoint::kTransactionComplete | SIEEndpoint::kBusNack0;
+		interrupt (result);
+		return Token::Sent;
+	}
+
+
+template<class C>
+	inline void
+	HostReplay<C>::interrupt (ReplayResult& result)
+	{
+		HostRegisterFile::Probe probe (result.traffic);
+		_conductor.handle_interrupt (NoTrace());
+		++result.interrupts;
+	}
+
+
+template<class C>
+	inline uint8_t*
+	HostReplay<C>::input_endpoint() const noexcept
+	{
+		return _endpoints_table + 1 * SIEEndpoint::kEndpointSize;
+	}
+
+
+template<class C>
+	inline uint8_t*
+	HostReplay<C>::output_endpoint() const noexcept
+	{
+		return _endpoints_table + 0 * SIEEndpoint::kEndpointSize;
+	}
+
+
+template<class C>
+	inline uint16_t
+	HostReplay<C>::count (uint8_t const* endpoint) noexcept
+	{
+		return endpoint[kCnt] | (endpoint[kCnt + 1] << 8);
+	}
+
+
+template<class C>
+	inline void
+	HostReplay<C>::set_count (uint8_t* endpoint, uint16_t count) noexcept
+	{
+		endpoint[kCnt + 0] = count & 0xff;
+		endpoint[kCnt + 1] = count >> 8;
+	}
+
+} // namespace usb
+} // namespace avr
+} // namespace mulabs
+
+#endif
+
@@ -15,80 +15,273 @@
 #define MULABS_AVR__SUPPORT__PROTOCOLS__SETUP_CONDUCTOR_H__INCLUDED
 
 // Mulabs:
-#include <mulabs_avr/support/protocols/usb/buffered_transfer.h>
 #include <mulabs_avr/support/protocols/usb/control_transfer.h>
+#include <mulabs_avr/support/protocols/usb/descriptor_table.h>
 #include <mulabs_avr/support/protocols/usb/device_definition.h>
 #include <mulabs_avr/support/protocols/usb/descriptors.h>
+#include <mulabs_avr/utility/flash_span.h>
 #include <mulabs_avr/utility/span.h>
+#include <mulabs_avr/utility/trace.h>
 
 
 namespace mulabs {
 namespace avr {
 namespace usb {
 
+/**
+ * Events traced by the USB stack (SetupConductor and State).
+ */
+struct TraceEvents
+{
+	static constexpr TraceEvent<0x10>											kBusReset		{ "USB bus reset" };
+	static constexpr TraceEvent<0x11>											kCRCError		{ "USB CRC error" };
+	static constexpr TraceEvent<0x12, uint16_t, uint16_t, uint16_t, uint16_t>	kSetup			{ "SETUP %04x value=%04x index=%04x length=%u" };
+	static constexpr TraceEvent<0x13, uint16_t>									kSetupStalled	{ "SETUP %04x stalled" };
+	static constexpr TraceEvent<0x14, uint8_t>									kTransferError	{ "ControlTransfer::Error %u" };
+	static constexpr TraceEvent<0x15, uint8_t>									kAddressSet		{ "USB address set to %u" };
+	static constexpr TraceEvent<0x16>											kSuspend		{ "USB suspend" };
+	static constexpr TraceEvent<0x17>											kResume			{ "USB resume" };
+};
+
+
 /**
  * This class handles the setup packets on the USB bus and replies according to the provided USB device definition.
+ * Descriptors are taken from pDescriptorTable (see DescriptorTable).
+ *
+ * Standard requests are dispatched by a single switch over the (bmRequestType, bRequest) pair, which the compiler
+ * turns into a jump table. Class- and vendor-specific requests, and standard requests not known here but addressed
+ * to an interface (eg. GET_DESCRIPTOR for HID report descriptor), are passed to the handler registered for the
+ * interface (see set_interface_handler()). Requests that aren't handled are answered with STALL.
+ *
+ * On SET_CONFIGURATION and SET_INTERFACE endpoints of the active alternate settings, that use buffers from the pool
+ * (see EndpointBuffer), are configured with buffers laid out in the endpoint_buffers block, which must be at least
+ * Device::endpoint_buffers_size() bytes. All their banks are NACK-ed until the user makes them ready.
+ * Endpoints with external buffers are only disabled and left for their class drivers to configure.
+ *
+ * \param	vMaxInterfaces
+ *			Maximum number of interfaces in any configuration of the device (see Device::maximum_number_of_interfaces()).
  */
-template<class pUSBSIE, pUSBSIE const& vUSBSIE, class pDeviceStrings, class pInputBuffer, class pOutputBuffer>
+template<class pUSBSIE, pUSBSIE const& vUSBSIE, class pDescriptorTable, class pInputBuffer, class pOutputBuffer, uint8_t vMaxInterfaces>
 	class SetupConductor
 	{
 	  public:
 		using USBSIE				= pUSBSIE;
-		using DeviceStringsType		= pDeviceStrings;
+		using DescriptorTableType	= pDescriptorTable;
 		using InputEndpoint			= typename USBSIE::InputEndpoint;
 		using InputBuffer			= pInputBuffer;
 		using OutputEndpoint		= typename USBSIE::OutputEndpoint;
 		using OutputBuffer			= pOutputBuffer;
-		using ControlTransferType	= ControlTransfer<InputEndpoint, InputBuffer, OutputEndpoint, OutputBuffer, 64>; // TODO user-configurable buffer-size
+		using ControlTransferType	= ControlTransfer<InputEndpoint, InputBuffer, OutputEndpoint, OutputBuffer>;
 
-		static constexpr USBSIE const&	usb_sie	= vUSBSIE;
+		static constexpr USBSIE const&	usb_sie			= vUSBSIE;
+		static constexpr uint8_t		kMaxInterfaces	= vMaxInterfaces;
+
+	  private:
+		/**
+		 * Type-erased pointer to a class driver, that handles requests for an interface.
+		 */
+		struct InterfaceHandler
+		{
+			void*	object	{ nullptr };
+			bool	(*handle_request) (void* object, SetupPacket const&, Span<uint8_t> output_data, ControlTransferType&) { nullptr };
+		};
 
 	  public:
 		// Ctor
 		explicit constexpr
-		SetupConductor (Device const& device, DeviceStringsType const&, InputEndpoint&, InputBuffer&, OutputEndpoint&, OutputBuffer&);
+		SetupConductor (Device const& device, uint8_t* endpoints_table, Span<uint8_t> endpoint_buffers,
+						InputEndpoint&, InputBuffer&, OutputEndpoint&, OutputBuffer&);
 
 		/**
 		 * Check endpoints and handle setup packets as needed.
+		 *
+		 * \param	trace
+		 *			Trace sink for TraceEvents (eg. TraceRing). Pass NoTrace() to compile tracing out.
 		 */
-		template<class Debug>
+		template<class Trace>
 			void
-			handle_interrupt (Debug&&);
+			handle_interrupt (Trace&& trace);
 
 		/**
-		 * Reset to initial state.
+		 * Reset to initial state (unconfigured).
 		 */
 		void
 		reset() noexcept;
 
+		/**
+		 * Register handler (usually a class driver, like CDCACM or HID) for requests addressed to given interface.
+		 *
+		 * \param	handler
+		 *			Object with method handle_request (SetupPacket const&, Span<uint8_t> output_data, ControlTransferType&) -> bool,
+		 *			which should return true if it handled the request (the response, if any, must be set up in the transfer
+		 *			object), or false to STALL the request.
+		 *			It gets class- and vendor-specific requests addressed to the interface or to one of its endpoints and
+		 *			standard interface requests not handled here. It's also notified about SET_CONFIGURATION and
+		 *			SET_INTERFACE (after they're validated here), but its return value is ignored for them.
+		 *			Must outlive the SetupConductor.
+		 */
+		template<class Handler>
+			void
+			set_interface_handler (uint8_t interface, Handler& handler);
+
+		/**
+		 * Return current configuration or nullptr if device is not configured.
+		 */
+		Configuration const*
+		configuration() const noexcept;
+
+		/**
+		 * Return current alternate setting of given interface.
+		 */
+		uint8_t
+		alternate_setting (uint8_t interface) const noexcept;
+
+		/**
+		 * Return true if host enabled remote wakeup (with SET_FEATURE DEVICE_REMOTE_WAKEUP).
+		 */
+		bool
+		remote_wakeup_enabled() const noexcept;
+
+		/**
+		 * Return pool buffer of the endpoint with given address (bit 7 is direction, bits 0…3 are the index).
+		 * For ping-pong endpoints it contains both banks. Return empty span if there's no such endpoint in the active
+		 * alternate settings of the current configuration, or if it doesn't use the pool.
+		 */
+		Span<uint8_t>
+		endpoint_buffer (uint8_t address);
+
+	  private:
+		static constexpr uint16_t kAllInterfaces = 0xffff;
+
 	  private:
+		/**
+		 * Return (bmRequestType, bRequest) dispatch key for a standard request.
+		 */
+		template<class Request>
+			static constexpr uint16_t
+			standard_request (SetupPacket::TransferDirection, SetupPacket::Recipient, Request);
+
+		/**
+		 * Return (bmRequestType, bRequest) dispatch key of the setup packet.
+		 */
+		static constexpr uint16_t
+		request_key (SetupPacket const&);
+
 		/**
 		 * Handle a setup packet, return true if processed OK.
 		 */
-		template<class Debug>
-			bool
-			handle_setup_packet (SetupPacket const&, ControlTransferType&, Debug&& debug);
+		bool
+		handle_setup_packet (SetupPacket const&, Span<uint8_t> output_data, ControlTransferType&);
+
+		bool
+		get_device_status (ControlTransferType&);
+
+		bool
+		set_device_feature (SetupPacket const&, bool enabled);
+
+		bool
+		get_descriptor (SetupPacket const&, ControlTransferType&);
+
+		bool
+		get_configuration (ControlTransferType&);
+
+		bool
+		set_configuration (SetupPacket const&, Span<uint8_t> output_data, ControlTransferType&);
+
+		bool
+		get_interface (SetupPacket const&, ControlTransferType&);
+
+		bool
+		set_interface (SetupPacket const&, Span<uint8_t> output_data, ControlTransferType&);
+
+		bool
+		get_endpoint_status (SetupPacket const&, ControlTransferType&);
+
+		bool
+		set_endpoint_feature (SetupPacket const&, bool enabled);
+
+		/**
+		 * Call function (Interface const&, Endpoint const&, uint8_t* buffer) for each endpoint of each alternate setting
+		 * in current configuration. Buffer is the endpoint's buffer in the pool or nullptr if endpoint doesn't use the pool.
+		 */
+		template<class Function>
+			void
+			for_each_endpoint (Function&&);
+
+		/**
+		 * Disable endpoints of given interface (or of all interfaces) and configure those in the active alternate setting.
+		 */
+		void
+		configure_endpoints (uint16_t interface);
+
+		/**
+		 * Return true if given interface is in its active alternate setting.
+		 */
+		bool
+		active (Interface const&) const;
+
+		/**
+		 * Pass the request to the handler registered for given interface.
+		 */
+		bool
+		forward (uint16_t interface, SetupPacket const&, Span<uint8_t> output_data, ControlTransferType&);
+
+		/**
+		 * Pass the request to all registered handlers, ignore results.
+		 */
+		void
+		notify_handlers (SetupPacket const&, Span<uint8_t> output_data, ControlTransferType&);
+
+		/**
+		 * Return true if interface with given index exists in current configuration.
+		 */
+		bool
+		interface_exists (uint16_t interface) const;
+
+		/**
+		 * Return interface (in its current alternate setting) that owns the endpoint with given address
+		 * (bit 7 is direction, bits 0…3 are the index), or nullptr if there's no such endpoint in current configuration.
+		 */
+		Interface const*
+		interface_for_endpoint (uint8_t address) const;
+
+		/**
+		 * Return the SIE IN endpoint with given index.
+		 */
+		InputEndpoint
+		input (uint8_t index) const;
+
+		/**
+		 * Return the SIE OUT endpoint with given index.
+		 */
+		OutputEndpoint
+		output (uint8_t index) const;
 
 	  private:
-		Device const&				_device;
-		DeviceStringsType const&	_device_strings;
-		InputEndpoint&				_input_endpoint;
-		InputBuffer&				_input_buffer;
-		OutputEndpoint&				_output_endpoint;
-		OutputBuffer&				_output_buffer;
-		uint8_t						_address_to_set		{ 0 };
-		BufferedTransfer<ControlTransferType>
-									_transfer			{ _input_endpoint, _input_buffer, _output_endpoint, _output_buffer };
+		Device const&							_device;
+		uint8_t*								_endpoints_table;
+		Span<uint8_t>							_endpoint_buffers;
+		InputEndpoint&							_input_endpoint;
+		InputBuffer&							_input_buffer;
+		OutputEndpoint&							_output_endpoint;
+		OutputBuffer&							_output_buffer;
+		uint8_t									_address_to_set			{ 0 };
+		Configuration const*					_configuration			{ nullptr };
+		bool									_remote_wakeup			{ false };
+		Array<uint8_t, kMaxInterfaces>			_alternate_settings		{ };
+		Array<InterfaceHandler, kMaxInterfaces>	_interface_handlers		{ };
+		ControlTransferType						_transfer				{ _input_endpoint, _input_buffer, _output_endpoint, _output_buffer };
 	};
 
 
-template<class U, U const& vU, class DS, class IB, class OB>
+template<class U, U const& vU, class DT, class IB, class OB, uint8_t vI>
 	constexpr
-	SetupConductor<U, vU, DS, IB, OB>::SetupConductor (Device const& device, DeviceStringsType const& device_strings,
-													   InputEndpoint& input_endpoint, InputBuffer& input_buffer,
-													   OutputEndpoint& output_endpoint, OutputBuffer& output_buffer):
+	SetupConductor<U, vU, DT, IB, OB, vI>::SetupConductor (Device const& device, uint8_t* endpoints_table, Span<uint8_t> endpoint_buffers,
+														   InputEndpoint& input_endpoint, InputBuffer& input_buffer,
+														   OutputEndpoint& output_endpoint, OutputBuffer& output_buffer):
 		_device (device),
-		_device_strings (device_strings),
+		_endpoints_table (endpoints_table),
+		_endpoint_buffers (endpoint_buffers),
 		_input_endpoint (input_endpoint),
 		_input_buffer (input_buffer),
 		_output_endpoint (output_endpoint),
@@ -96,251 +289,625 @@ template<class U, U const& vU, class DS, class IB, class OB>
 	{ }
 
 
-template<class U, U const& vU, class DS, class IB, class OB>
-	template<class Debug>
+template<class U, U const& vU, class DT, class IB, class OB, uint8_t vI>
+	template<class Trace>
 		inline void
-		SetupConductor<U, vU, DS, IB, OB>::handle_interrupt (Debug&& debug)
+		SetupConductor<U, vU, DT, IB, OB, vI>::handle_interrupt (Trace&& trace)
 		{
+			// Stall condition itself is cleared by ControlTransfer on next Setup packet, here only reset the flags:
 			if (_input_endpoint.is_stalled() || _output_endpoint.is_stalled())
 			{
-				debug ("!!! stalled\n");
-				// TODO
+				_input_endpoint.reset_stall();
+				_output_endpoint.reset_stall();
 			}
 
 			if (_input_endpoint.is_crc_error() || _output_endpoint.is_crc_error())
-			{
-				debug ("!!! CRC error\n");
-				// TODO stall the endpoint and report to the user
-			}
+				trace (TraceEvents::kCRCError);
 
 			if (usb_sie.triggered (std::remove_reference_t<decltype (usb_sie)>::InterruptFlag::Reset))
+			{
+				trace (TraceEvents::kBusReset);
 				reset();
+			}
+
+			auto on_setup = [&] (SetupPacket const& setup, Span<uint8_t> output_data) {
+				trace (TraceEvents::kSetup, request_key (setup), setup.request.class_request.value, setup.request.class_request.index, setup.length);
 
-			auto on_setup = [&] (SetupPacket const& setup, [[maybe_unused]] Span<uint8_t> output_data) {
-				// XXX remove debug
-				debug ("  Got setup packet:\n");
-				debug ("    transfer_direction  %u  %s\n", setup.transfer_direction,
-					(setup.transfer_direction == SetupPacket::TransferDirection::HostToDevice)
-						? "-> host to device"
-						: "<- device to host");
-				debug ("    type                %u\n", setup.type);
-				debug ("    recipient           %u\n", setup.recipient);
-				debug ("    length              %u\n", setup.length);
-
-				return handle_setup_packet (setup, _transfer, debug);
+				// By default, don't return anything:
+				_transfer.set_transfer_size (0);
+
+				if (handle_setup_packet (setup, output_data, _transfer))
+					return true;
+
+				trace (TraceEvents::kSetupStalled, request_key (setup));
+				return false;
 			};
 
 			auto on_finished = [&] {
 				if (_address_to_set != 0)
+				{
+					trace (TraceEvents::kAddressSet, _address_to_set);
 					usb_sie.set_address (std::exchange (_address_to_set, 0));
-				debug ("  Finished\n");
+				}
 			};
 
 			auto on_error = [&] (typename ControlTransferType::Error error) {
-				debug ("ControlTransfer::Error %u\n", static_cast<size_t> (error));
+				trace (TraceEvents::kTransferError, static_cast<uint8_t> (error));
 			};
 
 			_transfer.handle_interrupt (on_setup, on_finished, on_error);
 		}
 
 
-template<class U, U const& vU, class DS, class IB, class OB>
+template<class U, U const& vU, class DT, class IB, class OB, uint8_t vI>
 	inline void
-	SetupConductor<U, vU, DS, IB, OB>::reset() noexcept
+	SetupConductor<U, vU, DT, IB, OB, vI>::reset() noexcept
 	{
 		_address_to_set = 0;
 		_transfer.reset();
+
+		// Bus reset deconfigures the device, let the class drivers know:
+		if (_configuration)
+		{
+			SetupPacket setup { };
+			setup.request.device.type = SetupPacket::DeviceRequest::Type::SetConfiguration;
+			static_cast<void> (set_configuration (setup, Span<uint8_t>(), _transfer));
+		}
+
+		_remote_wakeup = false;
+	}
+
+
+template<class U, U const& vU, class DT, class IB, class OB, uint8_t vI>
+	template<class Handler>
+		inline void
+		SetupConductor<U, vU, DT, IB, OB, vI>::set_interface_handler (uint8_t interface, Handler& handler)
+		{
+			if (interface < kMaxInterfaces)
+			{
+				_interface_handlers[interface] = {
+					&handler,
+					[] (void* object, SetupPacket const& setup, Span<uint8_t> output_data, ControlTransferType& transfer) -> bool {
+						return static_cast<Handler*> (object)->handle_request (setup, output_data, transfer);
+					},
+				};
+			}
+		}
+
+
+template<class U, U const& vU, class DT, class IB, class OB, uint8_t vI>
+	inline Configuration const*
+	SetupConductor<U, vU, DT, IB, OB, vI>::configuration() const noexcept
+	{
+		return _configuration;
+	}
+
+
+template<class U, U const& vU, class DT, class IB, class OB, uint8_t vI>
+	inline uint8_t
+	SetupConductor<U, vU, DT, IB, OB, vI>::alternate_setting (uint8_t interface) const noexcept
+	{
+		return interface < kMaxInterfaces ? _alternate_settings[interface] : 0;
+	}
+
+
+template<class U, U const& vU, class DT, class IB, class OB, uint8_t vI>
+	inline bool
+	SetupConductor<U, vU, DT, IB, OB, vI>::remote_wakeup_enabled() const noexcept
+	{
+		return _remote_wakeup;
 	}
 
 
-template<class U, U const& vU, class DS, class IB, class OB>
-	template<class Debug>
-		inline bool
-		SetupConductor<U, vU, DS, IB, OB>::handle_setup_packet (SetupPacket const& setup, ControlTransferType& transfer, Debug&& debug)
+template<class U, U const& vU, class DT, class IB, class OB, uint8_t vI>
+	inline Span<uint8_t>
+	SetupConductor<U, vU, DT, IB, OB, vI>::endpoint_buffer (uint8_t address)
+	{
+		Direction const direction = (address & 0x80) ? Direction::In : Direction::Out;
+		uint8_t const index = address & 0x0f;
+		Span<uint8_t> result;
+
+		for_each_endpoint ([&] (Interface const& interface, Endpoint const& endpoint, uint8_t* buffer) {
+			if (buffer && active (interface) && *endpoint.index == index && endpoint.direction == direction)
+				result = Span<uint8_t> (buffer, endpoint.buffers_size());
+		});
+
+		return result;
+	}
+
+
+template<class U, U const& vU, class DT, class IB, class OB, uint8_t vI>
+	template<class Request>
+		constexpr uint16_t
+		SetupConductor<U, vU, DT, IB, OB, vI>::standard_request (SetupPacket::TransferDirection direction, SetupPacket::Recipient recipient, Request request)
 		{
-			// By default, don't return anything:
-			transfer.set_transfer_size (0);
+			return (direction << 15) | (SetupPacket::Type::Standard << 13) | (recipient << 8) | static_cast<uint8_t> (request);
+		}
+
+
+template<class U, U const& vU, class DT, class IB, class OB, uint8_t vI>
+	constexpr uint16_t
+	SetupConductor<U, vU, DT, IB, OB, vI>::request_key (SetupPacket const& setup)
+	{
+		return (setup.transfer_direction << 15) | (setup.type << 13) | (setup.recipient << 8) | setup.request.class_request.type;
+	}
+
 
-			switch (setup.type)
+template<class U, U const& vU, class DT, class IB, class OB, uint8_t vI>
+	inline bool
+	SetupConductor<U, vU, DT, IB, OB, vI>::handle_setup_packet (SetupPacket const& setup, Span<uint8_t> output_data, ControlTransferType& transfer)
+	{
+		using DeviceRequest		= SetupPacket::DeviceRequest::Type;
+		using InterfaceRequest	= SetupPacket::InterfaceRequest::Type;
+		using EndpointRequest	= SetupPacket::EndpointRequest::Type;
+
+		using Setup				= SetupPacket;
+
+		if (setup.type != SetupPacket::Type::Standard)
+		{
+			switch (setup.recipient)
 			{
-				case SetupPacket::Type::Standard:
-					switch (setup.recipient)
-					{
-						case SetupPacket::Recipient::Device:
-						{
-							using Type = SetupPacket::DeviceRequest::Type;
-
-							debug ("SETUP: Recipient::Device\n");
-
-							switch (setup.request.device.type)
-							{
-								case Type::GetStatus:
-								{
-									debug ("  DeviceRequest::GetStatus\n");
-									// Bit 0 is SelfPowered (1 if true)
-									// Bit 1 is RemoteWakeup (1 if true)
-									uint8_t lsb = 0;
-
-									transfer.buffer()[0] = lsb;
-									transfer.buffer()[1] = 0;
-									transfer.set_transfer_size (2);
-									break;
-								}
-
-								case Type::GetDescriptor:
-									switch (setup.request.device.get_descriptor.type)
-									{
-										case DescriptorType::Device:
-										{
-											auto const desc = make_device_descriptor (_device, _device_strings);
-											transfer.buffer().template as<DeviceDescriptor>() = desc;
-											transfer.set_transfer_size (std::min (setup.length, sizeof (desc)));
-											break;
-										}
-
-										case DescriptorType::Configuration:
-										{
-											// A request for the configuration descriptor should return the device descriptor and all interface and endpoint
-											// descriptors in one request.
-											size_t size = make_full_configuration_descriptor (transfer.buffer(), _device, setup.request.device.get_descriptor.index, _device_strings);
-											transfer.set_transfer_size (std::min (setup.length, size));
-											break;
-										}
-
-										case DescriptorType::String:
-										{
-											auto const index = setup.request.device.get_descriptor.index;
-
-											if (index == 0)
-											{
-												auto const actual_size = make_string_descriptor_0 (transfer.buffer(), LanguageID::English);
-												transfer.set_transfer_size (actual_size);
-											}
-											else
-											{
-												auto const& string = _device_strings.string_for_index (setup.request.device.get_descriptor.index);
-												auto const actual_size = make_string_descriptor (transfer.buffer(), string);
-												transfer.set_transfer_size (actual_size);
-											}
-											break;
-										}
-
-										case DescriptorType::Interface:
-											// Ignore. USB protocol doesn't allow asking for individual interface descriptors.
-											break;
-
-										case DescriptorType::Endpoint:
-											// Ignore. USB protocol doesn't allow asking for individual endpoint descriptors.
-											break;
-
-										case DescriptorType::BOS:
-											debug ("    DescriptorType::BOS\n");
-											break;
-									}
-									break;
-
-								case Type::GetConfiguration:
-									debug ("  DeviceRequest::GetConfiguration\n");
-									// Return to the host a byte indicating whether device is configured or not
-									// 0 means not configured, other value indicates current configuration index.
-									transfer.buffer()[0] = 0;
-									transfer.set_transfer_size (1);
-									break;
-
-								case Type::ClearFeature:
-									debug ("  DeviceRequest::ClearFeature\n");
-									break;
-
-								case Type::SetFeature:
-									debug ("  DeviceRequest::SetFeature\n");
-									break;
-
-								case Type::SetAddress:
-									// Address should be set after completion of the status stage, so just remember it for now:
-									_address_to_set = setup.request.device.set_address.address;
-									break;
-
-								case Type::SetDescriptor:
-									debug ("  DeviceRequest::SetDescriptor\n");
-									break;
-
-								case Type::SetConfiguration:
-									debug ("  DeviceRequest::SetConfiguration\n");
-									// TODO set current device configuration
-									// TODO call-out user method (set current config index in usb::DeviceState)
-									break;
-							}
-							break;
-						}
-
-						case SetupPacket::Recipient::Interface:
-						{
-							using Type = SetupPacket::InterfaceRequest::Type;
-
-							debug ("SETUP: Recipient::Interface\n");
-
-							switch (setup.request.interface.type)
-							{
-								case Type::GetStatus:
-									debug ("  InterfaceRequest::GetStatus\n");
-									break;
-
-								case Type::GetInterface:
-									debug ("  InterfaceRequest::GetInterface\n");
-									break;
-
-								case Type::ClearFeature:
-									debug ("  InterfaceRequest::ClearFeature\n");
-									break;
-
-								case Type::SetFeature:
-									debug ("  InterfaceRequest::SetFeature\n");
-									break;
-
-								case Type::SetInterface:
-									debug ("  InterfaceRequest::SetInterface\n");
-									break;
-							}
-							break;
-						}
-
-						case SetupPacket::Recipient::Endpoint:
-							using Type = SetupPacket::EndpointRequest::Type;
-
-							debug ("SETUP: Recipient::Endpoint\n");
-
-							switch (setup.request.endpoint.type)
-							{
-								case Type::GetStatus:
-									debug ("  EndpointRequest::GetStatus\n");
-									break;
-
-								case Type::SynchFrame:
-									debug ("  EndpointRequest::SynchFrame\n");
-									break;
-
-								case Type::ClearFeature:
-									debug ("  EndpointRequest::ClearFeature\n");
-									break;
-
-								case Type::SetFeature:
-									debug ("  EndpointRequest::SetFeature\n");
-									break;
-							}
-							break;
-
-						default:
-							break;
-					}
-					break;
+				case SetupPacket::Recipient::Interface:
+					return forward (setup.request.class_request.index, setup, output_data, transfer);
+
+				case SetupPacket::Recipient::Endpoint:
+					if (auto const* interface = interface_for_endpoint (setup.request.class_request.index))
+						return forward (*interface->index, setup, output_data, transfer);
+					return false;
 
 				default:
-					break;
+					return false;
 			}
+		}
+
+		switch (request_key (setup))
+		{
+			case standard_request (Setup::DeviceToHost, Setup::Device, DeviceRequest::GetStatus):
+				return get_device_status (transfer);
+
+			case standard_request (Setup::HostToDevice, Setup::Device, DeviceRequest::ClearFeature):
+				return set_device_feature (setup, false);
+
+			case standard_request (Setup::HostToDevice, Setup::Device, DeviceRequest::SetFeature):
+				return set_device_feature (setup, true);
+
+			case standard_request (Setup::HostToDevice, Setup::Device, DeviceRequest::SetAddress):
+				// Address should be set after completion of the status stage, so just remember it for now:
+				_address_to_set = setup.request.device.set_address.address & 0x7f;
+				return true;
+
+			case standard_request (Setup::DeviceToHost, Setup::Device, DeviceRequest::GetDescriptor):
+				return get_descriptor (setup, transfer);
+
+			case standard_request (Setup::DeviceToHost, Setup::Device, DeviceRequest::GetConfiguration):
+				return get_configuration (transfer);
+
+			case standard_request (Setup::HostToDevice, Setup::Device, DeviceRequest::SetConfiguration):
+				return set_configuration (setup, output_data, transfer);
+
+			case standard_request (Setup::DeviceToHost, Setup::Interface, InterfaceRequest::GetStatus):
+				// All bits are reserved:
+				transfer.buffer()[0] = 0;
+				transfer.buffer()[1] = 0;
+				transfer.set_transfer_size (2);
+				return interface_exists (setup.request.interface.get_status.interface);
+
+			case standard_request (Setup::DeviceToHost, Setup::Interface, InterfaceRequest::GetInterface):
+				return get_interface (setup, transfer);
 
+			case standard_request (Setup::HostToDevice, Setup::Interface, InterfaceRequest::SetInterface):
+				return set_interface (setup, output_data, transfer);
+
+			case standard_request (Setup::DeviceToHost, Setup::Endpoint, EndpointRequest::GetStatus):
+				return get_endpoint_status (setup, transfer);
+
+			case standard_request (Setup::HostToDevice, Setup::Endpoint, EndpointRequest::ClearFeature):
+				return set_endpoint_feature (setup, false);
+
+			case standard_request (Setup::HostToDevice, Setup::Endpoint, EndpointRequest::SetFeature):
+				return set_endpoint_feature (setup, true);
+
+			default:
+				// Other standard interface requests may be class-specific (eg. GET_DESCRIPTOR for HID descriptors):
+				if (setup.recipient == SetupPacket::Recipient::Interface)
+					return forward (setup.request.class_request.index, setup, output_data, transfer);
+
+				// SET_DESCRIPTOR, SYNCH_FRAME and others are not supported:
+				return false;
+		}
+	}
+
+
+template<class U, U const& vU, class DT, class IB, class OB, uint8_t vI>
+	inline bool
+	SetupConductor<U, vU, DT, IB, OB, vI>::get_device_status (ControlTransferType& transfer)
+	{
+		// Bit 0 is SelfPowered (1 if true)
+		// Bit 1 is RemoteWakeup (1 if enabled by the host)
+		uint8_t lsb = 0;
+
+		if (_configuration && *_configuration->self_powered)
+			lsb |= 1u << 0;
+
+		if (_remote_wakeup)
+			lsb |= 1u << 1;
+
+		transfer.buffer()[0] = lsb;
+		transfer.buffer()[1] = 0;
+		transfer.set_transfer_size (2);
+		return true;
+	}
+
+
+template<class U, U const& vU, class DT, class IB, class OB, uint8_t vI>
+	inline bool
+	SetupConductor<U, vU, DT, IB, OB, vI>::set_device_feature (SetupPacket const& setup, bool enabled)
+	{
+		switch (setup.request.device.set_feature.feature)
+		{
+			case SetupPacket::Feature::RemoteWakeup:
+				if (!_configuration || !*_configuration->remote_wakeup)
+					return false;
+
+				_remote_wakeup = enabled;
+				return true;
+
+			default:
+				// TestMode is only for high-speed devices:
+				return false;
+		}
+	}
+
+
+template<class U, U const& vU, class DT, class IB, class OB, uint8_t vI>
+	inline bool
+	SetupConductor<U, vU, DT, IB, OB, vI>::get_descriptor (SetupPacket const& setup, ControlTransferType& transfer)
+	{
+		// All descriptors were prepared at compile-time, so just stream the requested one from flash.
+		// A request for the configuration descriptor returns the configuration descriptor and all
+		// interface and endpoint descriptors in one request. Individual interface and endpoint descriptors
+		// can't be requested (and aren't in the table).
+		auto const& request = setup.request.device.get_descriptor;
+		FlashSpan const descriptor = DescriptorTableType::descriptor (request.type, request.index);
+
+		if (descriptor.empty())
+			return false;
+
+		transfer.set_transfer_data (descriptor);
+		return true;
+	}
+
+
+template<class U, U const& vU, class DT, class IB, class OB, uint8_t vI>
+	inline bool
+	SetupConductor<U, vU, DT, IB, OB, vI>::get_configuration (ControlTransferType& transfer)
+	{
+		// 0 means not configured, other value is the current configuration value:
+		transfer.buffer()[0] = _configuration ? *_configuration->value : 0;
+		transfer.set_transfer_size (1);
+		return true;
+	}
+
+
+template<class U, U const& vU, class DT, class IB, class OB, uint8_t vI>
+	inline bool
+	SetupConductor<U, vU, DT, IB, OB, vI>::set_configuration (SetupPacket const& setup, Span<uint8_t> output_data, ControlTransferType& transfer)
+	{
+		uint8_t const value = setup.request.device.set_configuration.configuration_value;
+		Configuration const* configuration = nullptr;
+
+		if (value != 0)
+		{
+			configuration = _device.find_configuration (value);
+
+			if (!configuration)
+				return false;
+		}
+
+		// Configuring the device resets all interfaces to the default alternate setting and clears halt on all endpoints.
+		// Endpoints with external buffers are configured by class drivers when they get notified:
+		_configuration = configuration;
+		_alternate_settings.fill (0);
+		configure_endpoints (kAllInterfaces);
+		notify_handlers (setup, output_data, transfer);
+		return true;
+	}
+
+
+template<class U, U const& vU, class DT, class IB, class OB, uint8_t vI>
+	inline bool
+	SetupConductor<U, vU, DT, IB, OB, vI>::get_interface (SetupPacket const& setup, ControlTransferType& transfer)
+	{
+		uint16_t const interface = setup.request.interface.get_interface.interface;
+
+		if (!interface_exists (interface))
+			return false;
+
+		transfer.buffer()[0] = _alternate_settings[interface];
+		transfer.set_transfer_size (1);
+		return true;
+	}
+
+
+template<class U, U const& vU, class DT, class IB, class OB, uint8_t vI>
+	inline bool
+	SetupConductor<U, vU, DT, IB, OB, vI>::set_interface (SetupPacket const& setup, Span<uint8_t> output_data, ControlTransferType& transfer)
+	{
+		auto const& request = setup.request.interface.set_interface;
+
+		if (!interface_exists (request.interface) || !_configuration->find_interface (request.interface, request.alternate_index))
+			return false;
+
+		_alternate_settings[request.interface] = request.alternate_index;
+		configure_endpoints (request.interface);
+		static_cast<void> (forward (request.interface, setup, output_data, transfer));
+		return true;
+	}
+
+
+template<class U, U const& vU, class DT, class IB, class OB, uint8_t vI>
+	inline bool
+	SetupConductor<U, vU, DT, IB, OB, vI>::get_endpoint_status (SetupPacket const& setup, ControlTransferType& transfer)
+	{
+		auto const& endpoint = setup.request.endpoint.get_status.endpoint;
+		// Bit 0 is Halt:
+		uint8_t lsb = 0;
+
+		if (endpoint.index != 0)
+		{
+			if (!interface_for_endpoint (setup.request.class_request.index))
+				return false;
+
+			if (endpoint.direction)
+				lsb = input (endpoint.index).stall_enabled();
+			else
+				lsb = output (endpoint.index).stall_enabled();
+		}
+
+		transfer.buffer()[0] = lsb;
+		transfer.buffer()[1] = 0;
+		transfer.set_transfer_size (2);
+		return true;
+	}
+
+
+template<class U, U const& vU, class DT, class IB, class OB, uint8_t vI>
+	inline bool
+	SetupConductor<U, vU, DT, IB, OB, vI>::set_endpoint_feature (SetupPacket const& setup, bool enabled)
+	{
+		auto const& request = setup.request.endpoint.set_feature;
+
+		if (request.feature != SetupPacket::Feature::EndpointHalt)
+			return false;
+
+		// Halting the default control endpoint makes no sense, just acknowledge:
+		if (request.endpoint.index == 0)
 			return true;
+
+		if (!interface_for_endpoint (setup.request.class_request.index))
+			return false;
+
+		auto halt = [enabled] (auto&& endpoint) {
+			endpoint.set_stalled (enabled);
+
+			// Clearing halt always resets data toggle:
+			if (!enabled)
+				endpoint.set_next_data_packet (std::remove_reference_t<decltype (endpoint)>::Endpoint::Data::_0);
+		};
+
+		if (request.endpoint.direction)
+			halt (input (request.endpoint.index));
+		else
+			halt (output (request.endpoint.index));
+
+		return true;
+	}
+
+
+template<class U, U const& vU, class DT, class IB, class OB, uint8_t vI>
+	template<class Function>
+		inline void
+		SetupConductor<U, vU, DT, IB, OB, vI>::for_each_endpoint (Function&& function)
+		{
+			if (!_configuration)
+				return;
+
+			// Each interface gets a region big enough for the most demanding of its alternate settings, alternate
+			// settings share it:
+			uint8_t* interface_buffers = _endpoint_buffers.data();
+			size_t interface_size = 0;
+
+			for (auto const& interface: _configuration->interfaces)
+			{
+				// Alternate settings always follow their interface:
+				if (*interface.alternate_index == 0)
+				{
+					interface_buffers += interface_size;
+					interface_size = 0;
+				}
+
+				uint8_t* buffer = interface_buffers;
+
+				for (auto const& endpoint: interface.endpoints)
+				{
+					function (interface, endpoint, endpoint.pooled() ? buffer : nullptr);
+					buffer += endpoint.buffers_size();
+				}
+
+				interface_size = std::max (interface_size, interface.buffers_size());
+			}
+		}
+
+
+template<class U, U const& vU, class DT, class IB, class OB, uint8_t vI>
+	inline void
+	SetupConductor<U, vU, DT, IB, OB, vI>::configure_endpoints (uint16_t interface_index)
+	{
+		using SIEEndpoint = typename USBSIE::Endpoint;
+
+		// Disable old endpoints first, since alternate settings and configurations may use the same endpoints differently:
+		if (interface_index == kAllInterfaces)
+		{
+			for (uint8_t i = 1; i <= _device.maximum_endpoint_address(); ++i)
+			{
+				input (i).initialize();
+				output (i).initialize();
+			}
+		}
+		else
+		{
+			for_each_endpoint ([&] (Interface const& interface, Endpoint const& endpoint, uint8_t*) {
+				// The other direction of the same index may belong to another interface, unless this one
+				// uses it as its second bank:
+				if (*interface.index == interface_index)
+				{
+					if (endpoint.direction == Direction::In || endpoint.ping_pong())
+						input (*endpoint.index).initialize();
+
+					if (endpoint.direction == Direction::Out || endpoint.ping_pong())
+						output (*endpoint.index).initialize();
+				}
+			});
+		}
+
+		for_each_endpoint ([&] (Interface const& interface, Endpoint const& endpoint, uint8_t* buffer) {
+			if (!buffer || !active (interface) || (interface_index != kAllInterfaces && *interface.index != interface_index))
+				return;
+
+			size_t const bank_size = endpoint.bank_size();
+			// Buffer size setting is log2 (bank_size) - 3 for both control/bulk and isochronous endpoints:
+			uint8_t size_setting = 0;
+
+			for (size_t size = 8; size < bank_size; size *= 2)
+				++size_setting;
+
+			auto configure = [&] (auto&& bank_0, auto&& bank_1) {
+				switch (endpoint.transfer_type)
+				{
+					case TransferType::Isochronous:
+						bank_0.set (SIEEndpoint::Type::Isochronous);
+						bank_0.set_buffer (buffer, static_cast<typename SIEEndpoint::IsochronousBufferSize> (size_setting));
+						break;
+
+					case TransferType::Control:
+						bank_0.set (SIEEndpoint::Type::Control);
+						bank_0.set_buffer (buffer, static_cast<typename SIEEndpoint::ControlBulkBufferSize> (size_setting));
+						break;
+
+					case TransferType::Bulk:
+					case TransferType::Interrupt:
+						// SIE handles interrupt endpoints just like the bulk ones:
+						bank_0.set (SIEEndpoint::Type::Bulk);
+						bank_0.set_buffer (buffer, static_cast<typename SIEEndpoint::ControlBulkBufferSize> (size_setting));
+						break;
+				}
+
+				// Banks are owned by the CPU until the user makes them ready:
+				bank_0.set_nack_all (SIEEndpoint::Buffer::_0, true);
+
+				if (endpoint.ping_pong())
+				{
+					bank_1.set_buffer (buffer + bank_size);
+					bank_0.set_ping_pong_enabled (true);
+					bank_0.set_nack_all (SIEEndpoint::Buffer::_1, true);
+				}
+			};
+
+			if (endpoint.direction == Direction::In)
+				configure (input (*endpoint.index), output (*endpoint.index));
+			else
+				configure (output (*endpoint.index), input (*endpoint.index));
+		});
+	}
+
+
+template<class U, U const& vU, class DT, class IB, class OB, uint8_t vI>
+	inline bool
+	SetupConductor<U, vU, DT, IB, OB, vI>::active (Interface const& interface) const
+	{
+		return *interface.index < kMaxInterfaces && *interface.alternate_index == _alternate_settings[*interface.index];
+	}
+
+
+template<class U, U const& vU, class DT, class IB, class OB, uint8_t vI>
+	inline bool
+	SetupConductor<U, vU, DT, IB, OB, vI>::forward (uint16_t interface, SetupPacket const& setup, Span<uint8_t> output_data, ControlTransferType& transfer)
+	{
+		if (!interface_exists (interface))
+			return false;
+
+		InterfaceHandler const& handler = _interface_handlers[interface];
+
+		return handler.object && handler.handle_request (handler.object, setup, output_data, transfer);
+	}
+
+
+template<class U, U const& vU, class DT, class IB, class OB, uint8_t vI>
+	inline void
+	SetupConductor<U, vU, DT, IB, OB, vI>::notify_handlers (SetupPacket const& setup, Span<uint8_t> output_data, ControlTransferType& transfer)
+	{
+		for (uint8_t i = 0; i < kMaxInterfaces; ++i)
+		{
+			InterfaceHandler const& handler = _interface_handlers[i];
+			bool already_notified = false;
+
+			// Handler may be registered for more than one interface:
+			for (uint8_t j = 0; j < i; ++j)
+				if (_interface_handlers[j].object == handler.object)
+					already_notified = true;
+
+			if (handler.object && !already_notified)
+				static_cast<void> (handler.handle_request (handler.object, setup, output_data, transfer));
 		}
 
+		transfer.set_transfer_size (0);
+	}
+
+
+template<class U, U const& vU, class DT, class IB, class OB, uint8_t vI>
+	inline bool
+	SetupConductor<U, vU, DT, IB, OB, vI>::interface_exists (uint16_t interface) const
+	{
+		return _configuration && interface < _configuration->number_of_interfaces() && interface < kMaxInterfaces;
+	}
+
+
+template<class U, U const& vU, class DT, class IB, class OB, uint8_t vI>
+	inline Interface const*
+	SetupConductor<U, vU, DT, IB, OB, vI>::interface_for_endpoint (uint8_t address) const
+	{
+		if (!_configuration)
+			return nullptr;
+
+		Direction const direction = (address & 0x80) ? Direction::In : Direction::Out;
+		uint8_t const index = address & 0x0f;
+
+		for (auto const& interface: _configuration->interfaces)
+			if (active (interface))
+				for (auto const& endpoint: interface.endpoints)
+					if (*endpoint.index == index && endpoint.direction == direction)
+						return &interface;
+
+		return nullptr;
+	}
+
+
+template<class U, U const& vU, class DT, class IB, class OB, uint8_t vI>
+	inline auto
+	SetupConductor<U, vU, DT, IB, OB, vI>::input (uint8_t index) const -> InputEndpoint
+	{
+		// Table holds OUT and IN descriptors for each endpoint index, in that order:
+		return InputEndpoint (_endpoints_table + (2 * index + 1) * USBSIE::Endpoint::kEndpointSize);
+	}
+
+
+template<class U, U const& vU, class DT, class IB, class OB, uint8_t vI>
+	inline auto
+	SetupConductor<U, vU, DT, IB, OB, vI>::output (uint8_t index) const -> OutputEndpoint
+	{
+		return OutputEndpoint (_endpoints_table + (2 * index) * USBSIE::Endpoint::kEndpointSize);
+	}
+
 } // namespace usb
 } // namespace avr
 } // namespace mulabs
@@ -49,10 +49,12 @@ struct SetupPacket
 		Other			= 0b00011,
 	};
 
+	// Feature selectors used by SET_FEATURE/CLEAR_FEATURE requests:
 	enum class Feature: uint16_t
 	{
-		SelfPowered		= 1u << 0,
-		RemoteWakeup	= 1u << 1,
+		EndpointHalt	= 0,
+		RemoteWakeup	= 1,
+		TestMode		= 2,
 	};
 
 	struct DeviceRequest
@@ -134,7 +136,7 @@ struct SetupPacket
 			// Host to device:
 			ClearFeature		= 0x01,
 			SetFeature			= 0x03,
-			SetInterface		= 0x11,
+			SetInterface		= 0x0b,
 		};
 
 		struct GetStatus
@@ -181,7 +183,7 @@ struct SetupPacket
 		{
 			// Device to host:
 			GetStatus			= 0x00,
-			SynchFrame			= 0x12,
+			SynchFrame			= 0x0c,
 			// Host to device:
 			ClearFeature		= 0x01,
 			SetFeature			= 0x03,
@@ -189,9 +191,10 @@ struct SetupPacket
 
 		struct Endpoint
 		{
-			uint16_t			direction:1;
-			uint16_t			reserved_1:3;
 			uint16_t			index:4;
+			uint16_t			reserved_1:3;
+			uint16_t			direction:1;
+			uint16_t			reserved_2:8;
 		} __attribute__((packed));
 
 		struct GetStatus
@@ -209,7 +212,7 @@ struct SetupPacket
 		struct SetClearFeature
 		{
 			Feature				feature;
-			uint16_t			interface;
+			Endpoint			endpoint;
 		} __attribute__((packed));
 
 	  public:
@@ -224,11 +227,23 @@ struct SetupPacket
 		};
 	} __attribute__((packed));
 
+	/**
+	 * Class- and vendor-specific requests. Meaning of the fields depends on the class.
+	 */
+	struct ClassRequest
+	{
+	  public:
+		uint8_t					type;
+		uint16_t				value;
+		uint16_t				index;
+	} __attribute__((packed));
+
 	union Request
 	{
 		DeviceRequest			device;
 		InterfaceRequest		interface;
 		EndpointRequest			endpoint;
+		ClassRequest			class_request;
 	};
 
   public:
@@ -0,0 +1,165 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__SUPPORT__PROTOCOLS__SUSPEND_MANAGER_H__INCLUDED
+#define MULABS_AVR__SUPPORT__PROTOCOLS__SUSPEND_MANAGER_H__INCLUDED
+
+// Mulabs:
+#include <mulabs_avr/avr/interrupts_lock.h>
+
+
+namespace mulabs {
+namespace avr {
+namespace usb {
+
+/**
+ * Low-power idle while the USB bus is suspended.
+ *
+ * When the host stops sending frames for 3 ms, the bus is suspended, and a bus-powered device must then draw no more
+ * than 2.5 mA from the bus. State tracks suspend and resume in its interrupt handler; call sleep_while_suspended()
+ * from the main loop. It stops clocks of all peripherals except USB and the ones listed in the constructor, puts
+ * the MCU into the selected sleep mode (USB bus events wake it up from any sleep mode) and restores the clocks
+ * when the host resumes or resets the bus.
+ *
+ * The current also depends on the rest of the board (LEDs, pull-ups, regulators, other chips), bring those into
+ * low-power state before calling sleep_while_suspended().
+ *
+ * Remote wakeup: the host must see at least 5 ms of bus idle before the device signals resume (USB 2.0 §7.1.7.7).
+ * Suspend is detected after 3 ms, State counts the rest with State::handle_suspend_time(), so keep a periodic
+ * interrupt running while suspended (eg. RTC) and call it from there. If wake_up() asks for the wakeup earlier,
+ * sleep_while_suspended() sleeps on until it's allowed. The configuration must be defined with RemoteWakeup (true),
+ * otherwise host's SET_FEATURE (DEVICE_REMOTE_WAKEUP) is refused and remote wakeup is never enabled.
+ *
+ * Usage:
+ *   usb::SuspendManager<MCU, UsbState> suspend_manager (usb_state, MCU::Sleep::Mode::PowerDown, MCU::Clock::Peripheral::RTC);
+ *
+ *   ISR (RTC_OVF_vect) { usb_state.handle_suspend_time (1); }
+ *
+ *   while (true)
+ *   {
+ *       if (usb_state.suspended())
+ *       {
+ *           leds.turn_off();
+ *           suspend_manager.sleep_while_suspended ([] { return button.pressed(); });
+ *       }
+ *       …
+ *   }
+ */
+template<class pMCU, class pState>
+	class SuspendManager
+	{
+	  public:
+		using MCU		= pMCU;
+		using State		= pState;
+		using Clock		= typename MCU::Clock;
+		using Sleep		= typename MCU::Sleep;
+
+	  public:
+		// Ctor
+		template<class ...Peripherals>
+			explicit
+			SuspendManager (State&, typename Sleep::Mode = Sleep::Mode::PowerDown, Peripherals ...keep_running);
+
+		/**
+		 * If the bus is suspended, sleep until it's resumed (or reset). Return true if the MCU went to sleep.
+		 */
+		bool
+		sleep_while_suspended();
+
+		/**
+		 * Like sleep_while_suspended(), but after each wake-up (by any interrupt) call wake_up() -> bool.
+		 * If it returns true (eg. a button was pressed), stop sleeping and signal remote wakeup to the host
+		 * (if host enabled it, see State::remote_wakeup()). If the bus hasn't been idle long enough for the
+		 * wakeup yet, keep sleeping until it has. wake_up() is called with interrupts disabled.
+		 */
+		template<class WakeUp>
+			bool
+			sleep_while_suspended (WakeUp&& wake_up);
+
+	  private:
+		State&							_state;
+		typename Sleep::Mode			_mode;
+		typename Clock::PowerReduction	_suspended_power_reduction;
+	};
+
+
+template<class M, class S>
+	template<class ...Peripherals>
+		inline
+		SuspendManager<M, S>::SuspendManager (State& state, typename Sleep::Mode mode, Peripherals ...keep_running):
+			_state (state),
+			_mode (mode),
+			_suspended_power_reduction (Clock::all_stopped_except (Clock::Peripheral::USB, keep_running...))
+		{ }
+
+
+template<class M, class S>
+	inline bool
+	SuspendManager<M, S>::sleep_while_suspended()
+	{
+		return sleep_while_suspended ([] { return false; });
+	}
+
+
+template<class M, class S>
+	template<class WakeUp>
+		inline bool
+		SuspendManager<M, S>::sleep_while_suspended (WakeUp&& wake_up)
+		{
+			if (!_state.suspended())
+				return false;
+
+			auto const saved_power_reduction = Clock::power_reduction();
+			bool remote_wakeup = false;
+
+			Clock::set_power_reduction (_suspended_power_reduction);
+			Sleep::set (_mode);
+
+			while (true)
+			{
+				// Check the condition with interrupts disabled, so that a Resume interrupt can't come between
+				// the check and the SLEEP instruction:
+				cli();
+
+				if (!_state.suspended())
+					break;
+
+				if (remote_wakeup || wake_up())
+				{
+					remote_wakeup = true;
+
+					// Wait for handle_suspend_time() to count enough bus idle time:
+					if (!_state.remote_wakeup_enabled() || _state.remote_wakeup_allowed())
+						break;
+				}
+
+				Sleep::set_enabled (true);
+				Sleep::enable_interrupts_and_sleep();
+				Sleep::set_enabled (false);
+			}
+
+			sei();
+			Clock::set_power_reduction (saved_power_reduction);
+
+			if (remote_wakeup)
+				static_cast<void> (_state.remote_wakeup());
+
+			return true;
+		}
+
+} // namespace usb
+} // namespace avr
+} // namespace mulabs
+
+#endif
+
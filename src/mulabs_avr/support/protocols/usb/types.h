@@ -36,6 +36,8 @@ using MaxPowerMilliAmps		= StrongType<uint8_t, struct MaxPowerMilliAmpsType>;
 using SelfPowered			= StrongType<bool, struct SelfPoweredType>;
 using RemoteWakeup			= StrongType<bool, struct RemoteWakeupType>;
 using Interval				= StrongType<uint8_t, struct IntervalType>;
+// True for USB Audio Class 1.0 endpoints, which have 9-byte endpoint descriptors (with bRefresh and bSynchAddress):
+using AudioEndpoint			= StrongType<bool, struct AudioEndpointType>;
 
 enum class USBVersion: uint16_t
 {
@@ -48,6 +50,12 @@ enum class DeviceClass: uint8_t
 {
 	// Means that each interface specifies its own class:
 	InterfaceSpecified	= 0x00,
+	Audio				= 0x01,
+	// Communications Device Class (communication interface):
+	CDC					= 0x02,
+	HID					= 0x03,
+	// Data interface of the Communications Device Class:
+	CDCData				= 0x0a,
 	// Means that class is vendor-specific:
 	VendorSpecified		= 0xff,
 };
@@ -14,6 +14,9 @@
 #ifndef MULABS_AVR__SUPPORT__PROTOCOLS__USB_STATE_H__INCLUDED
 #define MULABS_AVR__SUPPORT__PROTOCOLS__USB_STATE_H__INCLUDED
 
+// Mulabs:
+#include <mulabs_avr/support/protocols/usb/bulk_endpoint.h>
+
 namespace mulabs {
 namespace avr {
 namespace usb {
@@ -27,8 +30,15 @@ template<class cUSBSIE, cUSBSIE const& vUSBSIE, usb::Device const& vDevice, size
 		using OutputEndpoint	= typename USBSIE::OutputEndpoint;
 		using InputEndpoint		= typename USBSIE::InputEndpoint;
 
+		// Bus idle time after which the SIE reports suspend, in ms:
+		static constexpr uint8_t			kSuspendDetectionTime	= 3;
+		// Minimum bus idle time before the device may signal resume, in ms (USB 2.0 §7.1.7.7):
+		static constexpr uint8_t			kRemoteWakeupIdleTime	= 5;
+
 	  private:
-		static constexpr size_t				kMaxPacketSize	= vMaxPacketSize;
+		static constexpr size_t				kMaxPacketSize			= vMaxPacketSize;
+		static constexpr size_t				kEndpointBuffersSize	= vDevice.endpoint_buffers_size();
+		static constexpr uint8_t			kSuspendTimeNotStarted	= 0xff;
 
 	  public:
 		State (typename USBSIE::Speed);
@@ -39,34 +49,97 @@ template<class cUSBSIE, cUSBSIE const& vUSBSIE, usb::Device const& vDevice, size
 		void
 		reset();
 
-		template<class Debug>
+		/**
+		 * Handle USB interrupt. Trace is a trace sink (see SetupConductor::handle_interrupt()).
+		 * Bus-event interrupt flags must be cleared by the caller afterwards.
+		 */
+		template<class Trace>
 			void
-			handle_interrupt (Debug&& debug);
+			handle_interrupt (Trace&& trace);
 
-	  private:
-		constexpr size_t
-		required_buffers_size() const
-		{
-			return 400;
-			// TODO traverse vDevice and figure out max required buffers size
-		}
+		/**
+		 * Count time the bus is suspended. Call from a periodic interrupt that keeps running while suspended
+		 * (eg. RTC), with the period in ms. Without it remote_wakeup() is never allowed.
+		 */
+		void
+		handle_suspend_time (uint8_t elapsed_ms);
+
+		/**
+		 * Register handler (class driver) for requests addressed to given interface.
+		 * See SetupConductor::set_interface_handler().
+		 */
+		template<class Handler>
+			void
+			set_interface_handler (uint8_t interface, Handler&);
+
+		/**
+		 * Return current configuration or nullptr if device is not configured.
+		 */
+		usb::Configuration const*
+		configuration() const;
+
+		/**
+		 * Return true if the bus is suspended (host stopped sending frames). Bus-powered device must then draw
+		 * no more than 2.5 mA from the bus, see SuspendManager.
+		 */
+		bool
+		suspended() const;
+
+		/**
+		 * Return true if the host enabled remote wakeup for the device.
+		 */
+		bool
+		remote_wakeup_enabled() const;
+
+		/**
+		 * Return true if remote_wakeup() would signal resume: the bus is suspended, the host enabled remote wakeup
+		 * and the bus has been idle for at least kRemoteWakeupIdleTime (counted by handle_suspend_time()).
+		 */
+		bool
+		remote_wakeup_allowed() const;
+
+		/**
+		 * Signal remote wakeup to the host (resume the bus), if remote_wakeup_allowed().
+		 * Return true if resume was signalled.
+		 */
+		bool
+		remote_wakeup();
+
+		/**
+		 * Return the SIE endpoints table. Use it to construct non-control endpoints (eg. BulkInput, BulkOutput).
+		 */
+		EndpointsTable&
+		endpoints();
+
+		/**
+		 * Return buffer of given endpoint, allocated from the pool (see SetupConductor::endpoint_buffer()).
+		 * Valid only while the device is configured.
+		 */
+		Span<uint8_t>
+		endpoint_buffer (uint8_t address);
 
 	  private:
 		static constexpr USBSIE const&		_usb_sie					{ vUSBSIE };
 		static constexpr usb::Device const&	_device						{ vDevice };
 
 	  private:
-		usb::DeviceStrings<vDevice>			_usb_device_strings			{ };
-		usb::ConfigurationValue				_current_configuration		{ 0 };
 		typename USBSIE::Speed				_usb_speed;
+		Atomic<bool>						_suspended					{ false };
+		// Time counted by handle_suspend_time() since the Suspend interrupt, in ms (saturates at kRemoteWakeupIdleTime):
+		Atomic<uint8_t>						_suspended_time				{ kSuspendTimeNotStarted };
 		EndpointsTable						_endpoints					{ _device };
-		// TODO Array<uint8_t, required_buffers_size()>	_long_buffer;
+		// Buffers of endpoints other than the default control endpoint, sized exactly for the most demanding configuration:
+		alignas(2) Array<uint8_t, kEndpointBuffersSize>
+											_endpoint_buffers;
 		OutputEndpoint						_usb_control_out			{ _endpoints.nth_output (0) };
 		InputEndpoint						_usb_control_in				{ _endpoints.nth_input (0) };
 		Array<uint8_t, kMaxPacketSize>		_usb_control_buffer_in;
 		Array<uint8_t, kMaxPacketSize>		_usb_control_buffer_out;
-		usb::SetupConductor<USBSIE, _usb_sie, usb::DeviceStrings<vDevice>, decltype (_usb_control_buffer_in), decltype (_usb_control_buffer_out)>
-											_usb_setup_conductor		{ vDevice, _usb_device_strings, _usb_control_in, _usb_control_buffer_in, _usb_control_out, _usb_control_buffer_out };
+		usb::SetupConductor<USBSIE, _usb_sie, usb::DescriptorTable<vDevice>, decltype (_usb_control_buffer_in), decltype (_usb_control_buffer_out),
+							vDevice.maximum_number_of_interfaces()>
+											_usb_setup_conductor		{ vDevice, _endpoints.table(), _endpoint_buffers,
+																		  _usb_control_in, _usb_control_buffer_in,
+																		  _usb_control_out, _usb_control_buffer_out };
 	};
 
 
@@ -86,12 +159,12 @@ template<class cU, cU const& vU, usb::Device const& vD, size_t vM>
 
 		_usb_control_out.initialize();
 		_usb_control_out.set (USBSIE::Endpoint::Type::Control);
-		_usb_control_out.set_buffer (_usb_control_buffer_out.data(), USBSIE::Endpoint::ControlBulkBufferSize::_64);
+		_usb_control_out.set_buffer (_usb_control_buffer_out.data(), detail::bulk_buffer_size<typename USBSIE::Endpoint, kMaxPacketSize>());
 		_usb_control_out.set_ready();
 
 		_usb_control_in.initialize();
 		_usb_control_in.set (USBSIE::Endpoint::Type::Control);
-		_usb_control_in.set_buffer (_usb_control_buffer_in.data(), USBSIE::Endpoint::ControlBulkBufferSize::_64);
+		_usb_control_in.set_buffer (_usb_control_buffer_in.data(), detail::bulk_buffer_size<typename USBSIE::Endpoint, kMaxPacketSize>());
 		_usb_control_in.set_nack_all (USBSIE::Endpoint::Buffer::_0, true);
 		_usb_control_in.set_azlp_enabled (false);
 
@@ -120,13 +193,122 @@ template<class cU, cU const& vU, usb::Device const& vD, size_t vM>
 
 
 template<class cU, cU const& vU, usb::Device const& vD, size_t vM>
-	template<class Debug>
+	template<class Trace>
 		inline void
-		State<cU, vU, vD, vM>::handle_interrupt (Debug&& debug)
+		State<cU, vU, vD, vM>::handle_interrupt (Trace&& trace)
 		{
-			_usb_setup_conductor.handle_interrupt (debug);
+			using InterruptFlag = typename USBSIE::InterruptFlag;
+
+			if (_usb_sie.triggered (InterruptFlag::Suspend))
+			{
+				trace (TraceEvents::kSuspend);
+				_suspended_time.store (kSuspendTimeNotStarted);
+				_suspended.store (true);
+			}
+
+			// Bus reset also ends the suspend:
+			if (_usb_sie.triggered (InterruptFlag::Resume) || _usb_sie.triggered (InterruptFlag::Reset))
+			{
+				if (_suspended.load())
+					trace (TraceEvents::kResume);
+
+				_suspended.store (false);
+			}
+
+			_usb_setup_conductor.handle_interrupt (trace);
 		}
 
+
+template<class cU, cU const& vU, usb::Device const& vD, size_t vM>
+	inline void
+	State<cU, vU, vD, vM>::handle_suspend_time (uint8_t elapsed_ms)
+	{
+		if (!_suspended.load())
+			return;
+
+		uint8_t const time = _suspended_time.load();
+
+		// Suspend came at an arbitrary point of the period, so start counting at the first tick after it:
+		if (time == kSuspendTimeNotStarted)
+			_suspended_time.store (0);
+		else if (time < kRemoteWakeupIdleTime)
+			_suspended_time.store (elapsed_ms < kRemoteWakeupIdleTime - time ? time + elapsed_ms : kRemoteWakeupIdleTime);
+	}
+
+
+template<class cU, cU const& vU, usb::Device const& vD, size_t vM>
+	template<class Handler>
+		inline void
+		State<cU, vU, vD, vM>::set_interface_handler (uint8_t interface, Handler& handler)
+		{
+			_usb_setup_conductor.set_interface_handler (interface, handler);
+		}
+
+
+template<class cU, cU const& vU, usb::Device const& vD, size_t vM>
+	inline usb::Configuration const*
+	State<cU, vU, vD, vM>::configuration() const
+	{
+		return _usb_setup_conductor.configuration();
+	}
+
+
+template<class cU, cU const& vU, usb::Device const& vD, size_t vM>
+	inline bool
+	State<cU, vU, vD, vM>::suspended() const
+	{
+		return _suspended.load();
+	}
+
+
+template<class cU, cU const& vU, usb::Device const& vD, size_t vM>
+	inline bool
+	State<cU, vU, vD, vM>::remote_wakeup_enabled() const
+	{
+		return _usb_setup_conductor.remote_wakeup_enabled();
+	}
+
+
+template<class cU, cU const& vU, usb::Device const& vD, size_t vM>
+	inline bool
+	State<cU, vU, vD, vM>::remote_wakeup_allowed() const
+	{
+		uint8_t const time = _suspended_time.load();
+
+		// The SIE reports suspend after kSuspendDetectionTime of idle, the rest is counted by handle_suspend_time():
+		return _suspended.load() && remote_wakeup_enabled()
+			&& time != kSuspendTimeNotStarted && time >= kRemoteWakeupIdleTime - kSuspendDetectionTime;
+	}
+
+
+template<class cU, cU const& vU, usb::Device const& vD, size_t vM>
+	inline bool
+	State<cU, vU, vD, vM>::remote_wakeup()
+	{
+		if (!remote_wakeup_allowed())
+			return false;
+
+		// SIE sends the upstream resume and clears the bit; host then resumes the bus (Resume interrupt):
+		_usb_sie.set_rwakeup_enabled (true);
+		return true;
+	}
+
+
+template<class cU, cU const& vU, usb::Device const& vD, size_t vM>
+	inline auto
+	State<cU, vU, vD, vM>::endpoints() -> EndpointsTable&
+	{
+		return _endpoints;
+	}
+
+
+template<class cU, cU const& vU, usb::Device const& vD, size_t vM>
+	inline Span<uint8_t>
+	State<cU, vU, vD, vM>::endpoint_buffer (uint8_t address)
+	{
+		return _usb_setup_conductor.endpoint_buffer (address);
+	}
+
 } // namespace usb
 } // namespace avr
 } // namespace mulabs
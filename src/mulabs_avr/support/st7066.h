@@ -14,11 +14,9 @@
 #ifndef MULABS_AVR__SUPPORT__ST7066_H__INCLUDED
 #define MULABS_AVR__SUPPORT__ST7066_H__INCLUDED
 
-// AVR:
-#include <avr/io.h>
-
 // Local:
 #include <mulabs_avr/avr/interrupts_lock.h>
+#include <mulabs_avr/utility/flash_constring.h>
 
 
 namespace mulabs {
@@ -41,12 +39,18 @@ namespace avr {
  *			Also it should contain constexpr uint8_t:
  *
  *			  * row_pitch (number of columns in the display)
+ *
+ *			and the MCU policy type:
+ *
+ *			  * using MCU = …
  */
 template<class tConfig>
 	class ST7066
 	{
 	  public:
 		typedef tConfig Config;
+		typedef typename Config::MCU MCU;
+		typedef typename MCU::Pin Pin;
 
 		enum class WriteMode: uint8_t
 		{
@@ -209,6 +213,12 @@ template<class tConfig>
 		static void
 		print (const char* string);
 
+		/**
+		 * Print string stored in program memory under cursor position.
+		 */
+		static void
+		print (FlashConstring<char> const& string);
+
 	  protected:
 		/**
 		 * Return true if the display is busy processing and can't
@@ -236,6 +246,12 @@ template<class tConfig>
 		static void
 		write();
 
+		/**
+		 * Write single character to the display RAM.
+		 */
+		static void
+		write_data (uint8_t byte);
+
 		/**
 		 * Prepare for read.
 		 */
@@ -283,16 +299,16 @@ template<class P>
 	ST7066<P>::ST7066()
 	{
 		Config::e.configure_as_input();
-		Config::e.set_tri_state();
+		Config::e.set (Pin::Configuration::TotemPole);
 		Config::rs.configure_as_input();
-		Config::rs.set_tri_state();
+		Config::rs.set (Pin::Configuration::TotemPole);
 		Config::rw.configure_as_input();
-		Config::rw.set_tri_state();
+		Config::rw.set (Pin::Configuration::TotemPole);
 		configure_as_input();
-		Config::db_4.pull_up();
-		Config::db_5.pull_up();
-		Config::db_6.pull_up();
-		Config::db_7.pull_up();
+		Config::db_4.set (Pin::Configuration::PullUp);
+		Config::db_5.set (Pin::Configuration::PullUp);
+		Config::db_6.set (Pin::Configuration::PullUp);
+		Config::db_7.set (Pin::Configuration::PullUp);
 	}
 
 
@@ -324,18 +340,18 @@ template<class P>
 		// Three times according to doc:
 		for (int i = 0; i < 3; ++i)
 		{
-			Config::db_4.set (1);
-			Config::db_5.set (1);
-			Config::db_6.set (0);
-			Config::db_7.set (0);
+			Config::db_4 = 1;
+			Config::db_5 = 1;
+			Config::db_6 = 0;
+			Config::db_7 = 0;
 			write();
-			MCU::sleep_ms<5>();
+			MCU::template sleep_ms<5>();
 		}
 
 		// Select 4-bit interface:
-		Config::db_4.set (!!static_cast<uint8_t> (interface));
+		Config::db_4 = !!static_cast<uint8_t> (interface);
 		write();
-		MCU::sleep_ms<5>();
+		MCU::template sleep_ms<5>();
 
 		set_lines_and_font (lines, font);
 		set_display_options (Display::Off, Cursor::Off, CursorBlinking::Off);
@@ -369,13 +385,13 @@ template<class P>
 
 		wait();
 		prepare_for_write (WriteMode::Instruction);
-		Config::db_4.set (!!static_cast<uint8_t> (_interface));
-		Config::db_5.set (1);
-		Config::db_6.set (0);
-		Config::db_7.set (0);
+		Config::db_4 = !!static_cast<uint8_t> (_interface);
+		Config::db_5 = 1;
+		Config::db_6 = 0;
+		Config::db_7 = 0;
 		write();
-		Config::db_6.set (!!static_cast<uint8_t> (font));
-		Config::db_7.set (!!static_cast<uint8_t> (lines));
+		Config::db_6 = !!static_cast<uint8_t> (font);
+		Config::db_7 = !!static_cast<uint8_t> (lines);
 		write();
 	}
 
@@ -414,15 +430,15 @@ template<class P>
 
 		wait();
 		prepare_for_write (WriteMode::Instruction);
-		Config::db_4.set (0);
-		Config::db_5.set (0);
-		Config::db_6.set (0);
-		Config::db_7.set (0);
+		Config::db_4 = 0;
+		Config::db_5 = 0;
+		Config::db_6 = 0;
+		Config::db_7 = 0;
 		write();
-		Config::db_4.set (!!static_cast<uint8_t> (cursor_blinking));
-		Config::db_5.set (!!static_cast<uint8_t> (cursor));
-		Config::db_6.set (!!static_cast<uint8_t> (display));
-		Config::db_7.set (1);
+		Config::db_4 = !!static_cast<uint8_t> (cursor_blinking);
+		Config::db_5 = !!static_cast<uint8_t> (cursor);
+		Config::db_6 = !!static_cast<uint8_t> (display);
+		Config::db_7 = 1;
 		write();
 	}
 
@@ -452,14 +468,14 @@ template<class P>
 
 		wait();
 		prepare_for_write (WriteMode::Instruction);
-		Config::db_4.set (0);
-		Config::db_5.set (0);
-		Config::db_6.set (0);
-		Config::db_7.set (0);
+		Config::db_4 = 0;
+		Config::db_5 = 0;
+		Config::db_6 = 0;
+		Config::db_7 = 0;
 		write();
-		Config::db_4.set (!!static_cast<uint8_t> (shifting));
-		Config::db_5.set (!!static_cast<uint8_t> (cursor_direction));
-		Config::db_6.set (!!static_cast<uint8_t> (1));
+		Config::db_4 = !!static_cast<uint8_t> (shifting);
+		Config::db_5 = !!static_cast<uint8_t> (cursor_direction);
+		Config::db_6 = !!static_cast<uint8_t> (1);
 		write();
 	}
 
@@ -470,12 +486,12 @@ template<class P>
 	{
 		wait();
 		prepare_for_write (WriteMode::Instruction);
-		Config::db_4.set (0);
-		Config::db_5.set (0);
-		Config::db_6.set (0);
-		Config::db_7.set (0);
+		Config::db_4 = 0;
+		Config::db_5 = 0;
+		Config::db_6 = 0;
+		Config::db_7 = 0;
 		write();
-		Config::db_4.set (1);
+		Config::db_4 = 1;
 		write();
 	}
 
@@ -487,15 +503,15 @@ template<class P>
 		_ddram_addr = Config::row_pitch * row + column;
 		wait();
 		prepare_for_write (WriteMode::Instruction);
-		Config::db_4.set (get_bit (_ddram_addr, 4));
-		Config::db_5.set (get_bit (_ddram_addr, 5));
-		Config::db_6.set (get_bit (_ddram_addr, 6));
-		Config::db_7.set (1);
+		Config::db_4 = get_bit<4> (_ddram_addr);
+		Config::db_5 = get_bit<5> (_ddram_addr);
+		Config::db_6 = get_bit<6> (_ddram_addr);
+		Config::db_7 = 1;
 		write();
-		Config::db_4.set (get_bit (_ddram_addr, 0));
-		Config::db_5.set (get_bit (_ddram_addr, 1));
-		Config::db_6.set (get_bit (_ddram_addr, 2));
-		Config::db_7.set (get_bit (_ddram_addr, 3));
+		Config::db_4 = get_bit<0> (_ddram_addr);
+		Config::db_5 = get_bit<1> (_ddram_addr);
+		Config::db_6 = get_bit<2> (_ddram_addr);
+		Config::db_7 = get_bit<3> (_ddram_addr);
 		write();
 	}
 
@@ -505,20 +521,16 @@ template<class P>
 	ST7066<P>::print (const char* string)
 	{
 		for (const char* c = string; *c != 0; ++c)
-		{
-			wait();
-			prepare_for_write (WriteMode::Data);
-			Config::db_4.set (get_bit<uint8_t> (*c, 4));
-			Config::db_5.set (get_bit<uint8_t> (*c, 5));
-			Config::db_6.set (get_bit<uint8_t> (*c, 6));
-			Config::db_7.set (get_bit<uint8_t> (*c, 7));
-			write();
-			Config::db_4.set (get_bit<uint8_t> (*c, 0));
-			Config::db_5.set (get_bit<uint8_t> (*c, 1));
-			Config::db_6.set (get_bit<uint8_t> (*c, 2));
-			Config::db_7.set (get_bit<uint8_t> (*c, 3));
-			write();
-		}
+			write_data (*c);
+	}
+
+
+template<class P>
+	inline void
+	ST7066<P>::print (FlashConstring<char> const& string)
+	{
+		for (char c: string)
+			write_data (c);
 	}
 
 
@@ -528,7 +540,7 @@ template<class P>
 	{
 		prepare_for_read (ReadMode::BusyAddress);
 		read();
-		bool b = Config::db_7.read();
+		bool b = Config::db_7.get();
 		read(); // Read lower 4-bits:
 		return b;
 	}
@@ -548,7 +560,7 @@ template<class P>
 	ST7066<P>::prepare_for_write (WriteMode mode)
 	{
 		Config::rw.set_low();
-		Config::rs.set (!!static_cast<uint8_t> (mode));
+		Config::rs = !!static_cast<uint8_t> (mode);
 		configure_as_output();
 	}
 
@@ -559,11 +571,11 @@ template<class P>
 	{
 		// The data line must be stable for at least 40 ns (according to doc)
 		// before executing instruction.
-		MCU::sleep_us<1>();
+		MCU::template sleep_us<1>();
 		Config::e.set_high();
 		// Minimum time for data to be read by the display
 		// is 10 ns.
-		MCU::sleep_us<1>();
+		MCU::template sleep_us<1>();
 		Config::e.set_low();
 		// According to docs, minimum 'e' pin high time is 140 ns.
 		// Also the total cycle time between subsequent e.set_high()
@@ -572,12 +584,31 @@ template<class P>
 	}
 
 
+template<class P>
+	inline void
+	ST7066<P>::write_data (uint8_t byte)
+	{
+		wait();
+		prepare_for_write (WriteMode::Data);
+		Config::db_4 = get_bit<4> (byte);
+		Config::db_5 = get_bit<5> (byte);
+		Config::db_6 = get_bit<6> (byte);
+		Config::db_7 = get_bit<7> (byte);
+		write();
+		Config::db_4 = get_bit<0> (byte);
+		Config::db_5 = get_bit<1> (byte);
+		Config::db_6 = get_bit<2> (byte);
+		Config::db_7 = get_bit<3> (byte);
+		write();
+	}
+
+
 template<class P>
 	inline void
 	ST7066<P>::prepare_for_read (ReadMode mode)
 	{
 		Config::rw.set_high();
-		Config::rs.set (!!static_cast<uint8_t> (mode));
+		Config::rs = !!static_cast<uint8_t> (mode);
 		configure_as_input();
 	}
 
@@ -587,7 +618,7 @@ template<class P>
 	ST7066<P>::read()
 	{
 		Config::e.set_high();
-		MCU::sleep_us<1>();
+		MCU::template sleep_us<1>();
 		Config::e.set_low();
 		// Maximum delay before data line is stable is 100 ns.
 	}
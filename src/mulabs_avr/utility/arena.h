@@ -0,0 +1,299 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__UTILITY__ARENA_H__INCLUDED
+#define MULABS_AVR__UTILITY__ARENA_H__INCLUDED
+
+// Standard:
+#include <stddef.h>
+#include <stdint.h>
+
+// Mulabs:
+#include <mulabs_avr/utility/array.h>
+#include <mulabs_avr/utility/span.h>
+
+
+namespace mulabs {
+namespace avr {
+
+/**
+ * Bump allocator over a static Array<uint8_t, pSize>. Allocation is O(1) and there's no per-block
+ * deallocation - memory is released by rewinding to a previously taken mark, usually with ScopedArena.
+ * Tracks peak usage, so the size can be tuned to what the program really needs.
+ *
+ * Not interrupt-safe; use each arena from one context only.
+ */
+template<size_t pSize>
+	class Arena
+	{
+	  public:
+		static constexpr size_t kSize = pSize;
+
+		// Position in the arena, returned by mark().
+		using Mark = size_t;
+
+	  public:
+		// Ctor
+		Arena() = default;
+
+		// Copy ctor
+		Arena (Arena const&) = delete;
+
+		// Copy operator
+		Arena const&
+		operator= (Arena const&) = delete;
+
+		/**
+		 * Allocate size bytes aligned to given alignment (must be a power of two).
+		 * Return nullptr if there's not enough space.
+		 */
+		uint8_t*
+		allocate (size_t size, size_t alignment = 1);
+
+		/**
+		 * Allocate space for count values of type T (which are not constructed).
+		 * Return empty span if there's not enough space.
+		 */
+		template<class T>
+			Span<T>
+			allocate_span (size_t count);
+
+		/**
+		 * Return current position, for use with rewind().
+		 */
+		Mark
+		mark() const;
+
+		/**
+		 * Release everything allocated after given mark was taken.
+		 */
+		void
+		rewind (Mark);
+
+		/**
+		 * Number of bytes allocated now.
+		 */
+		size_t
+		used() const;
+
+		/**
+		 * Number of bytes that can still be allocated (not counting alignment padding).
+		 */
+		size_t
+		available() const;
+
+		/**
+		 * Maximum number of bytes that were ever allocated at once.
+		 */
+		size_t
+		peak() const;
+
+		/**
+		 * Number of allocations that failed because the arena was full.
+		 */
+		size_t
+		failures() const;
+
+	  private:
+		Array<uint8_t, kSize>	_storage;
+		size_t					_used		{ 0 };
+		size_t					_peak		{ 0 };
+		size_t					_failures	{ 0 };
+	};
+
+
+/**
+ * Takes a mark of the arena on construction and rewinds to it on destruction, so that all allocations done
+ * within the scope are released at once:
+ *
+ *   {
+ *       ScopedArena scratch (arena);
+ *       auto buffer = scratch.allocate_span<uint8_t> (length);
+ *       …
+ *   } // buffer released here.
+ */
+template<class pArena>
+	class ScopedArena
+	{
+	  public:
+		using Arena	= pArena;
+		using Mark	= typename Arena::Mark;
+
+	  public:
+		// Ctor
+		explicit
+		ScopedArena (Arena&);
+
+		// Copy ctor
+		ScopedArena (ScopedArena const&) = delete;
+
+		// Dtor
+		~ScopedArena();
+
+		// Copy operator
+		ScopedArena const&
+		operator= (ScopedArena const&) = delete;
+
+		/**
+		 * See Arena::allocate().
+		 */
+		uint8_t*
+		allocate (size_t size, size_t alignment = 1);
+
+		/**
+		 * See Arena::allocate_span().
+		 */
+		template<class T>
+			Span<T>
+			allocate_span (size_t count);
+
+		/**
+		 * Return the underlying arena.
+		 */
+		Arena&
+		arena() const;
+
+	  private:
+		Arena&		_arena;
+		Mark const	_mark;
+	};
+
+
+template<size_t S>
+	inline uint8_t*
+	Arena<S>::allocate (size_t size, size_t alignment)
+	{
+		auto const base = reinterpret_cast<uintptr_t> (_storage.data());
+		size_t const aligned = ((base + _used + alignment - 1) & ~(static_cast<uintptr_t> (alignment) - 1)) - base;
+
+		if (aligned > kSize || size > kSize - aligned)
+		{
+			++_failures;
+			return nullptr;
+		}
+
+		_used = aligned + size;
+
+		if (_used > _peak)
+			_peak = _used;
+
+		return _storage.data() + aligned;
+	}
+
+
+template<size_t S>
+	template<class T>
+		inline Span<T>
+		Arena<S>::allocate_span (size_t count)
+		{
+			if (auto* data = allocate (count * sizeof (T), alignof (T)))
+				return { reinterpret_cast<T*> (data), count };
+			else
+				return { };
+		}
+
+
+template<size_t S>
+	inline auto
+	Arena<S>::mark() const -> Mark
+	{
+		return _used;
+	}
+
+
+template<size_t S>
+	inline void
+	Arena<S>::rewind (Mark mark)
+	{
+		if (mark < _used)
+			_used = mark;
+	}
+
+
+template<size_t S>
+	inline size_t
+	Arena<S>::used() const
+	{
+		return _used;
+	}
+
+
+template<size_t S>
+	inline size_t
+	Arena<S>::available() const
+	{
+		return kSize - _used;
+	}
+
+
+template<size_t S>
+	inline size_t
+	Arena<S>::peak() const
+	{
+		return _peak;
+	}
+
+
+template<size_t S>
+	inline size_t
+	Arena<S>::failures() const
+	{
+		return _failures;
+	}
+
+
+template<class A>
+	inline
+	ScopedArena<A>::ScopedArena (Arena& arena):
+		_arena (arena),
+		_mark (arena.mark())
+	{ }
+
+
+template<class A>
+	inline
+	ScopedArena<A>::~ScopedArena()
+	{
+		_arena.rewind (_mark);
+	}
+
+
+template<class A>
+	inline uint8_t*
+	ScopedArena<A>::allocate (size_t size, size_t alignment)
+	{
+		return _arena.allocate (size, alignment);
+	}
+
+
+template<class A>
+	template<class T>
+		inline Span<T>
+		ScopedArena<A>::allocate_span (size_t count)
+		{
+			return _arena.template allocate_span<T> (count);
+		}
+
+
+template<class A>
+	inline auto
+	ScopedArena<A>::arena() const -> Arena&
+	{
+		return _arena;
+	}
+
+} // namespace avr
+} // namespace mulabs
+
+#endif
+
@@ -15,6 +15,7 @@
 #define MULABS_AVR__UTILITY__ATOMIC_H__INCLUDED
 
 // Mulabs:
+#include <mulabs_avr/avr/interrupts_lock.h>
 #include <mulabs_avr/utility/bits.h>
 
 
@@ -107,6 +108,9 @@ template<class V>
  *
  * Warning: These atomic instructions do not work on memory-mapped registers. Only regular SRAM memory can be modified
  * with these. Also memory modified by the instructions must be within first 64 kB of SRAM.
+ *
+ * LAS/LAC/LAT are only available on XMEGA. On other AVRs (like ATMega32U4) these functions do a read-modify-write
+ * with interrupts disabled.
  */
 
 
@@ -114,6 +118,7 @@ template<uint8_t BitMask>
 	inline void
 	atomic_sram_set_bitmask_value (uint8_t volatile& where, bool value)
 	{
+#ifdef __AVR_XMEGA__
 		if (value)
 		{
 			asm volatile (
@@ -134,6 +139,14 @@ template<uint8_t BitMask>
 				: "r16"
 			);
 		}
+#else
+		InterruptsLock lock;
+
+		if (value)
+			where = where | BitMask;
+		else
+			where = where & ~BitMask;
+#endif
 	}
 
 
@@ -177,10 +190,40 @@ template<uint8_t Bit>
 	}
 
 
+/**
+ * Clear bits and return the value from before clearing.
+ */
+template<uint8_t BitMask>
+	inline uint8_t
+	atomic_sram_fetch_and_clear_bitmask (uint8_t volatile& where)
+	{
+#ifdef __AVR_XMEGA__
+		uint8_t previous;
+
+		asm volatile (
+			"ldi	r16, %[mask]	\n\t"
+			".dc.w	0x9306			\n\t" // LAC instruction, leaves previous value in r16
+			"mov	%[previous], r16	\n\t"
+			: "+m" (where), [previous] "=r" (previous)
+			: "z" (&where), [mask] "i" (BitMask)
+			: "r16"
+		);
+
+		return previous;
+#else
+		InterruptsLock lock;
+		uint8_t const previous = where;
+		where = previous & ~BitMask;
+		return previous;
+#endif
+	}
+
+
 template<uint8_t BitMask>
 	inline void
 	atomic_sram_toggle_bitmask (uint8_t volatile& where)
 	{
+#ifdef __AVR_XMEGA__
 		asm volatile (
 			"ldi	r16, %[mask]	\n\t"
 			".dc.w	0x9307			\n\t" // LAT instruction
@@ -188,6 +231,10 @@ template<uint8_t BitMask>
 			: "z" (&where), [mask] "i" (BitMask)
 			: "r16"
 		);
+#else
+		InterruptsLock lock;
+		where = where ^ BitMask;
+#endif
 	}
 
 
@@ -198,6 +245,19 @@ template<uint8_t Bit>
 		atomic_sram_toggle_bitmask<bit<Bit>> (where);
 	}
 
+
+/**
+ * Prevent the compiler from moving memory accesses across this point.
+ * Needed when a volatile store publishes non-volatile data written before it (or a volatile load guards
+ * non-volatile reads done after it), since the compiler is free to reorder non-volatile accesses around
+ * volatile ones. Generates no code.
+ */
+inline void
+compiler_barrier()
+{
+	asm volatile ("" ::: "memory");
+}
+
 } // namespace avr
 } // namespace mulabs
 
@@ -0,0 +1,64 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__UTILITY__EAGER_STATIC_H__INCLUDED
+#define MULABS_AVR__UTILITY__EAGER_STATIC_H__INCLUDED
+
+
+namespace mulabs {
+namespace avr {
+
+/**
+ * Object of type pValue created by pFactory during static initialization (before main()), instead of on first use
+ * like a function-local static. Accessing it needs no guard check.
+ * There's one instance per <pValue, pFactory> pair.
+ */
+template<class pValue, pValue (*pFactory)()>
+	struct EagerStatic
+	{
+		static pValue instance;
+	};
+
+
+template<class V, V (*F)()>
+	V EagerStatic<V, F>::instance = F();
+
+} // namespace avr
+} // namespace mulabs
+
+
+/**
+ * Declare function-local object `name` of given type, created by calling factory.
+ *
+ * By default this is a regular function-local static, initialized on first use (and guarded, see cxa.cc).
+ * When MULABS_AVR_EAGER_STATICS is defined, the object is created at startup instead and the hot path doesn't
+ * check the guard at all:
+ *
+ *   Table make_table();
+ *
+ *   void f()
+ *   {
+ *       MULABS_AVR_STATIC_LOCAL (Table, table, make_table);
+ *       table.lookup (…);
+ *   }
+ */
+#ifdef MULABS_AVR_EAGER_STATICS
+# define MULABS_AVR_STATIC_LOCAL(type, name, factory) \
+	type& name = ::mulabs::avr::EagerStatic<type, factory>::instance
+#else
+# define MULABS_AVR_STATIC_LOCAL(type, name, factory) \
+	static type name = factory()
+#endif
+
+#endif
+
@@ -0,0 +1,245 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__UTILITY__EVENT_FLAGS_H__INCLUDED
+#define MULABS_AVR__UTILITY__EVENT_FLAGS_H__INCLUDED
+
+// Standard:
+#include <stdint.h>
+
+// Mulabs:
+#include <mulabs_avr/utility/atomic.h>
+#include <mulabs_avr/utility/bits.h>
+
+
+namespace mulabs {
+namespace avr {
+
+/**
+ * Group of up to 8 event flags that can be raised from ISRs and consumed by the main loop (or the other
+ * way around) without disabling interrupts. Modifications use the XMEGA LAS/LAC/LAT instructions;
+ * on other AVRs they fall back to a short read-modify-write with interrupts disabled.
+ *
+ * Flags are selected with compile-time masks, eg.:
+ *
+ *   enum Event: uint8_t { RxReady = bit8<0>, TxEmpty = bit8<1> };
+ *   EventFlags<2> events;
+ *
+ *   // ISR:
+ *   events.set<RxReady>();
+ *
+ *   // Main loop:
+ *   auto raised = events.wait_any<RxReady | TxEmpty>();
+ *
+ * Since instructions operate on SRAM, object must be placed in the first 64 kB of SRAM (see atomic.h).
+ */
+template<uint8_t pNumFlags = 8>
+	class EventFlags
+	{
+		static_assert (pNumFlags >= 1 && pNumFlags <= 8, "EventFlags supports 1…8 flags");
+
+	  public:
+		using Mask = uint8_t;
+
+		static constexpr Mask kAllFlags = mask_of_ones<pNumFlags - 1, 0, Mask>();
+
+	  public:
+		// Ctor
+		EventFlags() = default;
+
+		// Copy ctor
+		EventFlags (EventFlags const&) = delete;
+
+		// Copy operator
+		EventFlags const&
+		operator= (EventFlags const&) = delete;
+
+		/**
+		 * Return current state of all flags.
+		 */
+		Mask
+		get() const;
+
+		/**
+		 * Raise selected flags.
+		 */
+		template<Mask FlagsMask>
+			void
+			set();
+
+		/**
+		 * Lower selected flags.
+		 */
+		template<Mask FlagsMask>
+			void
+			clear();
+
+		/**
+		 * Toggle selected flags.
+		 */
+		template<Mask FlagsMask>
+			void
+			toggle();
+
+		/**
+		 * Return true if any of selected flags is raised.
+		 */
+		template<Mask FlagsMask>
+			bool
+			test_any() const;
+
+		/**
+		 * Return true if all of selected flags are raised.
+		 */
+		template<Mask FlagsMask>
+			bool
+			test_all() const;
+
+		/**
+		 * Atomically lower selected flags and return which of them were raised.
+		 */
+		template<Mask FlagsMask>
+			Mask
+			test_and_clear();
+
+		/**
+		 * Wait until any of selected flags is raised, then lower selected flags
+		 * and return which of them were raised.
+		 */
+		template<Mask FlagsMask>
+			Mask
+			wait_any();
+
+		/**
+		 * Wait until all selected flags are raised, then lower them.
+		 */
+		template<Mask FlagsMask>
+			void
+			wait_all();
+
+	  private:
+		template<Mask FlagsMask>
+			static constexpr void
+			check_mask();
+
+	  private:
+		uint8_t volatile _flags { 0 };
+	};
+
+
+template<uint8_t N>
+	inline auto
+	EventFlags<N>::get() const -> Mask
+	{
+		return _flags;
+	}
+
+
+template<uint8_t N>
+	template<typename EventFlags<N>::Mask FlagsMask>
+		inline void
+		EventFlags<N>::set()
+		{
+			check_mask<FlagsMask>();
+			atomic_sram_set_bitmask<FlagsMask> (_flags);
+		}
+
+
+template<uint8_t N>
+	template<typename EventFlags<N>::Mask FlagsMask>
+		inline void
+		EventFlags<N>::clear()
+		{
+			check_mask<FlagsMask>();
+			atomic_sram_clear_bitmask<FlagsMask> (_flags);
+		}
+
+
+template<uint8_t N>
+	template<typename EventFlags<N>::Mask FlagsMask>
+		inline void
+		EventFlags<N>::toggle()
+		{
+			check_mask<FlagsMask>();
+			atomic_sram_toggle_bitmask<FlagsMask> (_flags);
+		}
+
+
+template<uint8_t N>
+	template<typename EventFlags<N>::Mask FlagsMask>
+		inline bool
+		EventFlags<N>::test_any() const
+		{
+			check_mask<FlagsMask>();
+			return (_flags & FlagsMask) != 0;
+		}
+
+
+template<uint8_t N>
+	template<typename EventFlags<N>::Mask FlagsMask>
+		inline bool
+		EventFlags<N>::test_all() const
+		{
+			check_mask<FlagsMask>();
+			return (_flags & FlagsMask) == FlagsMask;
+		}
+
+
+template<uint8_t N>
+	template<typename EventFlags<N>::Mask FlagsMask>
+		inline auto
+		EventFlags<N>::test_and_clear() -> Mask
+		{
+			check_mask<FlagsMask>();
+			return atomic_sram_fetch_and_clear_bitmask<FlagsMask> (_flags) & FlagsMask;
+		}
+
+
+template<uint8_t N>
+	template<typename EventFlags<N>::Mask FlagsMask>
+		inline auto
+		EventFlags<N>::wait_any() -> Mask
+		{
+			while (!test_any<FlagsMask>())
+				continue;
+
+			return test_and_clear<FlagsMask>();
+		}
+
+
+template<uint8_t N>
+	template<typename EventFlags<N>::Mask FlagsMask>
+		inline void
+		EventFlags<N>::wait_all()
+		{
+			while (!test_all<FlagsMask>())
+				continue;
+
+			clear<FlagsMask>();
+		}
+
+
+template<uint8_t N>
+	template<typename EventFlags<N>::Mask FlagsMask>
+		constexpr void
+		EventFlags<N>::check_mask()
+		{
+			static_assert (FlagsMask != 0, "empty flags mask");
+			static_assert ((FlagsMask & ~kAllFlags) == 0, "flags mask refers to nonexistent flags");
+		}
+
+} // namespace avr
+} // namespace mulabs
+
+#endif
+
@@ -0,0 +1,279 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__UTILITY__FIXED_BLOCK_POOL_H__INCLUDED
+#define MULABS_AVR__UTILITY__FIXED_BLOCK_POOL_H__INCLUDED
+
+// Standard:
+#include <stddef.h>
+#include <stdint.h>
+
+// Mulabs:
+#include <mulabs_avr/avr/interrupts_lock.h>
+
+
+namespace mulabs {
+namespace avr {
+
+/**
+ * Statistics of a block pool.
+ */
+struct BlockPoolStatistics
+{
+	size_t	in_use		= 0;	// Number of blocks currently allocated.
+	size_t	high_water	= 0;	// Maximum value of in_use ever seen.
+	size_t	failures	= 0;	// Number of allocations that failed because the pool was exhausted.
+};
+
+
+/**
+ * Pool of pCount blocks of pBlockSize bytes each, placed in static storage.
+ * Allocation and deallocation are O(1) and may be called from ISRs: interrupts are disabled only for
+ * the few instructions that update the free list.
+ *
+ * Blocks are handed out from the never-used area first and from the free list after that, so construction
+ * doesn't have to walk the storage.
+ */
+template<size_t pBlockSize, size_t pCount>
+	class FixedBlockPool
+	{
+		static_assert (pBlockSize > 0, "block size must not be 0");
+		static_assert (pCount > 0, "count must not be 0");
+
+		struct FreeBlock
+		{
+			FreeBlock* next;
+		};
+
+	  public:
+		static constexpr size_t kBlockSize	= pBlockSize;
+		static constexpr size_t kCount		= pCount;
+
+	  private:
+		// Every block must be able to hold the free-list pointer and be aligned for it:
+		static constexpr size_t kStride = ((kBlockSize < sizeof (FreeBlock) ? sizeof (FreeBlock) : kBlockSize) + alignof (FreeBlock) - 1)
+										  / alignof (FreeBlock) * alignof (FreeBlock);
+
+	  public:
+		// Ctor
+		FixedBlockPool() = default;
+
+		// Copy ctor
+		FixedBlockPool (FixedBlockPool const&) = delete;
+
+		// Copy operator
+		FixedBlockPool const&
+		operator= (FixedBlockPool const&) = delete;
+
+		/**
+		 * Allocate a block. Return nullptr if the pool is exhausted.
+		 */
+		void*
+		allocate() noexcept;
+
+		/**
+		 * Return block to the pool. Pointer must come from allocate() of this pool.
+		 * Null pointer is ignored.
+		 */
+		void
+		deallocate (void*) noexcept;
+
+		/**
+		 * Return true if pointer points into this pool's storage.
+		 */
+		bool
+		owns (void const*) const noexcept;
+
+		/**
+		 * Return usage statistics.
+		 */
+		BlockPoolStatistics
+		statistics() const noexcept;
+
+	  private:
+		alignas (FreeBlock) uint8_t	_storage[kStride * kCount];
+		FreeBlock*					_free_list		{ nullptr };
+		size_t						_untouched		{ 0 };
+		BlockPoolStatistics			_statistics;
+	};
+
+
+/**
+ * Set of FixedBlockPools of different size classes. Allocation takes a block from the smallest pool
+ * that fits the requested size; if that pool is exhausted, the next bigger one is tried.
+ * Pools must be listed in order of increasing block size.
+ *
+ * Usage:
+ *   BlockPools<FixedBlockPool<8, 32>, FixedBlockPool<32, 8>, FixedBlockPool<128, 2>> pools;
+ */
+template<class ...pPools>
+	class BlockPools;
+
+
+template<>
+	class BlockPools<>
+	{
+	  public:
+		static constexpr size_t kMinBlockSize = static_cast<size_t> (-1);
+
+	  public:
+		static void*
+		allocate (size_t) noexcept
+		{
+			return nullptr;
+		}
+
+		static bool
+		deallocate (void*) noexcept
+		{
+			return false;
+		}
+	};
+
+
+template<class pPool, class ...pRest>
+	class BlockPools<pPool, pRest...>
+	{
+		static_assert (pPool::kBlockSize < BlockPools<pRest...>::kMinBlockSize, "pools must be ordered by increasing block size");
+
+	  public:
+		static constexpr size_t kMinBlockSize = pPool::kBlockSize;
+
+	  public:
+		/**
+		 * Allocate a block of at least given size. Return nullptr if there's no free block big enough.
+		 */
+		void*
+		allocate (size_t size) noexcept;
+
+		/**
+		 * Return block to the pool it came from. Return false if the pointer doesn't belong to any pool.
+		 */
+		bool
+		deallocate (void*) noexcept;
+
+		/**
+		 * Access the N-th pool (eg. to read its statistics).
+		 */
+		template<size_t N>
+			auto&
+			pool() noexcept;
+
+	  private:
+		pPool					_pool;
+		BlockPools<pRest...>	_rest;
+	};
+
+
+template<size_t B, size_t C>
+	inline void*
+	FixedBlockPool<B, C>::allocate() noexcept
+	{
+		InterruptsLock lock;
+		void* block = nullptr;
+
+		if (_free_list)
+		{
+			block = _free_list;
+			_free_list = _free_list->next;
+		}
+		else if (_untouched < kCount)
+			block = &_storage[kStride * _untouched++];
+
+		if (block)
+		{
+			if (++_statistics.in_use > _statistics.high_water)
+				_statistics.high_water = _statistics.in_use;
+		}
+		else
+			++_statistics.failures;
+
+		return block;
+	}
+
+
+template<size_t B, size_t C>
+	inline void
+	FixedBlockPool<B, C>::deallocate (void* pointer) noexcept
+	{
+		if (!pointer)
+			return;
+
+		InterruptsLock lock;
+		auto* block = static_cast<FreeBlock*> (pointer);
+		block->next = _free_list;
+		_free_list = block;
+		--_statistics.in_use;
+	}
+
+
+template<size_t B, size_t C>
+	inline bool
+	FixedBlockPool<B, C>::owns (void const* pointer) const noexcept
+	{
+		auto const* byte = static_cast<uint8_t const*> (pointer);
+		return byte >= _storage && byte < _storage + sizeof (_storage);
+	}
+
+
+template<size_t B, size_t C>
+	inline BlockPoolStatistics
+	FixedBlockPool<B, C>::statistics() const noexcept
+	{
+		InterruptsLock lock;
+		return _statistics;
+	}
+
+
+template<class P, class ...R>
+	inline void*
+	BlockPools<P, R...>::allocate (size_t size) noexcept
+	{
+		if (size <= P::kBlockSize)
+			if (void* block = _pool.allocate())
+				return block;
+
+		return _rest.allocate (size);
+	}
+
+
+template<class P, class ...R>
+	inline bool
+	BlockPools<P, R...>::deallocate (void* pointer) noexcept
+	{
+		if (_pool.owns (pointer))
+		{
+			_pool.deallocate (pointer);
+			return true;
+		}
+		else
+			return _rest.deallocate (pointer);
+	}
+
+
+template<class P, class ...R>
+	template<size_t N>
+		inline auto&
+		BlockPools<P, R...>::pool() noexcept
+		{
+			if constexpr (N == 0)
+				return _pool;
+			else
+				return _rest.template pool<N - 1>();
+		}
+
+} // namespace avr
+} // namespace mulabs
+
+#endif
+
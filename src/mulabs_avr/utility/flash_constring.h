@@ -0,0 +1,271 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__UTILITY__FLASH_CONSTRING_H__INCLUDED
+#define MULABS_AVR__UTILITY__FLASH_CONSTRING_H__INCLUDED
+
+// Standard:
+#include <stddef.h>
+#include <stdint.h>
+
+// Mulabs:
+#include <mulabs_avr/utility/constring.h>
+#include <mulabs_avr/utility/flash_span.h>
+#include <mulabs_avr/utility/span.h>
+
+
+namespace mulabs {
+namespace avr {
+
+/**
+ * Like Constring, but the characters live in program memory and are read with LPM, so they don't take
+ * any SRAM. Data must be placed in the lower 64 kB of flash (this is where avr-gcc puts .progmem data).
+ *
+ * Usage:
+ *   static constexpr char16_t kProduct[] PROGMEM = u"Widget";
+ *   FlashConstring<char16_t> product (kProduct);
+ */
+template<class pChar>
+	class FlashConstring
+	{
+		static_assert (sizeof (pChar) == 1 || sizeof (pChar) == 2, "only 8- and 16-bit characters are supported");
+
+	  public:
+		using Char = pChar;
+
+		class Iterator
+		{
+		  public:
+			// Ctor
+			constexpr
+			Iterator (Char const* position);
+
+			Char
+			operator*() const;
+
+			Iterator&
+			operator++();
+
+			constexpr bool
+			operator!= (Iterator const& other) const;
+
+		  private:
+			Char const* _position;
+		};
+
+	  public:
+		// Ctor
+		constexpr
+		FlashConstring() = default;
+
+		// Ctor
+		template<size_t N>
+			explicit constexpr
+			FlashConstring (Char const (&flash_data)[N]);
+
+		/**
+		 * Return pointer to the data in program memory.
+		 */
+		constexpr Char const*
+		data() const;
+
+		constexpr size_t
+		size() const;
+
+		/**
+		 * Read n-th character from flash.
+		 */
+		Char
+		operator[] (size_t n) const;
+
+		Iterator
+		begin() const;
+
+		Iterator
+		end() const;
+
+		/**
+		 * Copy characters, starting at given character position, into the target buffer.
+		 * Only whole characters are copied. Return number of bytes written.
+		 */
+		size_t
+		copy_to (Span<uint8_t> target, size_t first_char = 0) const;
+
+	  private:
+		/**
+		 * Read single character at given flash address.
+		 */
+		static Char
+		read (Char const*);
+
+	  private:
+		Char const*	_data	{ nullptr };
+		size_t		_size	{ 0 };
+	};
+
+
+template<class C>
+	constexpr
+	FlashConstring<C>::Iterator::Iterator (Char const* position):
+		_position (position)
+	{ }
+
+
+template<class C>
+	inline auto
+	FlashConstring<C>::Iterator::operator*() const -> Char
+	{
+		return read (_position);
+	}
+
+
+template<class C>
+	inline auto
+	FlashConstring<C>::Iterator::operator++() -> Iterator&
+	{
+		++_position;
+		return *this;
+	}
+
+
+template<class C>
+	constexpr bool
+	FlashConstring<C>::Iterator::operator!= (Iterator const& other) const
+	{
+		return _position != other._position;
+	}
+
+
+template<class C>
+	template<size_t N>
+		constexpr
+		FlashConstring<C>::FlashConstring (Char const (&flash_data)[N]):
+			_data (flash_data),
+			_size (N - 1) // -1 is not to count the "\0" from the string literal
+		{ }
+
+
+template<class C>
+	constexpr auto
+	FlashConstring<C>::data() const -> Char const*
+	{
+		return _data;
+	}
+
+
+template<class C>
+	constexpr size_t
+	FlashConstring<C>::size() const
+	{
+		return _size;
+	}
+
+
+template<class C>
+	inline auto
+	FlashConstring<C>::operator[] (size_t n) const -> Char
+	{
+		return read (_data + n);
+	}
+
+
+template<class C>
+	inline auto
+	FlashConstring<C>::begin() const -> Iterator
+	{
+		return Iterator (_data);
+	}
+
+
+template<class C>
+	inline auto
+	FlashConstring<C>::end() const -> Iterator
+	{
+		return Iterator (_data + _size);
+	}
+
+
+template<class C>
+	inline size_t
+	FlashConstring<C>::copy_to (Span<uint8_t> target, size_t first_char) const
+	{
+		if (first_char >= _size)
+			return 0;
+
+		size_t const chars_left = _size - first_char;
+		size_t const chars_fitting = target.size() / sizeof (Char);
+		size_t const bytes = (chars_left < chars_fitting ? chars_left : chars_fitting) * sizeof (Char);
+
+		flash_copy (target.data(), _data + first_char, bytes);
+		return bytes;
+	}
+
+
+template<class C>
+	inline auto
+	FlashConstring<C>::read (Char const* address) -> Char
+	{
+		if constexpr (sizeof (Char) == 1)
+			return static_cast<Char> (flash_read_byte (address));
+		else
+			return static_cast<Char> (flash_read_word (address));
+	}
+
+
+/*
+ * Global functions
+ */
+
+
+template<class C>
+	inline bool
+	operator== (FlashConstring<C> const& a, FlashConstring<C> const& b)
+	{
+		if (a.size() != b.size())
+			return false;
+
+		for (size_t i = 0; i < a.size(); ++i)
+			if (a[i] != b[i])
+				return false;
+
+		return true;
+	}
+
+
+template<class C>
+	inline bool
+	operator== (FlashConstring<C> const& a, Constring<C> const& b)
+	{
+		if (a.size() != b.size())
+			return false;
+
+		for (size_t i = 0; i < a.size(); ++i)
+			if (a[i] != b[i])
+				return false;
+
+		return true;
+	}
+
+
+template<class C>
+	inline bool
+	operator== (Constring<C> const& a, FlashConstring<C> const& b)
+	{
+		return b == a;
+	}
+
+} // namespace avr
+} // namespace mulabs
+
+#endif
+
@@ -0,0 +1,193 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__UTILITY__FLASH_SPAN_H__INCLUDED
+#define MULABS_AVR__UTILITY__FLASH_SPAN_H__INCLUDED
+
+// Standard:
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __AVR__
+// AVR:
+# include <avr/pgmspace.h>
+#else
+// Host builds have no separate program memory:
+# ifndef PROGMEM
+#  define PROGMEM
+# endif
+#endif
+
+// Mulabs:
+#include <mulabs_avr/utility/array.h>
+#include <mulabs_avr/utility/span.h>
+
+
+namespace mulabs {
+namespace avr {
+
+/**
+ * Read a byte from program memory (LPM).
+ */
+inline uint8_t
+flash_read_byte (void const* address)
+{
+#ifdef __AVR__
+	return pgm_read_byte (address);
+#else
+	return *static_cast<uint8_t const*> (address);
+#endif
+}
+
+
+/**
+ * Read a 16-bit word from program memory (LPM).
+ */
+inline uint16_t
+flash_read_word (void const* address)
+{
+#ifdef __AVR__
+	return pgm_read_word (address);
+#else
+	uint16_t result;
+	memcpy (&result, address, sizeof (result));
+	return result;
+#endif
+}
+
+
+/**
+ * Copy bytes from program memory to SRAM.
+ */
+inline void
+flash_copy (void* target, void const* flash_source, size_t bytes)
+{
+#ifdef __AVR__
+	memcpy_P (target, flash_source, bytes);
+#else
+	memcpy (target, flash_source, bytes);
+#endif
+}
+
+
+/**
+ * Span of bytes stored in program memory (eg. declared with PROGMEM).
+ * Bytes can't be referenced directly, only read or copied to SRAM.
+ */
+class FlashSpan
+{
+  public:
+	// Ctor
+	constexpr
+	FlashSpan() = default;
+
+	// Ctor
+	constexpr
+	FlashSpan (uint8_t const* flash_data, size_t size);
+
+	// Ctor
+	template<size_t N>
+		explicit constexpr
+		FlashSpan (Array<uint8_t, N> const& flash_array);
+
+	/**
+	 * Return pointer to the data in program memory.
+	 */
+	constexpr uint8_t const*
+	data() const;
+
+	constexpr size_t
+	size() const;
+
+	constexpr bool
+	empty() const;
+
+	/**
+	 * Read n-th byte from flash.
+	 */
+	uint8_t
+	operator[] (size_t n) const;
+
+	/**
+	 * Copy bytes starting at given offset into the target buffer, as many as fit.
+	 * Return number of bytes copied.
+	 */
+	size_t
+	copy_to (Span<uint8_t> target, size_t offset = 0) const;
+
+  private:
+	uint8_t const*	_data	{ nullptr };
+	size_t			_size	{ 0 };
+};
+
+
+constexpr
+FlashSpan::FlashSpan (uint8_t const* flash_data, size_t size):
+	_data (flash_data),
+	_size (size)
+{ }
+
+
+template<size_t N>
+	constexpr
+	FlashSpan::FlashSpan (Array<uint8_t, N> const& flash_array):
+		_data (flash_array.data()),
+		_size (N)
+	{ }
+
+
+constexpr uint8_t const*
+FlashSpan::data() const
+{
+	return _data;
+}
+
+
+constexpr size_t
+FlashSpan::size() const
+{
+	return _size;
+}
+
+
+constexpr bool
+FlashSpan::empty() const
+{
+	return _size == 0;
+}
+
+
+inline uint8_t
+FlashSpan::operator[] (size_t n) const
+{
+	return flash_read_byte (_data + n);
+}
+
+
+inline size_t
+FlashSpan::copy_to (Span<uint8_t> target, size_t offset) const
+{
+	if (offset >= _size)
+		return 0;
+
+	size_t const bytes = (_size - offset < target.size()) ? _size - offset : target.size();
+	flash_copy (target.data(), _data + offset, bytes);
+	return bytes;
+}
+
+} // namespace avr
+} // namespace mulabs
+
+#endif
+
@@ -18,6 +18,7 @@
 #include <stddef.h>
 
 // Local:
+#include <mulabs_avr/utility/array.h>
 #include <mulabs_avr/utility/bits.h>
 
 
@@ -257,6 +258,7 @@ template<class V>
 	Span<V>::remove_prefix (size_type n)
 	{
 		_data += n;
+		_size -= n;
 	}
 
 
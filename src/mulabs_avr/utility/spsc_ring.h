@@ -0,0 +1,369 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__UTILITY__SPSC_RING_H__INCLUDED
+#define MULABS_AVR__UTILITY__SPSC_RING_H__INCLUDED
+
+// Standard:
+#include <stddef.h>
+#include <stdint.h>
+
+// Mulabs:
+#include <mulabs_avr/utility/atomic.h>
+#include <mulabs_avr/utility/span.h>
+
+
+namespace mulabs {
+namespace avr {
+
+/**
+ * Lock-free single-producer/single-consumer ring buffer. One side (eg. an ISR) may push while
+ * the other side (eg. the main loop) pops, without disabling interrupts.
+ *
+ * Head and tail are free-running 8-bit counters, each written by only one side and published
+ * with Atomic stores. Number of elements is head - tail (mod 256), so the ring can hold all N elements
+ * without wasting a slot.
+ *
+ * For bulk transfers use push_span()/pop_span(), or access contiguous regions directly with
+ * free_region() + commit_push() and data_region() + commit_pop(), eg. to let a driver write
+ * straight into the ring.
+ *
+ * \param	pValue
+ *			Element type.
+ * \param	pCapacity
+ *			Number of elements. Must be a power of two, max 128.
+ */
+template<class pValue, size_t pCapacity>
+	class SpscRing
+	{
+		static_assert (pCapacity > 0 && (pCapacity & (pCapacity - 1)) == 0, "capacity must be a power of two");
+		static_assert (pCapacity <= 128, "capacity must fit 8-bit indices");
+
+	  public:
+		using Value = pValue;
+
+		static constexpr size_t kCapacity = pCapacity;
+
+	  public:
+		// Ctor
+		SpscRing() = default;
+
+		// Copy ctor
+		SpscRing (SpscRing const&) = delete;
+
+		// Copy operator
+		SpscRing const&
+		operator= (SpscRing const&) = delete;
+
+		/**
+		 * Return maximum number of elements.
+		 */
+		static constexpr size_t
+		capacity();
+
+		/**
+		 * Return number of elements ready to pop.
+		 * Exact when called by the consumer, lower bound otherwise.
+		 */
+		size_t
+		size() const;
+
+		/**
+		 * Return true if there's nothing to pop.
+		 */
+		bool
+		empty() const;
+
+		/**
+		 * Return true if nothing can be pushed.
+		 */
+		bool
+		full() const;
+
+		/*
+		 * Producer side
+		 */
+
+		/**
+		 * Push single element. Return false if ring is full.
+		 */
+		bool
+		push (Value const&);
+
+		/**
+		 * Push as many elements from the span as possible.
+		 * Return number of elements pushed.
+		 */
+		size_t
+		push_span (Span<Value const> values);
+
+		/**
+		 * Push all elements from the span or nothing, if there's not enough room.
+		 * Elements are published at once, so the consumer never sees only part of them.
+		 * Return true if pushed.
+		 */
+		bool
+		push_all (Span<Value const> values);
+
+		/**
+		 * Return the largest contiguous region that can be written without wrapping.
+		 * Fill it (or its prefix) and call commit_push().
+		 */
+		Span<Value>
+		free_region();
+
+		/**
+		 * Publish n elements written into the region returned by free_region().
+		 */
+		void
+		commit_push (size_t n);
+
+		/*
+		 * Consumer side
+		 */
+
+		/**
+		 * Pop single element. Return false if ring is empty.
+		 */
+		bool
+		pop (Value&);
+
+		/**
+		 * Pop as many elements as fit in the span.
+		 * Return number of elements popped.
+		 */
+		size_t
+		pop_span (Span<Value> values);
+
+		/**
+		 * Return the largest contiguous region of elements that can be read without wrapping.
+		 * Read it (or its prefix) and call commit_pop().
+		 */
+		Span<Value const>
+		data_region() const;
+
+		/**
+		 * Release n elements read from the region returned by data_region().
+		 */
+		void
+		commit_pop (size_t n);
+
+		/**
+		 * Drop all elements. Must be called by the consumer.
+		 */
+		void
+		clear();
+
+	  private:
+		static constexpr uint8_t
+		slot (uint8_t index);
+
+	  private:
+		Value			_data[kCapacity];
+		Atomic<uint8_t>	_head	{ 0 };	// Written only by producer.
+		Atomic<uint8_t>	_tail	{ 0 };	// Written only by consumer.
+	};
+
+
+template<class V, size_t C>
+	constexpr size_t
+	SpscRing<V, C>::capacity()
+	{
+		return kCapacity;
+	}
+
+
+template<class V, size_t C>
+	inline size_t
+	SpscRing<V, C>::size() const
+	{
+		return static_cast<uint8_t> (_head.load() - _tail.load());
+	}
+
+
+template<class V, size_t C>
+	inline bool
+	SpscRing<V, C>::empty() const
+	{
+		return size() == 0;
+	}
+
+
+template<class V, size_t C>
+	inline bool
+	SpscRing<V, C>::full() const
+	{
+		return size() == kCapacity;
+	}
+
+
+template<class V, size_t C>
+	inline bool
+	SpscRing<V, C>::push (Value const& value)
+	{
+		uint8_t const head = _head.load();
+
+		if (static_cast<uint8_t> (head - _tail.load()) == kCapacity)
+			return false;
+
+		_data[slot (head)] = value;
+		compiler_barrier();
+		_head.store (head + 1);
+		return true;
+	}
+
+
+template<class V, size_t C>
+	inline size_t
+	SpscRing<V, C>::push_span (Span<Value const> values)
+	{
+		size_t pushed = 0;
+
+		// At most two contiguous regions (before and after wrapping):
+		for (int i = 0; i < 2 && pushed < values.size(); ++i)
+		{
+			auto region = free_region();
+			size_t const n = region.size() < values.size() - pushed ? region.size() : values.size() - pushed;
+
+			for (size_t k = 0; k < n; ++k)
+				region[k] = values[pushed + k];
+
+			commit_push (n);
+			pushed += n;
+		}
+
+		return pushed;
+	}
+
+
+template<class V, size_t C>
+	inline bool
+	SpscRing<V, C>::push_all (Span<Value const> values)
+	{
+		uint8_t const head = _head.load();
+
+		if (kCapacity - static_cast<uint8_t> (head - _tail.load()) < values.size())
+			return false;
+
+		for (size_t i = 0; i < values.size(); ++i)
+			_data[slot (head + i)] = values[i];
+
+		compiler_barrier();
+		_head.store (head + values.size());
+		return true;
+	}
+
+
+template<class V, size_t C>
+	inline auto
+	SpscRing<V, C>::free_region() -> Span<Value>
+	{
+		uint8_t const head = _head.load();
+		size_t const free = kCapacity - static_cast<uint8_t> (head - _tail.load());
+		size_t const until_wrap = kCapacity - slot (head);
+
+		return { &_data[slot (head)], free < until_wrap ? free : until_wrap };
+	}
+
+
+template<class V, size_t C>
+	inline void
+	SpscRing<V, C>::commit_push (size_t n)
+	{
+		compiler_barrier();
+		_head.store (_head.load() + n);
+	}
+
+
+template<class V, size_t C>
+	inline bool
+	SpscRing<V, C>::pop (Value& value)
+	{
+		uint8_t const tail = _tail.load();
+
+		if (_head.load() == tail)
+			return false;
+
+		compiler_barrier();
+		value = _data[slot (tail)];
+		compiler_barrier();
+		_tail.store (tail + 1);
+		return true;
+	}
+
+
+template<class V, size_t C>
+	inline size_t
+	SpscRing<V, C>::pop_span (Span<Value> values)
+	{
+		size_t popped = 0;
+
+		// At most two contiguous regions (before and after wrapping):
+		for (int i = 0; i < 2 && popped < values.size(); ++i)
+		{
+			auto region = data_region();
+			size_t const n = region.size() < values.size() - popped ? region.size() : values.size() - popped;
+
+			for (size_t k = 0; k < n; ++k)
+				values[popped + k] = region[k];
+
+			commit_pop (n);
+			popped += n;
+		}
+
+		return popped;
+	}
+
+
+template<class V, size_t C>
+	inline auto
+	SpscRing<V, C>::data_region() const -> Span<Value const>
+	{
+		uint8_t const tail = _tail.load();
+		size_t const used = static_cast<uint8_t> (_head.load() - tail);
+		size_t const until_wrap = kCapacity - slot (tail);
+
+		compiler_barrier();
+		return { &_data[slot (tail)], used < until_wrap ? used : until_wrap };
+	}
+
+
+template<class V, size_t C>
+	inline void
+	SpscRing<V, C>::commit_pop (size_t n)
+	{
+		compiler_barrier();
+		_tail.store (_tail.load() + n);
+	}
+
+
+template<class V, size_t C>
+	inline void
+	SpscRing<V, C>::clear()
+	{
+		_tail.store (_head.load());
+	}
+
+
+template<class V, size_t C>
+	constexpr uint8_t
+	SpscRing<V, C>::slot (uint8_t index)
+	{
+		return index & (kCapacity - 1);
+	}
+
+} // namespace avr
+} // namespace mulabs
+
+#endif
+
@@ -0,0 +1,169 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__UTILITY__TRACE_H__INCLUDED
+#define MULABS_AVR__UTILITY__TRACE_H__INCLUDED
+
+// Standard:
+#include <stddef.h>
+#include <stdint.h>
+
+// Mulabs:
+#include <mulabs_avr/utility/atomic.h>
+#include <mulabs_avr/utility/span.h>
+#include <mulabs_avr/utility/spsc_ring.h>
+
+
+namespace mulabs {
+namespace avr {
+
+/**
+ * Definition of a trace event: its ID and types of its arguments (integers, at most 4).
+ * Format is a printf-style format used only by the TraceDecoder on the host (it gets each argument as unsigned int).
+ * The MCU only records the ID and the arguments, so the format string isn't referenced by the firmware.
+ *
+ *   static constexpr TraceEvent<0x12, uint16_t> kSetupStalled { "SETUP %04x stalled" };
+ *
+ * IDs must be unique in the firmware. Ranges used by the library:
+ *   0x10…0x1f	USB
+ */
+template<uint8_t pID, class ...pArgs>
+	struct TraceEvent
+	{
+		static_assert (sizeof... (pArgs) <= 4, "at most 4 arguments allowed");
+
+		static constexpr uint8_t	kID		= pID;
+		// Size of the record (ID and arguments):
+		static constexpr size_t		kSize	= 1 + (0 + ... + sizeof (pArgs));
+
+		char const*	format;
+	};
+
+
+/**
+ * Trace sink that does nothing. Trace points compile to nothing when it's used.
+ */
+struct NoTrace
+{
+	template<class ...Args>
+		constexpr void
+		operator() (Args&&...) const noexcept
+		{ }
+};
+
+
+/**
+ * Trace sink that records events in binary form into a lock-free ring buffer in RAM. Recording an event takes a few
+ * stores, so it's cheap enough to be used in interrupt handlers and left enabled in production. The main loop (or
+ * a low-priority task) drains the ring with ring().pop_span() and sends the bytes to the host (eg. over USART), where
+ * TraceDecoder turns them back into text.
+ *
+ * Each record is the event ID followed by the arguments, little-endian. Records are written whole or not at all;
+ * if there's no room, the event is dropped and counted (see dropped()).
+ *
+ * Single producer: record only from one interrupt level (or lock interrupts).
+ *
+ * \param	pCapacity
+ *			Ring size in bytes. Must be a power of two, max 128.
+ */
+template<size_t pCapacity>
+	class TraceRing
+	{
+	  public:
+		using Ring = SpscRing<uint8_t, pCapacity>;
+
+	  public:
+		/**
+		 * Record an event with given arguments.
+		 */
+		template<uint8_t vID, class ...EventArgs, class ...Args>
+			void
+			operator() (TraceEvent<vID, EventArgs...> const&, Args... args);
+
+		/**
+		 * Return the ring buffer for the consumer.
+		 */
+		Ring&
+		ring() noexcept;
+
+		/**
+		 * Return number of events dropped because the ring was full (saturates at 255).
+		 */
+		uint8_t
+		dropped() const noexcept;
+
+	  private:
+		template<class Value>
+			static void
+			put (uint8_t*& position, Value);
+
+	  private:
+		Ring			_ring;
+		Atomic<uint8_t>	_dropped	{ 0 };
+	};
+
+
+template<size_t C>
+	template<uint8_t vID, class ...EventArgs, class ...Args>
+		inline void
+		TraceRing<C>::operator() (TraceEvent<vID, EventArgs...> const&, Args... args)
+		{
+			static_assert (sizeof... (Args) == sizeof... (EventArgs), "number of arguments must match the event");
+
+			using Event = TraceEvent<vID, EventArgs...>;
+
+			uint8_t record[Event::kSize];
+			uint8_t* position = record;
+			*position++ = vID;
+			(put (position, static_cast<EventArgs> (args)), ...);
+
+			if (!_ring.push_all (Span<uint8_t const> (record, Event::kSize)))
+			{
+				uint8_t const dropped = _dropped.load();
+
+				if (dropped != 0xff)
+					_dropped.store (dropped + 1);
+			}
+		}
+
+
+template<size_t C>
+	inline auto
+	TraceRing<C>::ring() noexcept -> Ring&
+	{
+		return _ring;
+	}
+
+
+template<size_t C>
+	inline uint8_t
+	TraceRing<C>::dropped() const noexcept
+	{
+		return _dropped.load();
+	}
+
+
+template<size_t C>
+	template<class Value>
+		inline void
+		TraceRing<C>::put (uint8_t*& position, Value value)
+		{
+			for (size_t i = 0; i < sizeof (Value); ++i)
+				*position++ = static_cast<uint8_t> (value >> (8 * i));
+		}
+
+} // namespace avr
+} // namespace mulabs
+
+#endif
+
@@ -0,0 +1,151 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__UTILITY__TRACE_DECODER_H__INCLUDED
+#define MULABS_AVR__UTILITY__TRACE_DECODER_H__INCLUDED
+
+// Standard:
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Mulabs:
+#include <mulabs_avr/utility/span.h>
+#include <mulabs_avr/utility/trace.h>
+
+
+namespace mulabs {
+namespace avr {
+
+/**
+ * Host-side decoder of records written by TraceRing. Needs the same TraceEvent definitions as the firmware:
+ *
+ *   TraceDecoder decoder;
+ *   decoder.add (usb::TraceEvents::kBusReset, usb::TraceEvents::kSetup, …);
+ *   size_t consumed = decoder.decode (bytes, [] (char const* line) { puts (line); });
+ */
+class TraceDecoder
+{
+  public:
+	static constexpr size_t kMaxArgs = 4;
+
+  private:
+	struct Entry
+	{
+		char const*	format				{ nullptr };
+		uint8_t		args				{ 0 };
+		uint8_t		arg_sizes[kMaxArgs]	{ };
+	};
+
+  public:
+	/**
+	 * Add definitions of events.
+	 */
+	template<class ...Events>
+		void
+		add (Events const&...);
+
+	/**
+	 * Decode records and call output (char const* line) for each one.
+	 * Return number of bytes consumed. An incomplete record at the end is not consumed, so the rest of it can be
+	 * appended later. Decoding also stops at an event of unknown ID (it's reported to the output), since size
+	 * of its record isn't known; the byte with the unknown ID is consumed.
+	 */
+	template<class Output>
+		size_t
+		decode (Span<uint8_t const>, Output&&) const;
+
+  private:
+	template<uint8_t vID, class ...EventArgs>
+		void
+		add_one (TraceEvent<vID, EventArgs...> const&);
+
+  private:
+	Entry	_entries[256];
+};
+
+
+template<class ...Events>
+	inline void
+	TraceDecoder::add (Events const&... events)
+	{
+		(add_one (events), ...);
+	}
+
+
+template<class Output>
+	inline size_t
+	TraceDecoder::decode (Span<uint8_t const> data, Output&& output) const
+	{
+		size_t position = 0;
+		char line[256];
+
+		while (position < data.size())
+		{
+			uint8_t const id = data[position];
+			Entry const& entry = _entries[id];
+
+			if (!entry.format)
+			{
+				snprintf (line, sizeof (line), "unknown trace event 0x%02x", id);
+				output (static_cast<char const*> (line));
+				return position + 1;
+			}
+
+			size_t record_size = 1;
+
+			for (uint8_t a = 0; a < entry.args; ++a)
+				record_size += entry.arg_sizes[a];
+
+			if (data.size() - position < record_size)
+				break;
+
+			unsigned int args[kMaxArgs] = { };
+			size_t arg_position = position + 1;
+
+			for (uint8_t a = 0; a < entry.args; ++a)
+			{
+				for (uint8_t i = 0; i < entry.arg_sizes[a]; ++i)
+					args[a] |= static_cast<unsigned int> (data[arg_position + i]) << (8 * i);
+
+				arg_position += entry.arg_sizes[a];
+			}
+
+			snprintf (line, sizeof (line), entry.format, args[0], args[1], args[2], args[3]);
+			output (static_cast<char const*> (line));
+			position += record_size;
+		}
+
+		return position;
+	}
+
+
+template<uint8_t vID, class ...EventArgs>
+	inline void
+	TraceDecoder::add_one (TraceEvent<vID, EventArgs...> const& event)
+	{
+		Entry& entry = _entries[vID];
+		entry.format = event.format;
+		entry.args = sizeof... (EventArgs);
+
+		uint8_t const sizes[] = { sizeof (EventArgs)..., 0 };
+
+		for (uint8_t a = 0; a < entry.args; ++a)
+			entry.arg_sizes[a] = sizes[a];
+	}
+
+} // namespace avr
+} // namespace mulabs
+
+#endif
+
@@ -0,0 +1,207 @@
+/* vim:ts=4
+ *
+ * Copyleft 2012…2017  Michał Gawron
+ * Marduk Unix Labs, http://mulabs.org/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Visit http://www.gnu.org/licenses/gpl-3.0.html for more information on licensing.
+ */
+
+#ifndef MULABS_AVR__UTILITY__WIDE_ATOMIC_H__INCLUDED
+#define MULABS_AVR__UTILITY__WIDE_ATOMIC_H__INCLUDED
+
+// Standard:
+#include <stdint.h>
+
+// Mulabs:
+#include <mulabs_avr/avr/interrupts_lock.h>
+#include <mulabs_avr/utility/atomic.h>
+
+
+namespace mulabs {
+namespace avr {
+
+/**
+ * 16- or 32-bit value shared between an ISR and other code, which can't be read or written with a single
+ * instruction on AVR.
+ *
+ * Reads don't disable interrupts: they use a sequence counter (seqlock) which is odd while a write is in progress,
+ * and retry if the counter changed during the read. store() doesn't disable interrupts either, but there must be
+ * only one writer and it must not be preempted by a reader, otherwise the reader would spin forever.
+ * In practice: write from the ISR (or from the highest-priority context that uses the value) and read anywhere
+ * with lower priority.
+ *
+ * fetch_add() and compare_exchange() may be used from any context (also for readers, since interrupts are disabled
+ * while they write), but only for the few instructions of the read-modify-write. Don't mix them with store() called
+ * from code that they can preempt.
+ */
+template<class pValue>
+	class WideAtomic
+	{
+		static_assert (sizeof (pValue) == 2 || sizeof (pValue) == 4, "value must be 16 or 32 bits wide");
+
+	  public:
+		using Value = pValue;
+
+	  public:
+		// Ctor
+		WideAtomic() = default;
+
+		// Ctor
+		WideAtomic (Value initial_value);
+
+		// Copy ctor
+		WideAtomic (WideAtomic const&) = delete;
+
+		// Copy operator
+		WideAtomic const&
+		operator= (WideAtomic const&) = delete;
+
+		/**
+		 * Load value. Retries if a write happened during the read.
+		 */
+		Value
+		load() const;
+
+		/**
+		 * Try to load value once. Return false if a write happened during the read,
+		 * in which case the value is not touched. Useful where the writer may be preempted by the reader.
+		 */
+		bool
+		try_load (Value&) const;
+
+		/**
+		 * Store value. Only one context may call store(). See class description.
+		 */
+		void
+		store (Value);
+
+		/**
+		 * Add delta and return the previous value.
+		 */
+		Value
+		fetch_add (Value delta);
+
+		/**
+		 * If current value equals expected, store desired and return true.
+		 * Otherwise load current value into expected and return false.
+		 */
+		bool
+		compare_exchange (Value& expected, Value desired);
+
+	  private:
+		/**
+		 * Write value and bump sequence counter around it. Caller must ensure there's no concurrent writer.
+		 */
+		void
+		write (Value);
+
+	  private:
+		Atomic<uint8_t>	_sequence	{ 0 };
+		Value volatile	_value		{ };
+	};
+
+
+using Atomic16 = WideAtomic<uint16_t>;
+using Atomic32 = WideAtomic<uint32_t>;
+
+
+template<class V>
+	inline
+	WideAtomic<V>::WideAtomic (Value initial_value):
+		_value (initial_value)
+	{ }
+
+
+template<class V>
+	inline typename WideAtomic<V>::Value
+	WideAtomic<V>::load() const
+	{
+		Value value;
+
+		while (!try_load (value))
+			continue;
+
+		return value;
+	}
+
+
+template<class V>
+	inline bool
+	WideAtomic<V>::try_load (Value& value) const
+	{
+		uint8_t const sequence = _sequence.load();
+
+		if (sequence & 1)
+			return false;
+
+		Value const result = _value;
+
+		if (_sequence.load() != sequence)
+			return false;
+
+		value = result;
+		return true;
+	}
+
+
+template<class V>
+	inline void
+	WideAtomic<V>::store (Value value)
+	{
+		write (value);
+	}
+
+
+template<class V>
+	inline typename WideAtomic<V>::Value
+	WideAtomic<V>::fetch_add (Value delta)
+	{
+		InterruptsLock lock;
+
+		Value const previous = _value;
+		write (previous + delta);
+		return previous;
+	}
+
+
+template<class V>
+	inline bool
+	WideAtomic<V>::compare_exchange (Value& expected, Value desired)
+	{
+		InterruptsLock lock;
+
+		Value const current = _value;
+
+		if (current == expected)
+		{
+			write (desired);
+			return true;
+		}
+		else
+		{
+			expected = current;
+			return false;
+		}
+	}
+
+
+template<class V>
+	inline void
+	WideAtomic<V>::write (Value value)
+	{
+		// Both _sequence and _value are volatile, so the compiler keeps these in order:
+		_sequence.store (_sequence.load() + 1);
+		_value = value;
+		_sequence.store (_sequence.load() + 1);
+	}
+
+} // namespace avr
+} // namespace mulabs
+
+#endif
+